@@ -0,0 +1,109 @@
+//  id検索のベンチマーク
+//  ノード、ジオメトリ、マテリアルが大量にあるシーンを生成して解析時間を計る
+//  id索引が効いていればノード数に対してほぼ線形に伸びる
+
+
+#include "../tiny_collada_parser.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+
+namespace  {
+
+//----------------------------------------------------------------------
+//  ノードごとに別のジオメトリとマテリアルを参照する.daeを生成
+void makeScene(
+    int node_count,
+    std::string& out
+) {
+    const int material_count = node_count / 10 + 1;
+    char buf[512];
+
+    out.clear();
+    out += "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out += "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n";
+
+    //  エフェクト
+    out += "<library_effects>\n";
+    for (int i = 0; i < material_count; ++i) {
+        snprintf(buf, sizeof(buf),
+            "<effect id=\"fx%d\"><profile_COMMON><technique sid=\"common\"><phong>"
+            "<diffuse><color>0.5 0.5 0.5 1</color></diffuse></phong></technique></profile_COMMON></effect>\n",
+            i
+        );
+        out += buf;
+    }
+    out += "</library_effects>\n";
+
+    //  マテリアル
+    out += "<library_materials>\n";
+    for (int i = 0; i < material_count; ++i) {
+        snprintf(buf, sizeof(buf), "<material id=\"mat%d\"><instance_effect url=\"#fx%d\"/></material>\n", i, i);
+        out += buf;
+    }
+    out += "</library_materials>\n";
+
+    //  ジオメトリ(三角形1枚)
+    out += "<library_geometries>\n";
+    for (int i = 0; i < node_count; ++i) {
+        snprintf(buf, sizeof(buf),
+            "<geometry id=\"geo%d\"><mesh>"
+            "<source id=\"geo%d-pos\"><float_array id=\"geo%d-arr\" count=\"9\">0 0 0 1 0 0 0 1 0</float_array>"
+            "<technique_common><accessor source=\"#geo%d-arr\" count=\"3\" stride=\"3\"/></technique_common></source>"
+            "<vertices id=\"geo%d-vtx\"><input semantic=\"POSITION\" source=\"#geo%d-pos\"/></vertices>"
+            "<triangles count=\"1\"><input semantic=\"VERTEX\" source=\"#geo%d-vtx\" offset=\"0\"/><p>0 1 2</p></triangles>"
+            "</mesh></geometry>\n",
+            i, i, i, i, i, i, i
+        );
+        out += buf;
+    }
+    out += "</library_geometries>\n";
+
+    //  ノード
+    //  後ろのジオメトリほど線形探索では遠くなるよう、逆順に参照する
+    out += "<library_visual_scenes><visual_scene id=\"scene\">\n";
+    for (int i = 0; i < node_count; ++i) {
+        snprintf(buf, sizeof(buf),
+            "<node id=\"node%d\"><matrix>1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1</matrix>"
+            "<instance_geometry url=\"#geo%d\"><bind_material><technique_common>"
+            "<instance_material symbol=\"m\" target=\"#mat%d\"/></technique_common></bind_material>"
+            "</instance_geometry></node>\n",
+            i, node_count - 1 - i, (node_count - 1 - i) % material_count
+        );
+        out += buf;
+    }
+    out += "</visual_scene></library_visual_scenes>\n";
+    out += "<scene><instance_visual_scene url=\"#scene\"/></scene>\n</COLLADA>\n";
+}
+
+}   // unname namespace
+
+
+//----------------------------------------------------------------------
+//  sample
+void benchmark_id_index()
+{
+    const int NODE_COUNTS[] = {1000, 10000, 50000};
+
+    for (int i = 0; i < 3; ++i) {
+        std::string dae;
+        makeScene(NODE_COUNTS[i], dae);
+
+        tc::Parser parser;
+        auto start = std::chrono::steady_clock::now();
+        tc::Result result = parser.parse(dae.data(), dae.size());
+        std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+        if (result.isFailed()) {
+            printf("parse failed. nodes = %d\n", NODE_COUNTS[i]);
+            continue;
+        }
+
+        printf("nodes %6d  scenes %6lu  %8.3f sec  %8.2f us/node\n",
+            NODE_COUNTS[i],
+            static_cast<unsigned long>(parser.scenes()->size()),
+            sec.count(),
+            sec.count() * 1000000.0 / NODE_COUNTS[i]
+        );
+    }
+}
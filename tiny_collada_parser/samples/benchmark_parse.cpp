@@ -0,0 +1,547 @@
+//  解析ベンチマーク
+//  条件(頂点数、メッシュ数、インスタンス数、プリミティブ、属性)を指定して合成.daeを生成し、
+//  Parser::parse のスループット、ピークRSS、フェーズごとの時間を計る
+//  生成は乱数の種を固定しているので、同じ条件なら毎回同じファイルになる
+
+
+#include "../tiny_collada_parser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+#endif
+
+
+namespace  {
+
+//======================================================================
+//  生成条件
+struct CorpusSpec
+{
+    const char* name_;
+    int vertex_count_;          //  メッシュあたりの頂点数(格子にするので切り上がる)
+    int mesh_count_;
+    int instance_count_;        //  ノード数。メッシュを順番に参照する
+    bool polylist_;             //  true なら四角形の polylist、false なら triangles
+    bool normal_;
+    bool uv_;
+};
+
+//  小さい順に並べる。max_case でどこまで計るか選ぶ
+const CorpusSpec CORPUS[] = {
+    {"small_tri",       1000,       1,      1,      false,  true,   true},
+    {"small_poly_pos",  1000,       1,      1,      true,   false,  false},
+    {"many_meshes",     1000,       100,    1000,   true,   true,   true},
+    {"large_tri",       1000000,    1,      4,      false,  true,   true},
+    {"huge_poly",       8000000,    1,      1,      true,   true,   true},
+};
+const int CORPUS_NUM = sizeof(CORPUS) / sizeof(CORPUS[0]);
+
+
+//======================================================================
+//  解析設定
+struct ParseMode
+{
+    const char* name_;
+    bool streaming_;
+    unsigned int thread_count_;
+};
+
+const ParseMode MODES[] = {
+    {"dom",     false,  1},
+    {"stream",  true,   1},
+    {"dom-mt",  false,  0},
+};
+const int MODE_NUM = sizeof(MODES) / sizeof(MODES[0]);
+
+
+//======================================================================
+//  書き出しバッファ
+//  GB単位のファイルも作るので、まとめて fwrite する
+class Writer
+{
+public:
+    explicit Writer(
+        FILE* fp
+    )   : fp_(fp)
+        , buffer_()
+        , written_(0)
+    {
+        buffer_.reserve(BUFFER_SIZE + 256);
+    }
+
+    ~Writer() {
+        flush();
+    }
+
+    Writer& operator=(const Writer&) = delete;	// コピーの禁止
+    Writer(const Writer&) = delete;
+
+public:
+    void text(
+        const char* str
+    ) {
+        buffer_ += str;
+        flushIfFull();
+    }
+
+    template <typename... Args>
+    void format(
+        const char* fmt,
+        Args... args
+    ) {
+        char buf[256];
+        int len = snprintf(buf, sizeof(buf), fmt, args...);
+        if (len > 0) {
+            buffer_.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+        }
+        flushIfFull();
+    }
+
+    void flush() {
+        if (!buffer_.empty()) {
+            written_ += std::fwrite(buffer_.data(), 1, buffer_.size(), fp_);
+            buffer_.clear();
+        }
+    }
+
+    size_t getWrittenBytes() const {
+        return written_ + buffer_.size();
+    }
+
+private:
+    void flushIfFull() {
+        if (buffer_.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    static const size_t BUFFER_SIZE = 4 * 1024 * 1024;
+
+    FILE* fp_;
+    std::string buffer_;
+    size_t written_;
+};
+
+
+//----------------------------------------------------------------------
+//  格子の一辺の頂点数
+int getGridSide(
+    const CorpusSpec& spec
+) {
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(spec.vertex_count_))));
+    return side < 2 ? 2 : side;
+}
+
+//----------------------------------------------------------------------
+//  三角形数(四角形は2枚と数える)
+uint64_t getTriangleCount(
+    const CorpusSpec& spec
+) {
+    uint64_t quads = static_cast<uint64_t>(getGridSide(spec) - 1) * (getGridSide(spec) - 1);
+    return quads * 2 * spec.mesh_count_;
+}
+
+//----------------------------------------------------------------------
+//  線形合同法
+float nextRandom(
+    uint32_t& seed
+) {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / 16777216.0f;
+}
+
+//----------------------------------------------------------------------
+//  float_array を持つ source を書く
+void writeSource(
+    Writer& out,
+    int mesh_idx,
+    const char* suffix,
+    int count,
+    int stride,
+    const std::vector<float>& values
+) {
+    out.format("<source id=\"geo%d-%s\"><float_array id=\"geo%d-%s-array\" count=\"%d\">",
+        mesh_idx, suffix, mesh_idx, suffix, count * stride
+    );
+    for (size_t i = 0; i < values.size(); ++i) {
+        out.format(i == 0 ? "%.6g" : " %.6g", values[i]);
+    }
+    out.format("</float_array><technique_common><accessor source=\"#geo%d-%s-array\" count=\"%d\" stride=\"%d\"/>"
+        "</technique_common></source>\n",
+        mesh_idx, suffix, count, stride
+    );
+}
+
+//----------------------------------------------------------------------
+//  メッシュを1つ書く
+//  格子状の頂点を四角形(または三角形2枚)でつなぐ。全属性で同じインデックスを使う
+void writeGeometry(
+    Writer& out,
+    const CorpusSpec& spec,
+    int mesh_idx,
+    uint32_t& seed
+) {
+    const int side = getGridSide(spec);
+    const int vertex_count = side * side;
+    const int quad_count = (side - 1) * (side - 1);
+    std::vector<float> values;
+
+    out.format("<geometry id=\"geo%d\"><mesh>\n", mesh_idx);
+
+    //  位置
+    values.clear();
+    values.reserve(vertex_count * 3);
+    for (int y = 0; y < side; ++y) {
+        for (int x = 0; x < side; ++x) {
+            values.push_back(static_cast<float>(x));
+            values.push_back(static_cast<float>(y));
+            values.push_back(nextRandom(seed) * 0.5f);
+        }
+    }
+    writeSource(out, mesh_idx, "pos", vertex_count, 3, values);
+
+    //  法線
+    if (spec.normal_) {
+        values.clear();
+        for (int i = 0; i < vertex_count; ++i) {
+            float nx = nextRandom(seed) * 0.2f - 0.1f;
+            float ny = nextRandom(seed) * 0.2f - 0.1f;
+            float len = std::sqrt(nx * nx + ny * ny + 1.0f);
+            values.push_back(nx / len);
+            values.push_back(ny / len);
+            values.push_back(1.0f / len);
+        }
+        writeSource(out, mesh_idx, "nrm", vertex_count, 3, values);
+    }
+
+    //  uv
+    if (spec.uv_) {
+        values.clear();
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x) {
+                values.push_back(static_cast<float>(x) / (side - 1));
+                values.push_back(static_cast<float>(y) / (side - 1));
+            }
+        }
+        writeSource(out, mesh_idx, "uv", vertex_count, 2, values);
+    }
+
+    out.format("<vertices id=\"geo%d-vtx\"><input semantic=\"POSITION\" source=\"#geo%d-pos\"/></vertices>\n",
+        mesh_idx, mesh_idx
+    );
+
+    //  プリミティブ
+    int input_count = 1;
+    if (spec.polylist_) {
+        out.format("<polylist material=\"mat\" count=\"%d\">", quad_count);
+    }
+    else {
+        out.format("<triangles material=\"mat\" count=\"%d\">", quad_count * 2);
+    }
+    out.format("<input semantic=\"VERTEX\" source=\"#geo%d-vtx\" offset=\"0\"/>", mesh_idx);
+    if (spec.normal_) {
+        out.format("<input semantic=\"NORMAL\" source=\"#geo%d-nrm\" offset=\"%d\"/>", mesh_idx, input_count++);
+    }
+    if (spec.uv_) {
+        out.format("<input semantic=\"TEXCOORD\" source=\"#geo%d-uv\" offset=\"%d\" set=\"0\"/>", mesh_idx, input_count++);
+    }
+    out.text("\n");
+
+    if (spec.polylist_) {
+        out.text("<vcount>");
+        for (int i = 0; i < quad_count; ++i) {
+            out.text(i == 0 ? "4" : " 4");
+        }
+        out.text("</vcount>\n");
+    }
+
+    out.text("<p>");
+    for (int y = 0; y + 1 < side; ++y) {
+        for (int x = 0; x + 1 < side; ++x) {
+            int v0 = y * side + x;
+            int v1 = v0 + 1;
+            int v2 = v0 + side + 1;
+            int v3 = v0 + side;
+            int quad[6] = {v0, v1, v2, v3, 0, 0};
+            int tris[6] = {v0, v1, v2, v0, v2, v3};
+            const int* corners = spec.polylist_ ? quad : tris;
+            int corner_count = spec.polylist_ ? 4 : 6;
+            for (int c = 0; c < corner_count; ++c) {
+                for (int input = 0; input < input_count; ++input) {
+                    out.format("%d ", corners[c]);
+                }
+            }
+        }
+    }
+    out.text("</p>\n");
+    out.text(spec.polylist_ ? "</polylist>" : "</triangles>");
+    out.text("</mesh></geometry>\n");
+}
+
+//----------------------------------------------------------------------
+//  .daeを生成
+//  書き出したバイト数を返す。失敗したら0
+size_t writeCorpus(
+    const CorpusSpec& spec,
+    const char* path
+) {
+    FILE* fp = std::fopen(path, "wb");
+    if (!fp) {
+        return 0;
+    }
+
+    size_t bytes = 0;
+    {
+        Writer out(fp);
+        uint32_t seed = 12345;
+
+        out.text("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+        out.text("<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n");
+
+        //  マテリアル
+        out.text("<library_effects><effect id=\"fx\"><profile_COMMON><technique sid=\"common\"><phong>"
+            "<diffuse><color>0.8 0.8 0.8 1</color></diffuse></phong></technique></profile_COMMON></effect>"
+            "</library_effects>\n");
+        out.text("<library_materials><material id=\"mat\"><instance_effect url=\"#fx\"/></material>"
+            "</library_materials>\n");
+
+        //  ジオメトリ
+        out.text("<library_geometries>\n");
+        for (int i = 0; i < spec.mesh_count_; ++i) {
+            writeGeometry(out, spec, i, seed);
+        }
+        out.text("</library_geometries>\n");
+
+        //  ノード
+        out.text("<library_visual_scenes><visual_scene id=\"scene\">\n");
+        for (int i = 0; i < spec.instance_count_; ++i) {
+            out.format("<node id=\"node%d\"><matrix>1 0 0 %d 0 1 0 0 0 0 1 0 0 0 0 1</matrix>", i, i);
+            out.format("<instance_geometry url=\"#geo%d\"><bind_material><technique_common>"
+                "<instance_material symbol=\"mat\" target=\"#mat\"/></technique_common></bind_material>"
+                "</instance_geometry></node>\n",
+                i % spec.mesh_count_
+            );
+        }
+        out.text("</visual_scene></library_visual_scenes>\n");
+        out.text("<scene><instance_visual_scene url=\"#scene\"/></scene>\n</COLLADA>\n");
+
+        out.flush();
+        bytes = out.getWrittenBytes();
+    }
+
+    if (std::fclose(fp) != 0) {
+        return 0;
+    }
+    return bytes;
+}
+
+
+//----------------------------------------------------------------------
+//  ピークRSSの計測開始
+//  Linux はピーク値を戻せるので計測ごとに戻す。他はプロセス開始からのピークになる
+void resetPeakRss()
+{
+#if defined(__linux__)
+    FILE* fp = std::fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        std::fputs("5", fp);
+        std::fclose(fp);
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+//  ピークRSS(バイト)
+size_t getPeakRss()
+{
+#if defined(__linux__)
+    FILE* fp = std::fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        size_t kb = 0;
+        while (std::fgets(line, sizeof(line), fp)) {
+            if (std::sscanf(line, "VmHWM: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        std::fclose(fp);
+        return kb * 1024;
+    }
+    return 0;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss);
+#elif defined(__unix__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
+
+
+//======================================================================
+//  1条件の計測結果
+struct Measurement
+{
+    bool succeeded_;
+    double best_sec_;
+    double median_sec_;
+    size_t peak_rss_;
+    tc::ParseStatistics statistics_;    //  最速回のもの
+};
+
+//----------------------------------------------------------------------
+//  指定回数解析して計る
+//  毎回新しい Parser を使うので、解析結果の解放も計測に含まれない
+Measurement measure(
+    const char* path,
+    const ParseMode& mode,
+    int repeat
+) {
+    Measurement result;
+    result.succeeded_ = true;
+    result.best_sec_ = 0.0;
+    result.median_sec_ = 0.0;
+    result.peak_rss_ = 0;
+
+    std::vector<double> seconds;
+    resetPeakRss();
+    for (int i = 0; i < repeat; ++i) {
+        tc::Parser parser;
+        parser.setStreamingMode(mode.streaming_);
+        parser.setThreadCount(mode.thread_count_);
+        parser.setStatisticsEnabled(true);
+
+        auto start = std::chrono::steady_clock::now();
+        tc::Result parse_result = parser.parse(path);
+        std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+        if (parse_result.isFailed()) {
+            result.succeeded_ = false;
+            return result;
+        }
+
+        if (seconds.empty() || sec.count() < *std::min_element(seconds.begin(), seconds.end())) {
+            result.statistics_ = parser.getStatistics();
+        }
+        seconds.push_back(sec.count());
+    }
+    result.peak_rss_ = getPeakRss();
+
+    std::sort(seconds.begin(), seconds.end());
+    result.best_sec_ = seconds.front();
+    result.median_sec_ = seconds[seconds.size() / 2];
+    return result;
+}
+
+//----------------------------------------------------------------------
+//  フェーズごとの時間を表示
+void printPhases(
+    const tc::ParseStatistics& statistics
+) {
+    printf("    phases:");
+    for (int i = 0; i < tc::ParseStatistics::PHASE_COUNT; ++i) {
+        tc::ParseStatistics::Phase phase = static_cast<tc::ParseStatistics::Phase>(i);
+        if (statistics.phase_seconds_[i] > 0.0) {
+            printf(" %s %.4f", tc::ParseStatistics::getPhaseName(phase), statistics.phase_seconds_[i]);
+        }
+    }
+    printf("\n");
+}
+
+}   // unname namespace
+
+
+//----------------------------------------------------------------------
+//  sample
+//  work_dir に合成.daeを作って計測し、計測後に消す
+//  max_case は CORPUS の何番目まで計るか(大きいものは GB 単位になる)
+//  slo_mb_per_sec に0より大きい値を指定すると、最速回のスループットがそれを下回った条件を NG と表示する
+void benchmark_parse(
+    const char* const work_dir,
+    int max_case,
+    int repeat,
+    double slo_mb_per_sec
+) {
+    if (repeat < 1) {
+        repeat = 1;
+    }
+
+    printf("%-16s %-8s %10s %10s %10s %10s %10s %10s %s\n",
+        "case", "mode", "size(MB)", "best(s)", "median(s)", "MB/s", "Mtri/s", "peak(MB)", "slo"
+    );
+
+    int failed_count = 0;
+    for (int case_idx = 0; case_idx < CORPUS_NUM && case_idx <= max_case; ++case_idx) {
+        const CorpusSpec& spec = CORPUS[case_idx];
+        std::string path = std::string(work_dir) + "/" + spec.name_ + ".dae";
+        size_t bytes = writeCorpus(spec, path.c_str());
+        if (bytes == 0) {
+            printf("%-16s write failed. %s\n", spec.name_, path.c_str());
+            continue;
+        }
+        double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+        double mtri = static_cast<double>(getTriangleCount(spec)) / 1000000.0;
+
+        for (int mode_idx = 0; mode_idx < MODE_NUM; ++mode_idx) {
+            const ParseMode& mode = MODES[mode_idx];
+            Measurement m = measure(path.c_str(), mode, repeat);
+            if (!m.succeeded_) {
+                printf("%-16s %-8s parse failed.\n", spec.name_, mode.name_);
+                ++failed_count;
+                continue;
+            }
+
+            double throughput = mb / m.best_sec_;
+            const char* slo = "-";
+            if (slo_mb_per_sec > 0.0) {
+                slo = throughput >= slo_mb_per_sec ? "OK" : "NG";
+                if (throughput < slo_mb_per_sec) {
+                    ++failed_count;
+                }
+            }
+            printf("%-16s %-8s %10.2f %10.4f %10.4f %10.1f %10.2f %10.1f %s\n",
+                spec.name_,
+                mode.name_,
+                mb,
+                m.best_sec_,
+                m.median_sec_,
+                throughput,
+                mtri / m.best_sec_,
+                static_cast<double>(m.peak_rss_) / (1024.0 * 1024.0),
+                slo
+            );
+            printPhases(m.statistics_);
+        }
+
+        std::remove(path.c_str());
+    }
+
+    if (slo_mb_per_sec > 0.0) {
+        printf("%s (%d failed)\n", failed_count == 0 ? "SLO passed" : "SLO failed", failed_count);
+    }
+}
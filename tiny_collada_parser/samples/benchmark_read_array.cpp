@@ -0,0 +1,194 @@
+//  数値テキスト解析のベンチマーク
+//  旧実装(strtok + atof)と tc::readFloatArray / tc::readIndexArray の速度を比較する
+
+
+#include "../tiny_collada_parser.hpp"
+#include "../third_party_libs/tinyxml2/tinyxml2.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace  {
+
+//----------------------------------------------------------------------
+//  旧実装
+template <typename T>
+void legacyReadArray(
+    const char* text,
+    std::vector<T>* container
+){
+    char* value_str = std::strtok(const_cast<char*>(text), " ");
+    while (value_str) {
+        T v = static_cast<T>(atof(value_str));
+        container->push_back(v);
+        value_str = std::strtok(nullptr, " ");
+    }
+}
+
+//----------------------------------------------------------------------
+//  経過秒
+double elapsedSec(
+    std::chrono::steady_clock::time_point start
+) {
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+//----------------------------------------------------------------------
+//  計測結果表示
+void report(
+    const char* label,
+    size_t bytes,
+    size_t values,
+    double legacy_sec,
+    double current_sec
+) {
+    double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    printf("%-10s %10.1f MB %12lu values  legacy %8.1f MB/s  current %8.1f MB/s  (x%.2f)\n",
+        label,
+        mb,
+        static_cast<unsigned long>(values),
+        mb / legacy_sec,
+        mb / current_sec,
+        legacy_sec / current_sec
+    );
+}
+
+//----------------------------------------------------------------------
+//  テキストを計測
+//  旧実装はテキストを破壊するので計測外でコピーしておく
+void measure(
+    const char* label,
+    const std::string& float_text,
+    const std::string& index_text
+) {
+    //  float
+    {
+        std::string work = float_text;
+        std::vector<float> legacy;
+        std::vector<float> current;
+        legacy.reserve(float_text.size() / 4);
+        current.reserve(float_text.size() / 4);
+
+        auto start = std::chrono::steady_clock::now();
+        legacyReadArray(&work[0], &legacy);
+        double legacy_sec = elapsedSec(start);
+
+        start = std::chrono::steady_clock::now();
+        tc::readFloatArray(float_text.data(), float_text.size(), &current);
+        double current_sec = elapsedSec(start);
+
+        if (legacy.size() != current.size()) {
+            printf("%s float count mismatch %lu != %lu\n", label, legacy.size(), current.size());
+        }
+        std::string name = std::string(label) + " float";
+        report(name.c_str(), float_text.size(), current.size(), legacy_sec, current_sec);
+    }
+
+    //  index
+    {
+        std::string work = index_text;
+        tc::Indices legacy;
+        tc::Indices current;
+        legacy.reserve(index_text.size() / 2);
+        current.reserve(index_text.size() / 2);
+
+        auto start = std::chrono::steady_clock::now();
+        legacyReadArray(&work[0], &legacy);
+        double legacy_sec = elapsedSec(start);
+
+        start = std::chrono::steady_clock::now();
+        tc::readIndexArray(index_text.data(), index_text.size(), &current);
+        double current_sec = elapsedSec(start);
+
+        if (legacy.size() != current.size()) {
+            printf("%s index count mismatch %lu != %lu\n", label, legacy.size(), current.size());
+        }
+        std::string name = std::string(label) + " index";
+        report(name.c_str(), index_text.size(), current.size(), legacy_sec, current_sec);
+    }
+}
+
+//----------------------------------------------------------------------
+//  .daeから float_array と p のテキストを抜き出す
+void collectTexts(
+    const tinyxml2::XMLElement* element,
+    std::string& float_text,
+    std::string& index_text
+) {
+    while (element) {
+        const char* text = element->GetText();
+        if (text) {
+            if (std::strcmp(element->Name(), "float_array") == 0) {
+                float_text += text;
+                float_text += ' ';
+            }
+            else if (std::strcmp(element->Name(), "p") == 0) {
+                index_text += text;
+                index_text += ' ';
+            }
+        }
+        collectTexts(element->FirstChildElement(), float_text, index_text);
+        element = element->NextSiblingElement();
+    }
+}
+
+//----------------------------------------------------------------------
+//  合成データ生成
+//  旧実装はスペース区切りしか扱えないので区切りはスペースのみ
+void makeSyntheticTexts(
+    size_t bytes,
+    std::string& float_text,
+    std::string& index_text
+) {
+    float_text.reserve(bytes + 32);
+    index_text.reserve(bytes + 32);
+    uint32_t seed = 12345;
+    char buf[32];
+    while (float_text.size() < bytes) {
+        seed = seed * 1664525u + 1013904223u;
+        float v = (static_cast<float>(seed >> 8) / 16777216.0f - 0.5f) * 200.0f;
+        int len = snprintf(buf, sizeof(buf), "%.6g ", v);
+        float_text.append(buf, len);
+    }
+    while (index_text.size() < bytes) {
+        seed = seed * 1664525u + 1013904223u;
+        int len = snprintf(buf, sizeof(buf), "%u ", seed >> 12);
+        index_text.append(buf, len);
+    }
+}
+
+}   // unname namespace
+
+
+//----------------------------------------------------------------------
+//  sample
+//  synthetic_mb に0を指定すると合成データの計測は行わない
+void benchmark_read_array(
+    const char* const dae_path,
+    size_t synthetic_mb
+) {
+    //  実ファイル(nanosuit.daeなど)
+    tinyxml2::XMLDocument doc;
+    if (doc.LoadFile(dae_path) == tinyxml2::XML_SUCCESS) {
+        std::string float_text;
+        std::string index_text;
+        collectTexts(doc.RootElement(), float_text, index_text);
+        measure("dae", float_text, index_text);
+    }
+    else {
+        printf("load failed. %s\n", dae_path);
+    }
+
+    //  合成データ
+    if (synthetic_mb > 0) {
+        std::string float_text;
+        std::string index_text;
+        makeSyntheticTexts(synthetic_mb * 1024 * 1024, float_text, index_text);
+        measure("synthetic", float_text, index_text);
+    }
+}
@@ -99,9 +99,30 @@ void keyboard(unsigned char key , int x , int y) {
 
 
 //----------------------------------------------------------------------
-//	メッシュの描画
-void drawMesh(std::shared_ptr<const tc::ColladaMesh> mesh)
+//	マテリアル設定
+void setMaterial(std::shared_ptr<const tc::ColladaMaterial> material)
 {
+    if (!material) {
+        return;
+    }
+    if (!material->diffuse_.empty()){
+        //  ディフューズ
+        glMaterialfv(GL_FRONT, GL_DIFFUSE, material->diffuse_.data());
+    }
+    if (!material->ambient_.empty()) {
+        //  アンビエント
+        glMaterialfv(GL_FRONT, GL_AMBIENT, material->ambient_.data());
+    }
+}
+
+
+//----------------------------------------------------------------------
+//	メッシュの描画
+//  頂点データは1回だけ設定し、サブメッシュごとにマテリアルを切り替えて描く
+void drawMesh(
+    std::shared_ptr<const tc::ColladaScene> scene,
+    std::shared_ptr<const tc::ColladaMesh> mesh
+) {
     bool has_vertex = mesh->hasVertex();
     bool has_normal = mesh->hasNormal();
     bool has_uv = mesh->hasTexCoord();
@@ -137,12 +158,18 @@ void drawMesh(std::shared_ptr<const tc::ColladaMesh> mesh)
 
 	//	描画
     int draw_type = GL_TRIANGLES;
-    glDrawElements(
-        draw_type,
-        static_cast<GLsizei>(pos->indices_.size()),
-        GL_UNSIGNED_INT,
-        pos->indices_.data()
-    );
+    const tc::IndexBuffer* indices = mesh->getIndexBuffer();
+    const std::vector<tc::ColladaMesh::SubMesh>& submeshes = *mesh->getSubMeshes();
+    for (int i = 0; i < submeshes.size(); ++i) {
+        const tc::ColladaMesh::SubMesh& submesh = submeshes[i];
+        setMaterial(scene->findMaterial(submesh.material_));
+        glDrawElements(
+            draw_type,
+            static_cast<GLsizei>(submesh.index_count_),
+            indices->getType() == tc::IndexBuffer::TYPE_UINT16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+            static_cast<const char*>(indices->data()) + submesh.index_offset_ * indices->getElementSize()
+        );
+    }
 
 	//	設定を戻す
     if (has_vertex) {
@@ -189,17 +216,6 @@ void display()
     uint32_t scene_count = scenes_->size();
     for (int i = 0; i < scene_count; ++i) {
         std::shared_ptr<const tc::ColladaScene> s = scenes_->at(i);
-        std::shared_ptr<const tc::ColladaMaterial> material = s->material_;
-
-        //  マテリアル設定
-        if (!material->diffuse_.empty()){
-            //  ディフューズ
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, material->diffuse_.data());
-        }
-        if (!material->ambient_.empty()) {
-            //  アンビエント
-            glMaterialfv(GL_FRONT, GL_AMBIENT, material->ambient_.data());
-        }
 
         //  基本のSRT行列設定
         glLoadMatrixf(s->matrix_.data());
@@ -207,7 +223,7 @@ void display()
         //  メッシュ描画
         const tc::ColladaMeshes& ms = s->meshes_;
         for (int j = 0; j < ms.size(); ++j) {
-            drawMesh(ms[j]);
+            drawMesh(s, ms[j]);
         }
 
     }
@@ -4,12 +4,31 @@
 #include "../tiny_collada_parser.hpp"
 
 
+namespace  {
+
+//----------------------------------------------------------------------
+//  解析中のログをコンソールに出す
+void printLog(
+    tc::LogLevel level,
+    const char* message,
+    void* /*user_data*/
+) {
+    const char* LEVEL_NAME[] = {"", "ERROR", "WARNING", "INFO", "DEBUG"};
+    printf("[%s] %s\n", LEVEL_NAME[level], message);
+}
+
+}   // unname namespace
+
+
 //----------------------------------------------------------------------
 //  sample
 void sample01(
     const char* const dae_path
 ) {
     tc::Parser parser;
+    parser.setLogSink(printLog);
+    parser.setLogLevel(tc::LOG_INFO);
+
     //  daeを解析
     parser.parse(dae_path);
 
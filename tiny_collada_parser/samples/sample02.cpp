@@ -10,7 +10,7 @@ const tc::ColladaScenes* scenes_ = nullptr;
 
 //----------------------------------------------------------------------
 //	メッシュの描画
-void drawMesh(std::shared_ptr<tc::ColladaMesh> mesh)
+void drawMesh(std::shared_ptr<const tc::ColladaMesh> mesh)
 {
 	//	頂点取得
     const tc::ColladaMesh::ArrayData* pos = mesh->getVertex();
@@ -22,11 +22,13 @@ void drawMesh(std::shared_ptr<tc::ColladaMesh> mesh)
     glVertexPointer(pos->stride_, GL_FLOAT, 0, pos->data_.data());
 
 	//	描画
+    //  インデックスの幅はメッシュごとに16bitか32bit
+    const tc::IndexBuffer* indices = mesh->getIndexBuffer();
     glDrawElements(
         GL_TRIANGLES,
-        static_cast<GLsizei>(pos->indices_.size()),
-        GL_UNSIGNED_INT,
-        pos->indices_.data()
+        static_cast<GLsizei>(indices->size()),
+        indices->getType() == tc::IndexBuffer::TYPE_UINT16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+        indices->data()
     );
 
 	//	設定を戻す
@@ -42,7 +44,7 @@ void display()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
 
-	std::shared_ptr<tc::ColladaMesh> mesh = scenes_->at(0)->meshes_.at(0);
+	std::shared_ptr<const tc::ColladaMesh> mesh = scenes_->at(0)->meshes_.at(0);
 
 	//	カメラ設定
 	glMatrixMode(GL_MODELVIEW);
@@ -0,0 +1,49 @@
+//  バイナリキャッシュを使って読み込む
+//  キャッシュが無いか元の.daeが変わっていれば解析し直してキャッシュを作る
+
+
+#include "../tiny_collada_parser.hpp"
+
+
+//----------------------------------------------------------------------
+//  sample
+void sample03(
+    const char* const dae_path,
+    const char* const cache_path
+) {
+    tc::SceneCache cache;
+    tc::Result result = cache.open(cache_path, dae_path);
+    if (result.isFailed()) {
+        //  daeを解析してキャッシュを作る
+        tc::Parser parser;
+        result = parser.parse(dae_path);
+        if (result.isFailed()) {
+            printf("parse failed. %s\n", dae_path);
+            return;
+        }
+        parser.writeCache(cache_path, dae_path);
+        result = cache.open(cache_path, dae_path);
+        if (result.isFailed()) {
+            printf("cache open failed. %s\n", cache_path);
+            return;
+        }
+    }
+
+    //  キャッシュ上のデータをそのまま参照する
+    printf("scene count = %lu\n", cache.getSceneCount());
+    for (size_t scene_idx = 0; scene_idx < cache.getSceneCount(); ++scene_idx) {
+        tc::SceneCache::Scene scene = cache.getScene(scene_idx);
+        for (size_t i = 0; i < scene.meshes_.size(); ++i) {
+            tc::SceneCache::Mesh mesh = cache.getMesh(scene.meshes_[i]);
+            printf("  mesh %u  vertices %lu  indices %lu\n",
+                scene.meshes_[i],
+                mesh.vertex_.data_.size(),
+                mesh.getIndexCount()
+            );
+        }
+        if (scene.material_ >= 0) {
+            tc::SceneCache::Material material = cache.getMaterial(scene.material_);
+            printf("  material %s\n", material.shading_name_ ? material.shading_name_ : "-");
+        }
+    }
+}
@@ -0,0 +1,62 @@
+//  複数の.daeをまとめて並列に解析する
+//  解析中のファイルの合計サイズを抑えながら、終わったファイルから順に結果を受け取る
+
+
+#include "../tiny_collada_parser.hpp"
+#include <mutex>
+
+
+namespace  {
+
+//  コールバックは複数のスレッドから呼ばれるので出力は排他する
+std::mutex print_mutex;
+
+//----------------------------------------------------------------------
+//  各スレッドの Parser の設定
+void setupParser(
+    tc::Parser& parser,
+    void* /*user_data*/
+) {
+    parser.setStreamingMode(true);
+}
+
+//----------------------------------------------------------------------
+//  1ファイル解析し終えるたびに呼ばれる
+void onParsed(
+    size_t index,
+    const char* path,
+    tc::Result result,
+    const tc::ColladaScenes* scenes,
+    void* /*user_data*/
+) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    if (result.isFailed()) {
+        printf("[%lu] %s  parse failed. %s\n", index, path, result.getErrorMessage());
+        return;
+    }
+    size_t mesh_count = 0;
+    for (size_t i = 0; i < scenes->size(); ++i) {
+        mesh_count += (*scenes)[i]->meshes_.size();
+    }
+    printf("[%lu] %s  scenes %lu  meshes %lu\n", index, path, scenes->size(), mesh_count);
+}
+
+}   // unname namespace
+
+
+//----------------------------------------------------------------------
+//  sample
+void sample04(
+    const char* const* dae_paths,
+    size_t count
+) {
+    tc::BatchParser batch;
+    batch.setThreadCount(0);
+    batch.setMaxInFlightBytes(256 * 1024 * 1024);
+    batch.setParserSetup(setupParser);
+
+    tc::Result result = batch.parse(dae_paths, count, onParsed);
+    if (result.isFailed()) {
+        printf("some files failed. error = %d\n", static_cast<int>(result.getErrorCode()));
+    }
+}
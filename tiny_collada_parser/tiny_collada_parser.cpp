@@ -2,23 +2,74 @@
 
 #include "tiny_collada_parser.hpp"
 #include "third_party_libs/tinyxml2/tinyxml2.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define TINY_COLLADA_USE_SSE2   1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define TINY_COLLADA_USE_NEON   1
+#endif
 
-#if 1
-    #define TINY_COLLADA_DEBUG  1
-#else
-    #define TYNE_COLLADA_DEBUG  0
+#if defined(_MSC_VER)
+    #include <intrin.h>
 #endif
 
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #define TINY_COLLADA_USE_WIN32_MAPPING  1
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define TINY_COLLADA_USE_MMAP   1
+#endif
 
-#if TINY_COLLADA_DEBUG
-    #define TINY_COLLADA_TRACE(...)         ::std::printf(__VA_ARGS__)
-    #define TINY_COLLADA_ASSERT(exp)        assert(exp)
-#else
+#define TINY_COLLADA_ASSERT(exp)        assert(exp)
 
-    #define TINY_COLLADA_TRACE(...)         (void)0
-    #define TINY_COLLADA_ASSERT(exp)        (void)0
-#endif
+
+//  ログ出力
+//  TINY_COLLADA_LOG_LEVEL で消したレベルは条件が定数で偽になり、引数の評価ごと消える
+//  実行時もシンクが無いかレベルが足りなければ書式化しない
+#define TINY_COLLADA_LOG(level, ...)                        \
+    do {                                                    \
+        if ((level) <= TINY_COLLADA_LOG_LEVEL               \
+            && isLogEnabled(level)) {                       \
+            writeLog((level), __VA_ARGS__);                 \
+        }                                                   \
+    } while (0)
+
+#define TINY_COLLADA_LOG_ERROR(...)     TINY_COLLADA_LOG(tc::LOG_ERROR, __VA_ARGS__)
+#define TINY_COLLADA_LOG_WARNING(...)   TINY_COLLADA_LOG(tc::LOG_WARNING, __VA_ARGS__)
+#define TINY_COLLADA_LOG_INFO(...)      TINY_COLLADA_LOG(tc::LOG_INFO, __VA_ARGS__)
+#define TINY_COLLADA_LOG_DEBUG(...)     TINY_COLLADA_LOG(tc::LOG_DEBUG, __VA_ARGS__)
 
 
 namespace xml = tinyxml2;
@@ -44,6 +95,199 @@ const char* ID_ATTR_NAME = "id";
 const char* OFFSET_ATTR_NAME = "offset";
 const char* VERTICES_NODE_NAME = "vertices";
 const char* COUNT_ATTR_NAME = "count";
+const char* MATERIAL_ATTR_NAME = "material";
+
+
+//======================================================================
+//  ログ
+//  解析中はスレッドに出力先を結び付けておき、どの関数からでも出せるようにする
+struct LogContext
+{
+    LogContext()
+        : sink_(nullptr)
+        , user_data_(nullptr)
+        , level_(tc::LOG_WARNING)
+    {}
+
+    tc::LogSink sink_;
+    void* user_data_;
+    tc::LogLevel level_;
+};
+
+thread_local const LogContext* current_log = nullptr;
+
+
+//----------------------------------------------------------------------
+//  出力するレベルか
+inline bool isLogEnabled(
+    tc::LogLevel level
+) {
+    const LogContext* log = current_log;
+    return log && log->sink_ && level <= log->level_;
+}
+
+//----------------------------------------------------------------------
+//  書式化してシンクに渡す
+//  長すぎる行は切り詰める
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+void writeLog(
+    tc::LogLevel level,
+    const char* format,
+    ...
+) {
+    const LogContext* log = current_log;
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    log->sink_(level, message, log->user_data_);
+}
+
+
+//======================================================================
+//  スコープの間、このスレッドのログを指定の出力先に向ける
+class LogScope
+{
+public:
+    explicit LogScope(
+        const LogContext* log
+    )   : previous_(current_log)
+    {
+        current_log = log;
+    }
+
+    ~LogScope() {
+        current_log = previous_;
+    }
+
+    LogScope& operator=(const LogScope&) = delete;	// コピーの禁止
+    LogScope(const LogScope&) = delete;
+
+private:
+    const LogContext* previous_;
+};
+
+
+//======================================================================
+//  解析統計の記録
+//  メッシュは並列に解析されるので、記録はロックして行う
+class ParseProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ParseProfiler(
+        tc::ParseStatistics* out
+    )   : out_(out)
+        , start_(Clock::now())
+        , threads_()
+        , mutex_()
+    {
+        out_->clear();
+        threads_.push_back(std::this_thread::get_id());
+    }
+
+    ParseProfiler& operator=(const ParseProfiler&) = delete;	// コピーの禁止
+    ParseProfiler(const ParseProfiler&) = delete;
+
+public:
+    //----------------------------------------------------------------------
+    //  区間を記録
+    void record(
+        tc::ParseStatistics::Phase phase,
+        Clock::time_point begin,
+        Clock::time_point end
+    ) {
+        std::chrono::duration<double, std::micro> offset = begin - start_;
+        std::chrono::duration<double, std::micro> duration = end - begin;
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->phase_seconds_[phase] += duration.count() / 1000000.0;
+        tc::ParseStatistics::Event event = {phase, getThreadIndex(), offset.count(), duration.count()};
+        out_->events_.push_back(event);
+    }
+
+    //----------------------------------------------------------------------
+    //  件数を加算
+    void add(
+        uint64_t tc::ParseStatistics::* counter,
+        uint64_t value
+    ) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->*counter += value;
+    }
+
+    //----------------------------------------------------------------------
+    //  解析終了
+    void finish() {
+        std::chrono::duration<double> total = Clock::now() - start_;
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->total_seconds_ = total.count();
+    }
+
+private:
+    //  スレッドの通し番号
+    uint32_t getThreadIndex() {
+        std::thread::id id = std::this_thread::get_id();
+        for (size_t i = 0; i < threads_.size(); ++i) {
+            if (threads_[i] == id) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        threads_.push_back(id);
+        return static_cast<uint32_t>(threads_.size() - 1);
+    }
+
+    tc::ParseStatistics* out_;
+    Clock::time_point start_;
+    std::vector<std::thread::id> threads_;
+    std::mutex mutex_;
+};
+
+
+//======================================================================
+//  スコープの間をフェーズとして記録する
+//  profiler が nullptr なら何もしない
+class ScopedPhase
+{
+public:
+    ScopedPhase(
+        ParseProfiler* profiler,
+        tc::ParseStatistics::Phase phase
+    )   : profiler_(profiler)
+        , phase_(phase)
+        , begin_()
+    {
+        if (profiler_) {
+            begin_ = ParseProfiler::Clock::now();
+        }
+    }
+
+    ~ScopedPhase() {
+        finish();
+    }
+
+    //  スコープの途中で区間を閉じる
+    void finish() {
+        if (profiler_) {
+            profiler_->record(phase_, begin_, ParseProfiler::Clock::now());
+            profiler_ = nullptr;
+        }
+    }
+
+    ScopedPhase& operator=(const ScopedPhase&) = delete;	// コピーの禁止
+    ScopedPhase(const ScopedPhase&) = delete;
+
+private:
+    ParseProfiler* profiler_;
+    tc::ParseStatistics::Phase phase_;
+    ParseProfiler::Clock::time_point begin_;
+};
 
 
 void parseEffect(
@@ -75,6 +319,29 @@ const char* getElementAttribute(
     return element->Attribute(attri_name);
 }
 
+//----------------------------------------------------------------------
+//  子孫を含めた要素数
+//  深い木でもスタックを使わないよう、親をたどって巡回する
+uint64_t countElements(
+    const xml::XMLElement* root
+) {
+    uint64_t count = 0;
+    const xml::XMLElement* element = root;
+    while (element) {
+        ++count;
+        const xml::XMLElement* next = element->FirstChildElement();
+        while (!next && element && element != root) {
+            next = element->NextSiblingElement();
+            if (!next) {
+                const xml::XMLNode* parent = element->Parent();
+                element = parent ? parent->ToElement() : nullptr;
+            }
+        }
+        element = next;
+    }
+    return count;
+}
+
 
 //======================================================================
 struct PrimitiveSelector
@@ -83,252 +350,808 @@ struct PrimitiveSelector
     tc::ColladaMesh::PrimitiveType type_;
 };
 
-#define PRIMITIVE_TYPE_NUM 2
+//  polylist と polygons は三角形に分割する
+#define PRIMITIVE_TYPE_NUM 3
 const PrimitiveSelector PRIMITIVE_TYPE_SELECT[PRIMITIVE_TYPE_NUM] = {
     {"triangles", tc::ColladaMesh::PRIMITIVE_TRIANGLES},
-    {"polylist", tc::ColladaMesh::PRIMITIVE_TRIANGLES}
+    {"polylist", tc::ColladaMesh::PRIMITIVE_TRIANGLES},
+    {"polygons", tc::ColladaMesh::PRIMITIVE_TRIANGLES}
 };
+const char* POLYGONS_NODE_NAME = "polygons";
+const char* POLYGON_HOLE_NODE_NAME = "ph";
+const char* HOLE_NODE_NAME = "h";
+const char* VCOUNT_NODE_NAME = "vcount";
+
 
+//----------------------------------------------------------------------
+//  下位から連続する0ビットの数
+inline int countTrailingZeros(
+    unsigned int mask
+) {
+    TINY_COLLADA_ASSERT(mask != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
 
-const size_t STRING_COMP_SIZE = 64;
+//----------------------------------------------------------------------
+//  立っているビットの数
+inline int countBits(
+    unsigned int mask
+) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt(mask));
+#else
+    return __builtin_popcount(mask);
+#endif
+}
 
 
 
 //======================================================================
-//  visual_sceneノードデータ
-struct VisualSceneData
+//  モノトニックアリーナ
+//  ブロックをまとめて確保して先頭から切り出すだけで、個別の解放はしない
+//  ブロックはアリーナの破棄時にまとめて返す。並列解析からも使うので排他する
+//  巻き戻すと確保済みのブロックを先頭から使い直す
+const size_t ARENA_FIRST_BLOCK_SIZE = 64 * 1024;
+const size_t ARENA_MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+
+class Arena
 {
-    VisualSceneData()
-        : type_(TYPE_UNKNOWN)
-        , url_(nullptr)
-        , matrix_()
-        , bind_material_(nullptr)
+public:
+    explicit Arena(
+        tc::Allocator* allocator
+    )   : allocator_(allocator)
+        , blocks_()
+        , current_block_(0)
+        , current_(nullptr)
+        , current_size_(0)
+        , used_(0)
+        , next_block_size_(ARENA_FIRST_BLOCK_SIZE)
+        , allocated_bytes_(0)
+        , reserved_bytes_(0)
+        , allocation_count_(0)
+        , mutex_()
     {}
 
-
-    void dump() {
-        TINY_COLLADA_TRACE("VisualSceneNode:type = %d ", type_);
-        if (url_) {
-            TINY_COLLADA_TRACE("url = %s ", url_);
-        }
-        if (bind_material_) {
-            TINY_COLLADA_TRACE("bind_material = %s", bind_material_);
-        }
-        TINY_COLLADA_TRACE(" matrix (%lu)", matrix_.size());
-        for (int i = 0; i < matrix_.size(); ++i) {
-            if ((i % 4) == 0) {
-                TINY_COLLADA_TRACE("\n");
+    ~Arena() {
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            if (allocator_) {
+                allocator_->deallocate(blocks_[i].memory_, blocks_[i].size_);
+            }
+            else {
+                std::free(blocks_[i].memory_);
             }
-            TINY_COLLADA_TRACE(" %f", matrix_[i]);
         }
-        TINY_COLLADA_TRACE("\n");
     }
 
-    enum Type {
-        TYPE_GEOMETRY,
-        TYPE_UNKNOWN,
-    };
-    Type type_;
-    const char* url_;
-    std::vector<float> matrix_;
-    const char* bind_material_;
-};
-using VisualScenes = std::vector<std::shared_ptr<VisualSceneData>>;
+    Arena& operator=(const Arena&) = delete;	// コピーの禁止
+    Arena(const Arena&) = delete;
 
+public:
+    //----------------------------------------------------------------------
+    //  領域を切り出す
+    void* allocate(
+        size_t size,
+        size_t alignment
+    ) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+        if (!current_ || offset + size > current_size_) {
+            nextBlock(size + alignment);
+            offset = 0;
+        }
+        used_ = offset + size;
+        allocated_bytes_ += size;
+        ++allocation_count_;
+        return current_ + offset;
+    }
 
-//======================================================================
-//  material
-struct MaterialData
-{
-    const char* id_;
-    const char* url_;
-    
-    void dump() {
-        TINY_COLLADA_TRACE("MaterialData:id %s  url %s\n", id_, url_);
+    //----------------------------------------------------------------------
+    //  巻き戻し
+    //  ブロックは返さずに先頭から使い直す
+    //  切り出した領域がもう参照されていないときだけ呼ぶこと
+    void rewind() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_block_ = 0;
+        current_ = nullptr;
+        current_size_ = 0;
+        used_ = 0;
+        allocated_bytes_ = 0;
+        allocation_count_ = 0;
+        if (!blocks_.empty()) {
+            current_ = static_cast<char*>(blocks_[0].memory_);
+            current_size_ = blocks_[0].size_;
+        }
     }
-};
-using Materials = std::vector<std::shared_ptr<MaterialData>>;
 
+    //  切り出した合計
+    size_t getAllocatedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocated_bytes_;
+    }
 
-//======================================================================
-//  material effect
-struct EffectData
-{
-    struct Surface {
+    //  ブロックとして確保した合計
+    size_t getReservedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return reserved_bytes_;
+    }
 
-        Surface()
-            : sid_(nullptr)
-            , init_from_(nullptr)
-        {}
+    //  切り出した回数
+    size_t getAllocationCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocation_count_;
+    }
 
+    //  確保したブロック数
+    size_t getBlockCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return blocks_.size();
+    }
 
-        void setupSurface(
-            const char* const sid,
-            const xml::XMLElement* surface
-        ) {
-            sid_ = sid;
-            const xml::XMLElement* init_from = firstChildElement(surface, "init_from");
-            init_from_ = init_from->GetText();
+private:
+    //----------------------------------------------------------------------
+    //  次のブロックに移る
+    //  巻き戻した後なら確保済みのブロックを順に使い、足りなければ追加する
+    void nextBlock(
+        size_t min_size
+    ) {
+        size_t next = current_ ? current_block_ + 1 : 0;
+        for (; next < blocks_.size(); ++next) {
+            if (blocks_[next].size_ >= min_size) {
+                current_block_ = next;
+                current_ = static_cast<char*>(blocks_[next].memory_);
+                current_size_ = blocks_[next].size_;
+                used_ = 0;
+                return;
+            }
         }
+        addBlock(min_size);
+    }
 
-        void dump() const {
-            printf("Surface:");
-            if (sid_) {
-                printf("sid = %s", sid_);
-            }
-            if (init_from_) {
-                printf ("init from %s", init_from_);
-            }
-            printf("\n");
+    //----------------------------------------------------------------------
+    //  ブロック追加
+    //  ブロックの大きさは倍々に増やす(上限あり)。大きな要求はそれに合わせる
+    void addBlock(
+        size_t min_size
+    ) {
+        size_t size = next_block_size_;
+        while (size < min_size) {
+            size *= 2;
+        }
+        if (next_block_size_ < ARENA_MAX_BLOCK_SIZE) {
+            next_block_size_ *= 2;
+        }
+
+        void* memory = allocator_ ? allocator_->allocate(size) : std::malloc(size);
+        if (!memory) {
+            throw std::bad_alloc();
         }
+        Block block = {memory, size};
+        blocks_.push_back(block);
+        current_block_ = blocks_.size() - 1;
+        current_ = static_cast<char*>(memory);
+        current_size_ = size;
+        used_ = 0;
+        reserved_bytes_ += size;
+    }
 
-        const char* sid_;
-        const char* init_from_;
+    struct Block
+    {
+        void* memory_;
+        size_t size_;
     };
 
-    struct Sampler2D {
+    tc::Allocator* allocator_;
+    std::vector<Block> blocks_;
+    size_t current_block_;
+    char* current_;
+    size_t current_size_;
+    size_t used_;
+    size_t next_block_size_;
+    size_t allocated_bytes_;
+    size_t reserved_bytes_;
+    size_t allocation_count_;
+    mutable std::mutex mutex_;
+};
 
-        Sampler2D()
-            : sid_(nullptr)
-            , source_(nullptr)
-            , min_filter_(nullptr)
-            , mag_filter_(nullptr)
-        {}
 
+//======================================================================
+//  アリーナから確保するアロケータ
+//  アリーナへの参照を持つので、確保したオブジェクトが残っている間はアリーナも残る
+template <typename T>
+class ArenaAllocator
+{
+    template <typename U>
+    friend class ArenaAllocator;
+public:
+    using value_type = T;
 
-        void setupSampler2D(
-            const char* const sid,
-            const xml::XMLElement* sampler2d
-        ) {
-            //  sid
-            sid_ = sid;
+    explicit ArenaAllocator(
+        const std::shared_ptr<Arena>& arena
+    )   : arena_(arena)
+    {}
 
+    template <typename U>
+    ArenaAllocator(
+        const ArenaAllocator<U>& other
+    )   : arena_(other.arena_)
+    {}
 
-            //  source
-            const xml::XMLElement* source = firstChildElement(sampler2d, "source");
-            if (source) {
-                source_ = source->GetText();
-            }
+    T* allocate(
+        size_t count
+    ) {
+        return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T)));
+    }
 
-            //  min filter
-            const xml::XMLElement* min_filter = firstChildElement(sampler2d, "minfilter");
-            if (min_filter) {
-                min_filter_ = min_filter->GetText();
-            }
+    void deallocate(
+        T*,
+        size_t
+    ) {
+        //  アリーナごと解放するので何もしない
+    }
 
-            //  mag filter
-            const xml::XMLElement* mag_filter = firstChildElement(sampler2d, "magfilter");
-            if (mag_filter) {
-                mag_filter_ = mag_filter->GetText();
-            }
+    template <typename U>
+    bool operator ==(
+        const ArenaAllocator<U>& other
+    ) const {
+        return arena_ == other.arena_;
+    }
 
+    template <typename U>
+    bool operator !=(
+        const ArenaAllocator<U>& other
+    ) const {
+        return arena_ != other.arena_;
+    }
 
-        }
+private:
+    std::shared_ptr<Arena> arena_;
+};
 
-        void dump() const {
-            TINY_COLLADA_TRACE("Sampler2D: sid = %s  source = %s  minfil = %s  magfil = %s\n", sid_, source_, min_filter_, mag_filter_);
-        }
+using ArenaFloats = std::vector<float, ArenaAllocator<float>>;
 
-        const char* sid_;
-        const char* source_;
-        const char* min_filter_;
-        const char* mag_filter_;
-    };
+//----------------------------------------------------------------------
+//  アリーナ上にオブジェクトを作る
+template <typename T, typename... Args>
+std::shared_ptr<T> allocateShared(
+    const std::shared_ptr<Arena>& arena,
+    Args&&... args
+) {
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+}
 
-    void setupEffectData(
-        const xml::XMLElement* effect
-    ) {
-        const char* SHADING_NAME[3] = {
-            "blinn",
-            "phong",
-            "----"
-        };
+//======================================================================
+//  文字列の登録表
+//  名前(id, url, semantic など)は全てここにコピーして一意な番号(StringId)で扱う
+//  同じ文字列は同じ番号になるので、比較は番号の比較だけで済む
+//  文字列本体は解析結果と同じアリーナに置くので、DOMを捨てた後も有効
+using StringId = uint32_t;
+const StringId NO_STRING = 0xFFFFFFFF;
+
+//  あらかじめ登録しておく文字列
+//  並び順がそのまま StringId になる
+enum PresetString : StringId {
+    STRING_POSITION,
+    STRING_NORMAL,
+    STRING_TEXCOORD,
+    STRING_VERTEX,
+    STRING_BLINN,
+    STRING_PHONG,
+    STRING_UNKNOWN_SHADING,
+    PRESET_STRING_COUNT
+};
 
-        //  id
-        id_ = getElementAttribute(effect, "id");
-          
-              
-        const xml::XMLElement* profile_common = firstChildElement(effect, "profile_COMMON");
-            
-        //  マテリアルデータ取得
-        const xml::XMLElement* technique = firstChildElement(profile_common, "technique");
+const char* const PRESET_STRINGS[PRESET_STRING_COUNT] = {
+    "POSITION",
+    "NORMAL",
+    "TEXCOORD",
+    "VERTEX",
+    "blinn",
+    "phong",
+    "----"
+};
 
-        material_ = std::make_shared<tc::ColladaMaterial>();
-        id_ = getElementAttribute(effect, "id");
+class StringTable
+{
+public:
+    explicit StringTable(
+        const std::shared_ptr<Arena>& arena
+    )   : arena_(arena)
+        , entries_()
+        , slots_()
+        , mutex_()
+    {
+        internPresets();
+    }
 
-        for (int shade_idx = 0; shade_idx < 3; ++shade_idx) {
-            const xml::XMLElement* shading = firstChildElement(technique, SHADING_NAME[shade_idx]);
-            if (shading) {
-                //  シェーディング
-                material_->shading_name_ = SHADING_NAME[shade_idx];
-                parseEffect(material_, shading);
-                break;
-            }
-        }
+    StringTable& operator=(const StringTable&) = delete;	// コピーの禁止
+    StringTable(const StringTable&) = delete;
 
-        //  newparam
-        const xml::XMLElement* newparam = firstChildElement(profile_common, "newparam");
+public:
+    //----------------------------------------------------------------------
+    //  登録
+    //  登録済みならその番号を返す。nullptr は NO_STRING
+    StringId intern(
+        const char* const str
+    ) {
+        if (!str) {
+            return NO_STRING;
+        }
+        return intern(str, std::strlen(str));
+    }
 
-        while (newparam) {
-            const char* sid = getElementAttribute(newparam, "sid");
-            const xml::XMLElement* surface = firstChildElement(newparam, "surface");
-            const xml::XMLElement* sampler2d = firstChildElement(newparam, "sampler2D");
-            if (surface) {
-                surface_ = std::make_shared<Surface>();
-                surface_->setupSurface(sid, surface);
+    StringId intern(
+        const char* const str,
+        size_t length
+    ) {
+        uint32_t hash = hashString(str, length);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if ((entries_.size() + 1) * 2 > slots_.size()) {
+            rehash(slots_.empty() ? 64 : slots_.size() * 2);
+        }
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            StringId id = slots_[i];
+            if (id == NO_STRING) {
+                //  本体をアリーナにコピー
+                char* copy = static_cast<char*>(arena_->allocate(length + 1, 1));
+                std::memcpy(copy, str, length);
+                copy[length] = '\0';
+                Entry entry = {copy, length, hash};
+                id = static_cast<StringId>(entries_.size());
+                entries_.push_back(entry);
+                slots_[i] = id;
+                return id;
             }
-            else if (sampler2d) {
-                sampler2d_ = std::make_shared<Sampler2D>();
-                sampler2d_->setupSampler2D(sid, sampler2d);
+            if (isSame(entries_[id], str, length, hash)) {
+                return id;
             }
+        }
+    }
 
-            newparam = newparam->NextSiblingElement("newparam");
+    //----------------------------------------------------------------------
+    //  url("#id" 形式)の登録
+    //  先頭の#を取って登録する
+    StringId internUrl(
+        const char* const url
+    ) {
+        if (url && url[0] == '#') {
+            return intern(url + 1);
         }
+        return intern(url);
     }
 
-    void dump() {
-        TINY_COLLADA_TRACE("EffectData: id = %s\n", id_);
-        if (material_) {
-            material_->dump();
+    //----------------------------------------------------------------------
+    //  文字列本体の取得
+    //  NO_STRING は nullptr
+    const char* get(
+        StringId id
+    ) const {
+        if (id == NO_STRING) {
+            return nullptr;
         }
-        if (sampler2d_) {
-            sampler2d_->dump();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_[id].str_;
+    }
+
+    //  登録数
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    //----------------------------------------------------------------------
+    //  全て消して定義済みの文字列だけにする
+    //  表の容量は残す。アリーナを巻き戻したときに合わせて呼ぶ
+    void clear() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            slots_.assign(slots_.size(), NO_STRING);
         }
-        if (surface_) {
-            surface_->dump();
+        internPresets();
+    }
+
+private:
+    //----------------------------------------------------------------------
+    //  定義済みの文字列を PresetString の番号で登録
+    void internPresets() {
+        for (StringId i = 0; i < PRESET_STRING_COUNT; ++i) {
+            intern(PRESET_STRINGS[i]);
         }
     }
-    EffectData()
-        : id_(nullptr)
-        , material_(nullptr)
-        , sampler2d_(nullptr)
-        , surface_(nullptr)
-    {}
 
+    struct Entry
+    {
+        const char* str_;
+        size_t length_;
+        uint32_t hash_;
+    };
 
-    const char* id_;
-    std::shared_ptr<tc::ColladaMaterial> material_;
-    std::shared_ptr<Sampler2D> sampler2d_;
-    std::shared_ptr<Surface> surface_;
-};
-using Effects = std::vector<std::shared_ptr<EffectData>>;
+    //----------------------------------------------------------------------
+    //  FNV-1a
+    static uint32_t hashString(
+        const char* str,
+        size_t length
+    ) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= static_cast<unsigned char>(str[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    static bool isSame(
+        const Entry& entry,
+        const char* str,
+        size_t length,
+        uint32_t hash
+    ) {
+        return entry.hash_ == hash
+            && entry.length_ == length
+            && std::memcmp(entry.str_, str, length) == 0;
+    }
+
+    //----------------------------------------------------------------------
+    //  テーブルの作り直し
+    void rehash(
+        size_t capacity
+    ) {
+        slots_.assign(capacity, NO_STRING);
+        size_t mask = capacity - 1;
+        for (size_t id = 0; id < entries_.size(); ++id) {
+            size_t i = entries_[id].hash_ & mask;
+            while (slots_[i] != NO_STRING) {
+                i = (i + 1) & mask;
+            }
+            slots_[i] = static_cast<StringId>(id);
+        }
+    }
+
+private:
+    std::shared_ptr<Arena> arena_;
+    std::vector<Entry> entries_;
+    std::vector<StringId> slots_;       //  オープンアドレス法(線形探索)
+    mutable std::mutex mutex_;
+};
+
+
+//======================================================================
+//  解析中のオブジェクトの確保先と文字列表
+//  scratch_ は解析の途中だけ使うデータ、document_ は解析結果として外に渡すデータ
+struct ParseArenas
+{
+    std::shared_ptr<Arena> scratch_;
+    std::shared_ptr<Arena> document_;
+    StringTable* strings_;
+};
+
+
+//======================================================================
+//  id検索用の索引
+//  StringId をそのまま添字にする。同じidが複数あるときは最初のものを返す
+template <typename T>
+class IdIndex
+{
+public:
+    IdIndex()
+        : values_()
+        , count_(0)
+    {}
+
+public:
+    //----------------------------------------------------------------------
+    //  登録
+    void insert(
+        StringId id,
+        T value
+    ) {
+        if (id == NO_STRING) {
+            return;
+        }
+        if (id >= values_.size()) {
+            values_.resize(id + 1, T());
+        }
+        if (values_[id] == T()) {
+            values_[id] = value;
+            ++count_;
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  検索
+    //  見つからなければ T()
+    T find(
+        StringId id
+    ) const {
+        if (id >= values_.size()) {
+            return T();
+        }
+        return values_[id];
+    }
+
+    size_t size() const {
+        return count_;
+    }
+
+private:
+    std::vector<T> values_;
+    size_t count_;
+};
+
+
+//======================================================================
+//  visual_sceneノードデータ
+struct VisualSceneData
+{
+    VisualSceneData()
+        : type_(TYPE_UNKNOWN)
+        , url_(NO_STRING)
+        , node_(tc::ColladaNodes::NO_INDEX)
+        , bind_materials_()
+    {}
+
+
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("VisualSceneNode:type = %d url = %s node = %u",
+            type_,
+            url_ != NO_STRING ? strings.get(url_) : "-",
+            node_
+        );
+        for (size_t i = 0; i < bind_materials_.size(); ++i) {
+            TINY_COLLADA_LOG_DEBUG("  bind_material %s -> %s",
+                bind_materials_[i].symbol_ != NO_STRING ? strings.get(bind_materials_[i].symbol_) : "-",
+                bind_materials_[i].target_ != NO_STRING ? strings.get(bind_materials_[i].target_) : "-"
+            );
+        }
+    }
+
+    enum Type {
+        TYPE_GEOMETRY,
+        TYPE_UNKNOWN,
+    };
+
+    //  <instance_material> の symbol と target
+    struct BindMaterial
+    {
+        StringId symbol_;
+        StringId target_;
+    };
+
+    Type type_;
+    StringId url_;
+    uint32_t node_;             //  <instance_geometry> を持つノードの番号
+    std::vector<BindMaterial> bind_materials_;
+};
+using VisualScenes = std::vector<std::shared_ptr<VisualSceneData>>;
+
+
+//======================================================================
+//  material
+struct MaterialData
+{
+    MaterialData()
+        : id_(NO_STRING)
+        , url_(NO_STRING)
+    {}
+
+    StringId id_;
+    StringId url_;
+    
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("MaterialData:id %s  url %s", strings.get(id_), strings.get(url_));
+    }
+};
+using Materials = std::vector<std::shared_ptr<MaterialData>>;
+
+
+//======================================================================
+//  material effect
+struct EffectData
+{
+    struct Surface {
+
+        Surface()
+            : sid_(NO_STRING)
+            , init_from_(NO_STRING)
+        {}
+
+
+        void setupSurface(
+            StringId sid,
+            const xml::XMLElement* surface,
+            StringTable& strings
+        ) {
+            sid_ = sid;
+            const xml::XMLElement* init_from = firstChildElement(surface, "init_from");
+            init_from_ = strings.intern(init_from->GetText());
+        }
+
+        void dump(
+            const StringTable& strings
+        ) const {
+            TINY_COLLADA_LOG_DEBUG("Surface: sid = %s  init from %s",
+                sid_ != NO_STRING ? strings.get(sid_) : "-",
+                init_from_ != NO_STRING ? strings.get(init_from_) : "-"
+            );
+        }
+
+        StringId sid_;
+        StringId init_from_;
+    };
+
+    struct Sampler2D {
+
+        Sampler2D()
+            : sid_(NO_STRING)
+            , source_(NO_STRING)
+            , min_filter_(NO_STRING)
+            , mag_filter_(NO_STRING)
+        {}
+
+
+        void setupSampler2D(
+            StringId sid,
+            const xml::XMLElement* sampler2d,
+            StringTable& strings
+        ) {
+            //  sid
+            sid_ = sid;
+
+
+            //  source
+            const xml::XMLElement* source = firstChildElement(sampler2d, "source");
+            if (source) {
+                source_ = strings.intern(source->GetText());
+            }
+
+            //  min filter
+            const xml::XMLElement* min_filter = firstChildElement(sampler2d, "minfilter");
+            if (min_filter) {
+                min_filter_ = strings.intern(min_filter->GetText());
+            }
+
+            //  mag filter
+            const xml::XMLElement* mag_filter = firstChildElement(sampler2d, "magfilter");
+            if (mag_filter) {
+                mag_filter_ = strings.intern(mag_filter->GetText());
+            }
+
+
+        }
+
+        void dump(
+            const StringTable& strings
+        ) const {
+            TINY_COLLADA_LOG_DEBUG("Sampler2D: sid = %s  source = %s  minfil = %s  magfil = %s",
+                strings.get(sid_),
+                strings.get(source_),
+                strings.get(min_filter_),
+                strings.get(mag_filter_)
+            );
+        }
+
+        StringId sid_;
+        StringId source_;
+        StringId min_filter_;
+        StringId mag_filter_;
+    };
+
+    void setupEffectData(
+        const xml::XMLElement* effect,
+        const ParseArenas& arenas
+    ) {
+        const StringId SHADING_NAME[3] = {
+            STRING_BLINN,
+            STRING_PHONG,
+            STRING_UNKNOWN_SHADING
+        };
+        StringTable& strings = *arenas.strings_;
+
+        //  id
+        id_ = strings.intern(getElementAttribute(effect, "id"));
+          
+              
+        const xml::XMLElement* profile_common = firstChildElement(effect, "profile_COMMON");
+            
+        //  マテリアルデータ取得
+        const xml::XMLElement* technique = firstChildElement(profile_common, "technique");
+
+        material_ = allocateShared<tc::ColladaMaterial>(arenas.document_);
+
+        for (int shade_idx = 0; shade_idx < 3; ++shade_idx) {
+            const char* shading_name = strings.get(SHADING_NAME[shade_idx]);
+            const xml::XMLElement* shading = firstChildElement(technique, shading_name);
+            if (shading) {
+                //  シェーディング
+                //  名前は文字列表のものを指すので、解析後も有効
+                material_->shading_name_ = shading_name;
+                parseEffect(material_, shading);
+                break;
+            }
+        }
+
+        //  newparam
+        const xml::XMLElement* newparam = firstChildElement(profile_common, "newparam");
+
+        while (newparam) {
+            StringId sid = strings.intern(getElementAttribute(newparam, "sid"));
+            const xml::XMLElement* surface = firstChildElement(newparam, "surface");
+            const xml::XMLElement* sampler2d = firstChildElement(newparam, "sampler2D");
+            if (surface) {
+                surface_ = allocateShared<Surface>(arenas.scratch_);
+                surface_->setupSurface(sid, surface, strings);
+            }
+            else if (sampler2d) {
+                sampler2d_ = allocateShared<Sampler2D>(arenas.scratch_);
+                sampler2d_->setupSampler2D(sid, sampler2d, strings);
+            }
+
+            newparam = newparam->NextSiblingElement("newparam");
+        }
+    }
+
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("EffectData: id = %s", strings.get(id_));
+        if (material_) {
+            TINY_COLLADA_LOG_DEBUG("  shading = %s  shininess = %f  transparency = %f",
+                material_->shading_name_ ? material_->shading_name_ : "-",
+                material_->shininess_,
+                material_->transparency_
+            );
+        }
+        if (sampler2d_) {
+            sampler2d_->dump(strings);
+        }
+        if (surface_) {
+            surface_->dump(strings);
+        }
+    }
+    EffectData()
+        : id_(NO_STRING)
+        , material_(nullptr)
+        , sampler2d_(nullptr)
+        , surface_(nullptr)
+    {}
+
+
+    StringId id_;
+    std::shared_ptr<tc::ColladaMaterial> material_;
+    std::shared_ptr<Sampler2D> sampler2d_;
+    std::shared_ptr<Surface> surface_;
+};
+using Effects = std::vector<std::shared_ptr<EffectData>>;
 
 
 //======================================================================
 //  textures
 struct ImageData
 {
-    void dump() {
-        TINY_COLLADA_TRACE("ImageData: id = %s  init_from = %s\n", id_, init_from_);
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("ImageData: id = %s  init_from = %s", strings.get(id_), strings.get(init_from_));
     }
 
     ImageData()
-        : id_(nullptr)
-        , init_from_(nullptr)
+        : id_(NO_STRING)
+        , init_from_(NO_STRING)
     {}
 
-    const char* id_;
-    const char* init_from_;
+    StringId id_;
+    StringId init_from_;
 };
 using Images = std::vector<std::shared_ptr<ImageData>>;
 
@@ -338,25 +1161,23 @@ using Images = std::vector<std::shared_ptr<ImageData>>;
 struct InputData
 {
     InputData()
-        : semantic_(nullptr)
-        , source_(nullptr)
+        : semantic_(NO_STRING)
+        , source_(NO_STRING)
         , offset_(0)
     {}
     
-    void dump() {
-        TINY_COLLADA_TRACE("InputData:semantic = ");
-        if (semantic_) {
-            printf("%s", semantic_);
-        }
-        TINY_COLLADA_TRACE("  source = ");
-        if (source_) {
-            printf("%s", source_);
-        }
-        TINY_COLLADA_TRACE("  offset = %d\n", offset_);
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("InputData:semantic = %s  source = %s  offset = %d",
+            semantic_ != NO_STRING ? strings.get(semantic_) : "",
+            source_ != NO_STRING ? strings.get(source_) : "",
+            offset_
+        );
     }
     
-    const char* semantic_;
-    const char* source_;
+    StringId semantic_;
+    StringId source_;
     int offset_;
 };
     
@@ -365,17 +1186,19 @@ struct InputData
 struct SourceData
 {
     SourceData()
-        : id_(nullptr)
+        : id_(NO_STRING)
         , stride_(0)
         , data_()
         , input_(nullptr)
     {}
     
-    void dump() {
-        TINY_COLLADA_TRACE("SourceData:id = %s  stride = %d\n", id_, stride_);
+    void dump(
+        const StringTable& strings
+    ) {
+        TINY_COLLADA_LOG_DEBUG("SourceData:id = %s  stride = %d", strings.get(id_), stride_);
     }
     
-    const char* id_;
+    StringId id_;
     uint32_t stride_;
     std::vector<float> data_;
     InputData* input_;
@@ -389,14 +1212,16 @@ struct MeshInformation {
 
 //----------------------------------------------------------------------
 //  指定idのinputを探す
+//  名前は番号で比べるので、inputの数だけの整数比較で済む
 InputData* searchInputBySource(
-    const char* const id
+    StringId id
 ) {
-    for (int i = 0; i < inputs_.size(); ++i) {
-        InputData* input = &inputs_[i];
-        TINY_COLLADA_TRACE("search %s == %s\n", id, input->source_);
-        if (std::strncmp(input->source_, id, STRING_COMP_SIZE) == 0){
-            return input;
+    if (id == NO_STRING) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        if (inputs_[i].source_ == id) {
+            return &inputs_[i];
         }
     }
     return nullptr;
@@ -406,24 +1231,23 @@ InputData* searchInputBySource(
 //----------------------------------------------------------------------
 //  指定semanticのsourceを探す
 SourceData* searchSourceBySemantic(
-    const char* const semantic
+    StringId semantic
 ) {
     size_t sources_size = sources_.size();
-    TINY_COLLADA_TRACE("\nsearchSourceBySemantic %s %lu\n", semantic, sources_size);
+    TINY_COLLADA_LOG_DEBUG("searchSourceBySemantic %u %lu", semantic, sources_size);
     for (int i = 0; i < sources_size; ++i) {
         SourceData* source = &sources_[i];
         InputData* input = source->input_;
         if (!input) {
-            TINY_COLLADA_TRACE("no input - %s\n", source->id_);
+            TINY_COLLADA_LOG_DEBUG("no input - %u", source->id_);
             continue;
         }
-        TINY_COLLADA_TRACE("  %s %s\n", input->semantic_, input->source_);   
-        if (std::strncmp(input->semantic_, semantic, STRING_COMP_SIZE) == 0) {
-            TINY_COLLADA_TRACE("%s - %s [%s] FOUND.\n", __FUNCTION__, semantic, input->source_);
+        if (input->semantic_ == semantic) {
+            TINY_COLLADA_LOG_DEBUG("%s - %u [%u] FOUND.", __FUNCTION__, semantic, input->source_);
             return source;
         }
     }
-    TINY_COLLADA_TRACE("%s - %s NOT FOUND.\n", __FUNCTION__, semantic);
+    TINY_COLLADA_LOG_DEBUG("%s - %u NOT FOUND.", __FUNCTION__, semantic);
         
     return nullptr;
 }
@@ -444,28 +1268,97 @@ int getIndexStride() const
 }
 
 //----------------------------------------------------------------------
-//  データ表示
-void dump()
+//  三角形の頂点数
+//  triangles は <p> の頂点の組をそのまま3つずつ使うので corners_ は作らない
+size_t getCornerCount() const
+{
+    if (face_count_.empty()) {
+        return raw_indices_.size() / getIndexStride() / 3 * 3;
+    }
+    return corners_.size();
+}
+
+//----------------------------------------------------------------------
+//  プリミティブ要素ごとの情報を消す
+//  ソースはメッシュで共有するので残す
+void clearPrimitive()
 {
+    raw_indices_.clear();
+    face_count_.clear();
+    face_holes_.clear();
+    hole_count_.clear();
+    corners_.clear();
+    inputs_.clear();
+}
+
+//----------------------------------------------------------------------
+//  データ表示
+void dump(
+    const StringTable& strings
+) {
     
     for (int i = 0; i < sources_.size(); ++i) {
-        sources_[i].dump();
+        sources_[i].dump(strings);
     }
 
     for (int i = 0; i < inputs_.size(); ++i) {
-        inputs_[i].dump();
+        inputs_[i].dump(strings);
     }
 
 }
 
 tc::Indices raw_indices_;
-std::vector<char> face_count_;
+tc::Indices face_count_;        //  面ごとの外周の頂点数。三角形だけなら空
+tc::Indices face_holes_;        //  面ごとの穴の数(polygons のみ)。無ければ空
+tc::Indices hole_count_;        //  穴ごとの頂点数。<p> 上では面の外周の後に穴が続く
+tc::Indices corners_;           //  三角形の頂点ごとの <p> 上の位置(頂点の組の先頭)。triangles なら空
 std::vector<SourceData> sources_;
 std::vector<InputData> inputs_;
     
 };
 
 
+//======================================================================
+//  サブメッシュをまとめた属性ごとのインデックス
+//  プリミティブ要素ごとに参照する source が違っていれば、データをつなげてインデックスをずらす
+//  属性を持たないプリミティブ要素の頂点は、最後に足す0の要素を指す
+const uint32_t MISSING_ELEMENT = 0xFFFFFFFF;
+
+struct AttributeStream
+{
+    AttributeStream()
+        : sources_()
+        , bases_()
+        , indices_()
+        , missing_(false)
+    {}
+
+    std::vector<const SourceData*> sources_;    //  参照した順
+    tc::Indices bases_;                         //  sources_ ごとの先頭の要素番号
+    tc::Indices indices_;
+    bool missing_;                              //  MISSING_ELEMENT を使った
+};
+
+
+//======================================================================
+//  メッシュ解析ジョブ
+//  1つのメッシュノードと、その解析結果
+//  同じジオメトリを参照するシーンは output_ を共有する
+struct MeshJob
+{
+    MeshJob()
+        : mesh_node_(nullptr)
+        , output_()
+        , result_()
+    {}
+
+    const xml::XMLElement* mesh_node_;
+    std::shared_ptr<tc::ColladaMesh> output_;
+    tc::Result result_;
+};
+using MeshJobs = std::vector<MeshJob>;
+
+
 
 
 
@@ -492,982 +1385,6614 @@ uint32_t getStride(
 }
 
 
+//======================================================================
+//  数値テキスト解析
+//  ロケール非依存、非破壊、リエントラントな数値トークナイザ
+//  空白はXMLの定義どおりスペース、タブ、CR、LFの4種
+
 //----------------------------------------------------------------------
-//  配列データ読み込み
-template <typename T>
-void readArray(
-    const char* text,
-    std::vector<T>* container
-){
-    char* value_str = std::strtok(const_cast<char*>(text), " ");
-    while (value_str) {
-        T v = static_cast<T>(atof(value_str));
-        container->push_back(v);
-        value_str = std::strtok(nullptr, " ");
-    }
+//  空白判定
+inline bool isSpace(
+    const char c
+) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-
 //----------------------------------------------------------------------
-//  ソース解析
-void readSourceNode(
-    const xml::XMLElement* const source_node,
-    SourceData* out
+//  空白を読み飛ばす
+//  インデントや改行が続く箇所は16byte単位でまとめて判定する
+const char* skipSpace(
+    const char* p,
+    const char* const end
 ) {
-    const int ARRAY_TYPE_MAX = 2;
-    char array_types[ARRAY_TYPE_MAX][15] = {
-        "float_array",
-        "int_array"
-    };
-        
-    for (int i = 0; i < ARRAY_TYPE_MAX; ++i) {
-        const xml::XMLElement* array_node = firstChildElement(
-            source_node, 
-            array_types[i]
+#if TINY_COLLADA_USE_SSE2
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, sp), _mm_cmpeq_epi8(chunk, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr))
         );
-        if (!array_node) {
-            continue;
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(ws)) ^ 0xFFFFu;
+        if (mask) {
+            return p + countTrailingZeros(mask);
         }
-        //  データのストライドを取得
-        out->stride_ = getStride(source_node);
-
-        const char* text = array_node->GetText();
-        //  データ数分のメモリをあらかじめリザーブ
-        size_t data_count = 0;
-        const char* count_str = getElementAttribute(array_node, COUNT_ATTR_NAME);
-        if (count_str) {
-            data_count = std::atoi(count_str);
+        p += 16;
+    }
+#elif TINY_COLLADA_USE_NEON
+    const uint8x16_t sp = vdupq_n_u8(' ');
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    while (end - p >= 16) {
+        uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t ws = vorrq_u8(
+            vorrq_u8(vceqq_u8(chunk, sp), vceqq_u8(chunk, tab)),
+            vorrq_u8(vceqq_u8(chunk, lf), vceqq_u8(chunk, cr))
+        );
+        if (vminvq_u8(ws) == 0) {
+            //  空白以外が含まれているので残りは1byteずつ
+            break;
         }
-        TINY_COLLADA_TRACE("reserve %lu\n", data_count);
-        out->data_.reserve(data_count);
-
-        //  データ取得
-        readArray(text, &out->data_);
+        p += 16;
+    }
+#endif
+    while (p < end && isSpace(*p)) {
+        ++p;
     }
+    return p;
 }
 
-
 //----------------------------------------------------------------------
-//  プリミティブノード取得
-const xml::XMLElement* getPrimitiveNode(
-    const xml::XMLElement* mesh_node
+//  トークン末尾まで読み飛ばす
+const char* skipToken(
+    const char* p,
+    const char* const end
 ) {
-    //  どのデータ構造でインデックスをもっているか調査
-    for (int prim_idx = 0; prim_idx < PRIMITIVE_TYPE_NUM; ++prim_idx) {
-
-        //  読み込めたら存在している
-        const xml::XMLElement* primitive_node = firstChildElement(
-            mesh_node,
-            PRIMITIVE_TYPE_SELECT[prim_idx].name_
-        );
-
-        if (primitive_node) {
-            return primitive_node;
-        }
+    while (p < end && !isSpace(*p)) {
+        ++p;
     }
-
-    return nullptr;
+    return p;
 }
 
 //----------------------------------------------------------------------
-//  プリミティブタイプ取得
-tc::ColladaMesh::PrimitiveType getPrimitiveType(
-    const xml::XMLElement* mesh_node
+//  大文字小文字を無視して前方一致判定
+bool matchKeyword(
+    const char* p,
+    const char* const end,
+    const char* keyword
 ) {
-    //  どのデータ構造でインデックスをもっているか調査
-    for (int prim_idx = 0; prim_idx < PRIMITIVE_TYPE_NUM; ++prim_idx) {
+    while (*keyword) {
+        if (p == end || (*p | 0x20) != *keyword) {
+            return false;
+        }
+        ++p;
+        ++keyword;
+    }
+    return true;
+}
 
-        //  読み込めたら存在している
-        const xml::XMLElement* primitive_node = firstChildElement(
-            mesh_node,
-            PRIMITIVE_TYPE_SELECT[prim_idx].name_
-        );
+//----------------------------------------------------------------------
+//  10の累乗
+//  この範囲なら double で正確に表現できる
+const double POW10_TABLE[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-        if (primitive_node) {
-            return PRIMITIVE_TYPE_SELECT[prim_idx].type_;
+//----------------------------------------------------------------------
+//  仮数と10進指数から double を組み立てる
+double composeDouble(
+    uint64_t mantissa,
+    int exponent
+) {
+    double value = static_cast<double>(mantissa);
+    if (mantissa == 0) {
+        return 0.0;
+    }
+    //  仮数が2^53以下かつ指数が表の範囲なら1回の乗除算で正しく丸まる
+    if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        return exponent < 0 ? value / POW10_TABLE[-exponent] : value * POW10_TABLE[exponent];
+    }
+    //  範囲外は分割して計算する(メッシュデータでは稀)
+    while (exponent > 22) {
+        value *= POW10_TABLE[22];
+        exponent -= 22;
+        if (value > 1e308) {
+            return value;
         }
     }
-
-    return tc::ColladaMesh::UNKNOWN_TYPE;
+    while (exponent < -22) {
+        value /= POW10_TABLE[22];
+        exponent += 22;
+        if (value == 0.0) {
+            return value;
+        }
+    }
+    return exponent < 0 ? value / POW10_TABLE[-exponent] : value * POW10_TABLE[exponent];
 }
 
-
 //----------------------------------------------------------------------
-//  visual scene読み込み
-void collectVisualSceneNode(
-    VisualScenes& out,
-    const xml::XMLElement* visual_scene_root
+//  浮動小数を1つ読み込む
+//  p はトークン先頭を指していること。読み終えた位置を返す
+//  解釈できない部分はトークン末尾まで読み飛ばす(atofと同じく0扱い)
+const char* parseFloat(
+    const char* p,
+    const char* const end,
+    double* out
 ) {
-    const xml::XMLElement* visual_scene = firstChildElement(visual_scene_root, "visual_scene");
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = (*p == '-');
+        ++p;
+    }
 
-    while (visual_scene) {
-        const xml::XMLElement* visual_scene_node = firstChildElement(visual_scene, "node");
-        while (visual_scene_node) {
-            std::shared_ptr<VisualSceneData> vs = std::make_shared<VisualSceneData>();
-            
-            //  行列取得
-            const xml::XMLElement* matrix_node = firstChildElement(visual_scene_node, "matrix");
-            const char* mtx_text = matrix_node->GetText();
-            readArray(mtx_text, &vs->matrix_);
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool has_digit = false;
+
+    //  整数部
+    while (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+            if (mantissa) {
+                ++digits;
+            }
+        }
+        else {
+            ++exponent;
+        }
+        has_digit = true;
+        ++p;
+    }
 
-            //  タイプ判定
-            const xml::XMLElement* instance_geometry = firstChildElement(visual_scene_node, "instance_geometry");
-            if (instance_geometry) {
-                // ジオメトリノードだった
-                vs->type_ = VisualSceneData::TYPE_GEOMETRY;
-                const char* attr_url = getElementAttribute(instance_geometry, "url");
-                if (attr_url[0] == '#') {
-                    attr_url = &attr_url[1];
+    //  小数部
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+                if (mantissa) {
+                    ++digits;
                 }
-                vs->url_ = attr_url;
+                --exponent;
+            }
+            has_digit = true;
+            ++p;
+        }
+    }
 
-            
-                //  マテリアル取得
-                const xml::XMLElement* bind_material = firstChildElement(
-                    instance_geometry,
-                    "bind_material"
-                );
-                if (bind_material) {
-                    //  マテリアル設定があった
-                    const xml::XMLElement* technique_common = firstChildElement(
-                        bind_material,
-                        "technique_common"
-                    );
-                    const xml::XMLElement* instance_material = firstChildElement(
-                        technique_common,
-                        "instance_material"
-                    );
-                    const char* attr_target = getElementAttribute(
-                        instance_material,
-                        "target"
-                    );
-                    if (attr_target[0] == '#') {
-                        attr_target = &attr_target[1];
-                    }
-                    vs->bind_material_ = attr_target;
+    if (!has_digit) {
+        //  nan / inf 表記
+        double special = 0.0;
+        if (matchKeyword(p, end, "nan")) {
+            special = std::numeric_limits<double>::quiet_NaN();
+        }
+        else if (matchKeyword(p, end, "inf")) {
+            special = std::numeric_limits<double>::infinity();
+        }
+        *out = negative ? -special : special;
+        return skipToken(p, end);
+    }
+
+    //  指数部
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* exp_start = p;
+        ++p;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            ++p;
+        }
+        if (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+            int exp_value = 0;
+            while (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+                if (exp_value < 10000) {
+                    exp_value = exp_value * 10 + (*p - '0');
                 }
-            
+                ++p;
             }
-            
-            out.push_back(vs);
-            visual_scene_node = visual_scene_node->NextSiblingElement("node");
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+        else {
+            //  "1e" のような不正な指数は無視
+            p = exp_start;
         }
-        visual_scene = visual_scene->NextSiblingElement("visual_scene");
     }
+
+    double value = composeDouble(mantissa, exponent);
+    *out = negative ? -value : value;
+    return skipToken(p, end);
 }
 
+//----------------------------------------------------------------------
+//  整数を1つ読み込む
+//  インデックス用なので浮動小数を経由しない
+const char* parseInteger(
+    const char* p,
+    const char* const end,
+    int64_t* out
+) {
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = (*p == '-');
+        ++p;
+    }
+    uint64_t value = 0;
+    while (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+        value = value * 10 + static_cast<unsigned>(*p - '0');
+        ++p;
+    }
+    *out = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+    return skipToken(p, end);
+}
 
 //----------------------------------------------------------------------
-//  マテリアルノード読み込み
-void collectMaterialNode(
-    Materials& out,
-    const xml::XMLElement* library_materials
+//  数値列読み込み(浮動小数)
+template <typename T, typename A>
+size_t readNumbers(
+    const char* p,
+    const char* const end,
+    std::vector<T, A>* container,
+    std::true_type  // is_floating_point
 ) {
-    const xml::XMLElement* material = firstChildElement(library_materials, "material");
+    size_t count = 0;
+    p = skipSpace(p, end);
+    while (p < end) {
+        double v;
+        p = parseFloat(p, end, &v);
+        container->push_back(static_cast<T>(v));
+        ++count;
+        p = skipSpace(p, end);
+    }
+    return count;
+}
 
-    while (material) {
-        const xml::XMLElement* instance_effect = firstChildElement(material, "instance_effect");
-        std::shared_ptr<MaterialData> md = std::make_shared<MaterialData>();
-        md->id_ = getElementAttribute(material, "id");
-        while (instance_effect) {
-            const char* attr_url = getElementAttribute(instance_effect, "url");
-            if (attr_url[0] == '#') {
-                attr_url = &attr_url[1];
-            }
-            md->url_ = attr_url;
-            instance_effect = instance_effect->NextSiblingElement("instance_effect");
-        }
-        
-        out.push_back(md);
-        material = material->NextSiblingElement("material");
+//----------------------------------------------------------------------
+//  数値列読み込み(整数)
+template <typename T, typename A>
+size_t readNumbers(
+    const char* p,
+    const char* const end,
+    std::vector<T, A>* container,
+    std::false_type // is_floating_point
+) {
+    size_t count = 0;
+    p = skipSpace(p, end);
+    while (p < end) {
+        int64_t v;
+        p = parseInteger(p, end, &v);
+        container->push_back(static_cast<T>(v));
+        ++count;
+        p = skipSpace(p, end);
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+//  配列データ読み込み
+//  要素の型で浮動小数用と整数用の処理を切り替える
+template <typename T, typename A>
+size_t readArray(
+    const char* begin,
+    const char* end,
+    std::vector<T, A>* container
+){
+    return readNumbers(
+        begin,
+        end,
+        container,
+        typename std::is_floating_point<T>::type()
+    );
+}
+
+template <typename T, typename A>
+size_t readArray(
+    const char* text,
+    std::vector<T, A>* container
+){
+    if (!text) {
+        return 0;
     }
+    return readArray(text, text + std::strlen(text), container);
 }
 
+//----------------------------------------------------------------------
+//  数値(空白で区切られたトークン)の数を数える
+//  空白から非空白に変わる位置を16byte単位でまとめて数える
+size_t countTokens(
+    const char* p,
+    const char* const end
+) {
+    size_t count = 0;
+    unsigned int prev_token = 0;    //  直前の文字がトークンの一部か
+#if TINY_COLLADA_USE_SSE2
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, sp), _mm_cmpeq_epi8(chunk, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr))
+        );
+        unsigned int token = static_cast<unsigned int>(_mm_movemask_epi8(ws)) ^ 0xFFFFu;
+        unsigned int starts = token & ~((token << 1) | prev_token);
+        count += countBits(starts);
+        prev_token = (token >> 15) & 1;
+        p += 16;
+    }
+#endif
+    while (p < end) {
+        unsigned int token = isSpace(*p) ? 0 : 1;
+        count += token & ~prev_token;
+        prev_token = token;
+        ++p;
+    }
+    return count;
+}
 
 //----------------------------------------------------------------------
-//  materialノード読み込み
-void parseEffect(
-    std::shared_ptr<tc::ColladaMaterial>& material,
-    const xml::XMLElement* shading
+//  確保済みの領域に数値列を読み込む(浮動小数)
+template <typename T>
+size_t readNumbersInto(
+    const char* p,
+    const char* const end,
+    T* dst,
+    size_t capacity,
+    std::true_type  // is_floating_point
 ) {
-    //  エミッション
-    const xml::XMLElement* emission = firstChildElement(shading, "emission");
-    if (emission) {
-        const xml::XMLElement* color = firstChildElement(emission, "color");
-        if (color) {
-            const char* text = color->GetText();
-            readArray(text, &material->emission_);
+    size_t count = 0;
+    p = skipSpace(p, end);
+    while (p < end && count < capacity) {
+        double v;
+        p = parseFloat(p, end, &v);
+        dst[count++] = static_cast<T>(v);
+        p = skipSpace(p, end);
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+//  確保済みの領域に数値列を読み込む(整数)
+template <typename T>
+size_t readNumbersInto(
+    const char* p,
+    const char* const end,
+    T* dst,
+    size_t capacity,
+    std::false_type // is_floating_point
+) {
+    size_t count = 0;
+    p = skipSpace(p, end);
+    while (p < end && count < capacity) {
+        int64_t v;
+        p = parseInteger(p, end, &v);
+        dst[count++] = static_cast<T>(v);
+        p = skipSpace(p, end);
+    }
+    return count;
+}
+
+
+//======================================================================
+//  ワークスティーリングのタスクプール
+//  スレッドごとにキューを持ち、自分のキューは後ろから、
+//  他スレッドのキューは前から盗んで処理する
+class TaskPool
+{
+public:
+    explicit TaskPool(
+        unsigned int thread_count
+    )   : queues_()
+        , workers_()
+        , wake_mutex_()
+        , wake_cond_()
+        , pending_(0)
+        , next_queue_(0)
+        , quit_(false)
+    {
+        if (thread_count < 1) {
+            thread_count = 1;
+        }
+        //  キュー0は呼び出し側スレッド用
+        for (unsigned int i = 0; i < thread_count; ++i) {
+            queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (unsigned int i = 1; i < thread_count; ++i) {
+            workers_.push_back(std::thread(&TaskPool::workerMain, this, i));
         }
     }
-    //  アンビエント
-    const xml::XMLElement* ambient = firstChildElement(shading, "ambient");
-    if (ambient) {
-        const xml::XMLElement* color = firstChildElement(ambient, "color");
-        if (color) {
-            const char* text = color->GetText();
-            readArray(text, &material->ambient_);
+
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            quit_ = true;
+        }
+        wake_cond_.notify_all();
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i].join();
         }
     }
 
-    //  ディフューズ
-    const xml::XMLElement* diffuse = firstChildElement(shading, "diffuse");
-    if (diffuse) {
-        const xml::XMLElement* color = firstChildElement(diffuse, "color");
-        if (color) {
-            const char* text = color->GetText();
-            readArray(text, &material->diffuse_);
+    TaskPool& operator=(const TaskPool&) = delete;	// コピーの禁止
+    TaskPool(const TaskPool&) = delete;
+
+public:
+    //----------------------------------------------------------------------
+    //  呼び出し側も含めたスレッド数
+    unsigned int threadCount() const {
+        return static_cast<unsigned int>(queues_.size());
+    }
+
+    //----------------------------------------------------------------------
+    //  0 から count - 1 までを並列に処理して全て終わるまで待つ
+    //  待っている間は呼び出し側も処理に参加するので、タスクの中から呼んでもよい
+    //  タスクが例外を投げた場合は最初の例外を呼び出し側に投げなおす
+    void parallelFor(
+        size_t count,
+        const std::function<void(size_t)>& func
+    ) {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1 || threadCount() == 1) {
+            for (size_t i = 0; i < count; ++i) {
+                func(i);
+            }
+            return;
+        }
+
+        Group group;
+        group.remaining_ = count;
+        int self = currentQueueIndex();
+        for (size_t i = 0; i < count; ++i) {
+            size_t queue_idx = self >= 0 ? self : (next_queue_++ % queues_.size());
+            Task task;
+            task.group_ = &group;
+            task.func_ = &func;
+            task.index_ = i;
+            push(queue_idx, task);
+        }
+
+        //  自分のグループが終わるまで手伝う
+        //  取れるタスクが無ければ、グループが終わるかタスクが追加されるまで眠る
+        size_t home = self >= 0 ? self : 0;
+        while (group.remaining_.load() > 0) {
+            if (runOne(home)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_cond_.wait(lock, [this, &group]() {
+                return group.remaining_.load() == 0 || pending_ > 0;
+            });
+        }
+        if (group.exception_) {
+            std::rethrow_exception(group.exception_);
         }
     }
 
-    //  スペキュラ
-    const xml::XMLElement* specular = firstChildElement(shading, "specular");
-    if (specular) {
-        const xml::XMLElement* color = firstChildElement(specular, "color");
-        if (color) {
-            const char* text = color->GetText();
-            readArray(text, &material->specular_);
+private:
+    struct Group {
+        Group()
+            : remaining_(0)
+            , exception_mutex_()
+            , exception_()
+        {}
+        std::atomic<size_t> remaining_;
+        std::mutex exception_mutex_;
+        std::exception_ptr exception_;
+    };
+
+    struct Task {
+        Group* group_;
+        const std::function<void(size_t)>* func_;
+        size_t index_;
+    };
+
+    struct Queue {
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+    };
+
+    //----------------------------------------------------------------------
+    //  このスレッドが使うキュー番号(プール外のスレッドなら -1)
+    int currentQueueIndex() const {
+        return current_pool_ == this ? current_queue_ : -1;
+    }
+
+    //----------------------------------------------------------------------
+    //  タスク追加
+    void push(
+        size_t queue_idx,
+        const Task& task
+    ) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[queue_idx]->mutex_);
+            queues_[queue_idx]->tasks_.push_back(task);
         }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            ++pending_;
+        }
+        wake_cond_.notify_one();
     }
 
-    //  リフレクティブ
-    const xml::XMLElement* reflective = firstChildElement(shading, "reflective");
-    if (reflective) {
-        const xml::XMLElement* color = firstChildElement(reflective, "color");
-        if (color) {
-            const char* text = color->GetText();
-            readArray(text, &material->reflective_);
+    //----------------------------------------------------------------------
+    //  タスク取得
+    //  自分のキューは後ろから、他のキューは前から取る
+    bool pop(
+        size_t home,
+        Task* out
+    ) {
+        size_t queue_count = queues_.size();
+        for (size_t n = 0; n < queue_count; ++n) {
+            size_t queue_idx = (home + n) % queue_count;
+            Queue* queue = queues_[queue_idx].get();
+            std::lock_guard<std::mutex> lock(queue->mutex_);
+            if (queue->tasks_.empty()) {
+                continue;
+            }
+            if (n == 0) {
+                *out = queue->tasks_.back();
+                queue->tasks_.pop_back();
+            }
+            else {
+                *out = queue->tasks_.front();
+                queue->tasks_.pop_front();
+            }
+            std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+            --pending_;
+            return true;
         }
+        return false;
     }
-    
-    
-    //  リフレクティビティ
-    const xml::XMLElement* reflectivity = firstChildElement(shading, "reflectivity");
-    if (reflectivity) {
-        const xml::XMLElement* data = firstChildElement(reflectivity, "float");
-        const char* val = data->GetText();
 
-        material->reflectivity_ = atof(val);
+    //----------------------------------------------------------------------
+    //  タスクを1つ処理
+    bool runOne(
+        size_t home
+    ) {
+        Task task;
+        if (!pop(home, &task)) {
+            return false;
+        }
+        try {
+            (*task.func_)(task.index_);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(task.group_->exception_mutex_);
+            if (!task.group_->exception_) {
+                task.group_->exception_ = std::current_exception();
+            }
+        }
+        //  最後のタスクならグループの終わりを待っているスレッドを起こす
+        //  起きた側はすぐに group を破棄するので、これ以降 task.group_ には触らない
+        if (task.group_->remaining_.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            wake_cond_.notify_all();
+        }
+        return true;
     }
 
-    //  シャイネス
-    const xml::XMLElement* shininess = firstChildElement(shading, "shininess");
-    if (shininess) {
-        const xml::XMLElement* data = firstChildElement(shininess, "float");
-        const char* val = data->GetText();
+    //----------------------------------------------------------------------
+    //  ワーカースレッド
+    void workerMain(
+        unsigned int queue_idx
+    ) {
+        current_pool_ = this;
+        current_queue_ = static_cast<int>(queue_idx);
+        for (;;) {
+            if (runOne(queue_idx)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_cond_.wait(lock, [this]() { return quit_ || pending_ > 0; });
+            if (quit_) {
+                return;
+            }
+        }
+    }
 
-        material->shininess_ = atof(val);
+private:
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cond_;
+    size_t pending_;
+    std::atomic<size_t> next_queue_;
+    bool quit_;
+
+    static thread_local const TaskPool* current_pool_;
+    static thread_local int current_queue_;
+};
+thread_local const TaskPool* TaskPool::current_pool_ = nullptr;
+thread_local int TaskPool::current_queue_ = -1;
+
+//======================================================================
+//  巨大な配列テキストの並列読み込み
+//  空白位置でチャンクに分割し、各チャンクの数値の数を数えてから
+//  書き込み位置を決めて並列に変換する
+const size_t PARALLEL_DECODE_MIN_BYTES = 4 * 1024 * 1024;
+const size_t PARALLEL_DECODE_CHUNK_BYTES = 1024 * 1024;
+
+//----------------------------------------------------------------------
+//  count_hint は count アトリビュートなどから分かっている数値の数
+//  0(不明)のときや、数えた結果と一致しないときは1スレッドで読む
+template <typename T>
+void readArrayParallel(
+    const char* const begin,
+    const char* const end,
+    const size_t count_hint,
+    std::vector<T>* container,
+    TaskPool* pool
+) {
+    //  count は壊れていることがあるので、テキストに入りうる数までにする
+    //  数値1つには少なくとも1文字と区切りが要る
+    const size_t bytes = end - begin;
+    const size_t expected_count = std::min(count_hint, bytes / 2 + 1);
+    if (!pool || expected_count == 0 || bytes < PARALLEL_DECODE_MIN_BYTES) {
+        container->reserve(container->size() + expected_count);
+        readArray(begin, end, container);
+        return;
     }
-    
-    //  透明度
-    const xml::XMLElement* transparency = firstChildElement(shading, "transparency");
-    if (transparency) {
-        const xml::XMLElement* data = firstChildElement(transparency, "float");
-        const char* val = data->GetText();
 
-        material->transparency_ = atof(val);
+    //  空白位置でチャンクに分割
+    size_t chunk_count = bytes / PARALLEL_DECODE_CHUNK_BYTES;
+    const size_t max_chunk_count = pool->threadCount() * 4;
+    if (chunk_count > max_chunk_count) {
+        chunk_count = max_chunk_count;
+    }
+    std::vector<const char*> bounds(chunk_count + 1);
+    bounds[0] = begin;
+    bounds[chunk_count] = end;
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const char* p = begin + bytes / chunk_count * i;
+        if (p < bounds[i - 1]) {
+            p = bounds[i - 1];
+        }
+        bounds[i] = skipToken(p, end);
+    }
+
+    //  チャンクごとの数値の数から書き込み位置を決める
+    std::vector<size_t> offsets(chunk_count + 1, 0);
+    pool->parallelFor(chunk_count, [&bounds, &offsets](size_t i) {
+        offsets[i + 1] = countTokens(bounds[i], bounds[i + 1]);
+    });
+    for (size_t i = 0; i < chunk_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    if (offsets[chunk_count] != expected_count) {
+        TINY_COLLADA_LOG_WARNING("count mismatch %lu != %lu. read serially.", offsets[chunk_count], expected_count);
+        container->reserve(container->size() + offsets[chunk_count]);
+        readArray(begin, end, container);
+        return;
     }
 
+    //  変換
+    const size_t base = container->size();
+    container->resize(base + expected_count);
+    T* dst = container->data() + base;
+    pool->parallelFor(chunk_count, [&bounds, &offsets, dst](size_t i) {
+        readNumbersInto(
+            bounds[i],
+            bounds[i + 1],
+            dst + offsets[i],
+            offsets[i + 1] - offsets[i],
+            typename std::is_floating_point<T>::type()
+        );
+    });
+}
+
+
+//======================================================================
+//  ストリーミング解析で抜き出した配列データ
+//  骨格XMLの要素には抜き出した配列の番号をアトリビュートで残す
+const char* FLOAT_PAYLOAD_ATTR_NAME = "tc_float_payload";
+const char* INDEX_PAYLOAD_ATTR_NAME = "tc_index_payload";
+
+struct StreamPayloads
+{
+    //  変換前のテキスト範囲
+    //  入力がメモリ上に残っている場合は変換を後回しにして範囲だけ覚える
+    struct TextRange {
+        const char* begin_;
+        const char* end_;
+    };
+
+    //  変換済みの配列は大きいので解放し、範囲の一覧は容量を残して使い回す
+    void clear() {
+        std::vector<std::vector<float>>().swap(floats_);
+        std::vector<tc::Indices>().swap(indices_);
+        float_texts_.clear();
+        index_texts_.clear();
+    }
+
+    std::vector<std::vector<float>> floats_;
+    std::vector<tc::Indices> indices_;
+    std::vector<TextRange> float_texts_;
+    std::vector<TextRange> index_texts_;
+};
+
+
+//======================================================================
+//  メッシュ解析時に参照するデータ
+struct DecodeContext
+{
+    DecodeContext()
+        : payloads_(nullptr)
+        , pool_(nullptr)
+        , strings_(nullptr)
+    {}
+
+    const StreamPayloads* payloads_;    //  ストリーミング解析で抜き出した配列
+    TaskPool* pool_;                    //  並列読み込み用
+    StringTable* strings_;              //  名前の登録先
+};
+
+
+//----------------------------------------------------------------------
+//  抜き出した配列データを読み込む
+template <typename T, typename U>
+void readPayload(
+    const std::vector<StreamPayloads::TextRange>& texts,
+    const std::vector<std::vector<U>>& decoded,
+    unsigned int payload_idx,
+    std::vector<T>* container,
+    const size_t expected_count,
+    TaskPool* pool
+) {
+    if (payload_idx < texts.size()) {
+        const StreamPayloads::TextRange& text = texts[payload_idx];
+        readArrayParallel(text.begin_, text.end_, expected_count, container, pool);
+    }
+    else {
+        const std::vector<U>& src = decoded.at(payload_idx);
+        container->insert(container->end(), src.begin(), src.end());
+    }
+}
+
+//----------------------------------------------------------------------
+//  要素の配列データ読み込み
+//  ストリーミング解析済みならそちらから、そうでなければテキストから読む
+template <typename T>
+void readElementArray(
+    const xml::XMLElement* element,
+    std::vector<T>* container,
+    const DecodeContext& context,
+    const size_t expected_count
+) {
+    const StreamPayloads* payloads = context.payloads_;
+    if (payloads) {
+        unsigned int payload_idx = 0;
+        if (element->QueryUnsignedAttribute(FLOAT_PAYLOAD_ATTR_NAME, &payload_idx) == xml::XML_SUCCESS) {
+            readPayload(payloads->float_texts_, payloads->floats_, payload_idx, container, expected_count, context.pool_);
+            return;
+        }
+        if (element->QueryUnsignedAttribute(INDEX_PAYLOAD_ATTR_NAME, &payload_idx) == xml::XML_SUCCESS) {
+            readPayload(payloads->index_texts_, payloads->indices_, payload_idx, container, expected_count, context.pool_);
+            return;
+        }
+    }
+    const char* text = element->GetText();
+    if (text) {
+        readArrayParallel(text, text + std::strlen(text), expected_count, container, context.pool_);
+    }
+}
+
+
+//======================================================================
+//  メモリマップしたファイル
+//  ページキャッシュ上のデータをコピーせずにそのまま読む
+class MappedFile
+{
+public:
+    MappedFile()
+        : data_(nullptr)
+        , size_(0)
+#if TINY_COLLADA_USE_WIN32_MAPPING
+        , file_(INVALID_HANDLE_VALUE)
+        , mapping_(nullptr)
+#endif
+    {}
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile& operator=(const MappedFile&) = delete;	// コピーの禁止
+    MappedFile(const MappedFile&) = delete;
+
+public:
+    //----------------------------------------------------------------------
+    //  マップする
+    //  マップできない環境やファイル(空ファイル、パイプなど)では false
+    bool open(
+        const char* const path
+    ) {
+        close();
+#if TINY_COLLADA_USE_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        //  先頭から順に読むことをカーネルに伝えて先読みを効かせる
+        ::posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(addr);
+        size_ = size;
+        return true;
+#elif TINY_COLLADA_USE_WIN32_MAPPING
+        file_ = ::CreateFileA(
+            path,
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr
+        );
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!::GetFileSizeEx(file_, &file_size) || file_size.QuadPart <= 0) {
+            close();
+            return false;
+        }
+        mapping_ = ::CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            close();
+            return false;
+        }
+        const void* view = ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char*>(view);
+        size_ = static_cast<size_t>(file_size.QuadPart);
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    //----------------------------------------------------------------------
+    //  アンマップ
+    void close() {
+#if TINY_COLLADA_USE_MMAP
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#elif TINY_COLLADA_USE_WIN32_MAPPING
+        if (data_) {
+            ::UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            ::CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    //----------------------------------------------------------------------
+    //  読み終えた範囲のページを手放す
+    //  巨大なファイルを流し読みするときに常駐メモリを増やさないため
+    void release(
+        size_t offset,
+        size_t size
+    ) {
+#if TINY_COLLADA_USE_MMAP
+        static const size_t page_mask = static_cast<size_t>(::sysconf(_SC_PAGESIZE)) - 1;
+        size_t begin = (offset + page_mask) & ~page_mask;
+        size_t end = (offset + size) & ~page_mask;
+        if (data_ && begin < end) {
+            ::posix_madvise(const_cast<char*>(data_) + begin, end - begin, POSIX_MADV_DONTNEED);
+        }
+#else
+        (void)offset;
+        (void)size;
+#endif
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+#if TINY_COLLADA_USE_WIN32_MAPPING
+    HANDLE file_;
+    HANDLE mapping_;
+#endif
+};
+
+
+//----------------------------------------------------------------------
+//  ファイル全体を読み込む
+//  マップできないファイル用
+bool readFile(
+    const char* const path,
+    std::vector<char>& out
+) {
+    FILE* fp = std::fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    out.clear();
+    char chunk[64 * 1024];
+    size_t read_size = 0;
+    while ((read_size = std::fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        out.insert(out.end(), chunk, chunk + read_size);
+    }
+    bool failed = std::ferror(fp) != 0;
+    std::fclose(fp);
+    return !failed;
+}
+
+//----------------------------------------------------------------------
+//  ファイルサイズ取得
+//  取得できなければ 0
+uint64_t getFileSize(
+    const char* const path
+) {
+#if TINY_COLLADA_USE_MMAP
+    struct stat st;
+    if (::stat(path, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+#else
+    FILE* fp = std::fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    uint64_t size = 0;
+    if (std::fseek(fp, 0, SEEK_END) == 0) {
+        long position = std::ftell(fp);
+        size = position > 0 ? static_cast<uint64_t>(position) : 0;
+    }
+    std::fclose(fp);
+    return size;
+#endif
+}
+
+
+//======================================================================
+//  バイナリキャッシュ形式
+//  [ヘッダ][メッシュ表][マテリアル表][シーン表][文字列][配列本体] の順に並ぶ
+//  ノード階層は表を持たず、種類ごとの配列を配列本体に置く
+//  オフセットはすべてファイル先頭から。配列本体は8バイト境界に置く
+//  同じ環境で書いて読むことを前提に、構造体をそのまま書き出す
+
+const char CACHE_MAGIC[8] = {'T', 'C', 'C', 'A', 'C', 'H', 'E', '\0'};
+const uint32_t CACHE_VERSION = 3;
+const uint32_t CACHE_ENDIAN_TAG = 0x01020304;
+const uint32_t CACHE_NO_STRING = 0xFFFFFFFF;
+const size_t CACHE_ALIGNMENT = 8;
+
+//  配列の位置と要素数
+struct CacheArray
+{
+    uint64_t offset_;
+    uint64_t count_;
+};
+
+//  ノード階層の配列
+struct CacheNodeTable
+{
+    CacheArray parents_;
+    CacheArray ids_;                //  文字列領域の先頭からの位置
+    CacheArray local_matrices_;
+    CacheArray world_matrices_;
+};
+
+struct CacheHeader
+{
+    char magic_[8];
+    uint32_t version_;
+    uint32_t endian_tag_;
+    uint64_t file_size_;
+    uint64_t source_size_;
+    uint64_t source_hash_;
+    CacheArray meshes_;
+    CacheArray materials_;
+    CacheArray scenes_;
+    CacheArray strings_;
+    CacheNodeTable nodes_;
+};
+
+struct CacheMeshRecord
+{
+    int32_t primitive_type_;
+    int8_t strides_[3];             //  位置、法線、uv
+    uint8_t interleaved_stride_;
+    uint32_t index_type_;
+    uint32_t reserved_;
+    CacheArray data_[3];
+    CacheArray indices_[3];
+    CacheArray interleaved_layout_;
+    CacheArray interleaved_data_;
+    CacheArray index_buffer_;
+    CacheArray submeshes_;          //  SceneCache::SubMesh
+};
+
+struct CacheMaterialRecord
+{
+    uint32_t shading_name_;         //  文字列領域の先頭からの位置
+    uint32_t texture_name_;
+    CacheArray colors_[5];          //  diffuse, ambient, emission, specular, reflective
+    float shininess_;
+    float transparency_;
+    float reflectivity_;
+    uint32_t reserved_;
+};
+
+struct CacheSceneRecord
+{
+    CacheArray matrix_;
+    CacheArray meshes_;
+    int32_t material_;
+    uint32_t node_;
+    CacheArray submesh_materials_;  //  meshes_ の順に並べたサブメッシュごとのマテリアル番号
+};
+
+
+//----------------------------------------------------------------------
+//  元ファイルの照合用ハッシュ
+//  8バイトずつ4レーンで混ぜる
+uint64_t hashBytes(
+    const char* data,
+    size_t size
+) {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t lanes[4] = {
+        PRIME1 + PRIME2,
+        PRIME2,
+        0,
+        0 - PRIME1
+    };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            std::memcpy(&word, data + i + lane * 8, sizeof(word));
+            uint64_t h = lanes[lane] + word * PRIME2;
+            h = (h << 31) | (h >> 33);
+            lanes[lane] = h * PRIME1;
+        }
+    }
+    uint64_t hash = size;
+    for (int lane = 0; lane < 4; ++lane) {
+        hash = (hash ^ lanes[lane]) * PRIME1;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * PRIME2;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+//----------------------------------------------------------------------
+//  ファイルのサイズとハッシュを求める
+bool hashFile(
+    const char* const path,
+    uint64_t* size,
+    uint64_t* hash
+) {
+    MappedFile file;
+    if (file.open(path)) {
+        *size = file.size();
+        *hash = hashBytes(file.data(), file.size());
+        return true;
+    }
+
+    //  マップできなければ読み込む
+    std::vector<char> data;
+    if (!readFile(path, data)) {
+        return false;
+    }
+    *size = data.size();
+    *hash = hashBytes(data.data(), data.size());
+    return true;
+}
+
+
+//======================================================================
+//  キャッシュの組み立て
+class CacheBuilder
+{
+public:
+    CacheBuilder()
+        : blob_()
+        , strings_()
+        , string_offsets_()
+    {}
+
+public:
+    //----------------------------------------------------------------------
+    //  配列を本体に追加
+    //  オフセットは本体先頭から。最後に rebase でファイル先頭からに直す
+    template <typename T>
+    CacheArray addArray(
+        const T* data,
+        size_t count
+    ) {
+        CacheArray array = {0, 0};
+        if (count == 0) {
+            return array;
+        }
+        size_t offset = (blob_.size() + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+        blob_.resize(offset + count * sizeof(T), 0);
+        std::memcpy(&blob_[offset], data, count * sizeof(T));
+        array.offset_ = offset;
+        array.count_ = count;
+        return array;
+    }
+
+    template <typename T>
+    CacheArray addArray(
+        const std::vector<T>& data
+    ) {
+        return addArray(data.data(), data.size());
+    }
+
+    //----------------------------------------------------------------------
+    //  文字列を追加
+    //  同じ文字列は1つにまとめる
+    uint32_t addString(
+        const char* str
+    ) {
+        if (!str) {
+            return CACHE_NO_STRING;
+        }
+        std::string key(str);
+        auto found = string_offsets_.find(key);
+        if (found != string_offsets_.end()) {
+            return found->second;
+        }
+        uint32_t offset = static_cast<uint32_t>(strings_.size());
+        strings_.append(key);
+        strings_.push_back('\0');
+        string_offsets_[key] = offset;
+        return offset;
+    }
+
+    //----------------------------------------------------------------------
+    //  本体内のオフセットをファイル先頭からに直す
+    static void rebase(
+        CacheArray& array,
+        uint64_t base
+    ) {
+        if (array.count_ > 0) {
+            array.offset_ += base;
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  書き出し用のバイト列を作る
+    void build(
+        std::vector<CacheMeshRecord>& meshes,
+        std::vector<CacheMaterialRecord>& materials,
+        std::vector<CacheSceneRecord>& scenes,
+        const CacheNodeTable& nodes,
+        uint64_t source_size,
+        uint64_t source_hash,
+        std::vector<char>& out
+    ) {
+        CacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic_, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version_ = CACHE_VERSION;
+        header.endian_tag_ = CACHE_ENDIAN_TAG;
+        header.source_size_ = source_size;
+        header.source_hash_ = source_hash;
+
+        uint64_t offset = sizeof(CacheHeader);
+        header.meshes_.offset_ = offset;
+        header.meshes_.count_ = meshes.size();
+        offset += meshes.size() * sizeof(CacheMeshRecord);
+        header.materials_.offset_ = offset;
+        header.materials_.count_ = materials.size();
+        offset += materials.size() * sizeof(CacheMaterialRecord);
+        header.scenes_.offset_ = offset;
+        header.scenes_.count_ = scenes.size();
+        offset += scenes.size() * sizeof(CacheSceneRecord);
+        header.strings_.offset_ = offset;
+        header.strings_.count_ = strings_.size();
+        offset += strings_.size();
+        const uint64_t blob_base = (offset + CACHE_ALIGNMENT - 1) & ~static_cast<uint64_t>(CACHE_ALIGNMENT - 1);
+        header.file_size_ = blob_base + blob_.size();
+
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            CacheMeshRecord& mesh = meshes[i];
+            for (int a = 0; a < 3; ++a) {
+                rebase(mesh.data_[a], blob_base);
+                rebase(mesh.indices_[a], blob_base);
+            }
+            rebase(mesh.interleaved_layout_, blob_base);
+            rebase(mesh.interleaved_data_, blob_base);
+            rebase(mesh.index_buffer_, blob_base);
+            rebase(mesh.submeshes_, blob_base);
+        }
+        for (size_t i = 0; i < materials.size(); ++i) {
+            for (int c = 0; c < 5; ++c) {
+                rebase(materials[i].colors_[c], blob_base);
+            }
+        }
+        for (size_t i = 0; i < scenes.size(); ++i) {
+            rebase(scenes[i].matrix_, blob_base);
+            rebase(scenes[i].meshes_, blob_base);
+            rebase(scenes[i].submesh_materials_, blob_base);
+        }
+        header.nodes_ = nodes;
+        rebase(header.nodes_.parents_, blob_base);
+        rebase(header.nodes_.ids_, blob_base);
+        rebase(header.nodes_.local_matrices_, blob_base);
+        rebase(header.nodes_.world_matrices_, blob_base);
+
+        out.assign(static_cast<size_t>(header.file_size_), 0);
+        std::memcpy(&out[0], &header, sizeof(header));
+        if (!meshes.empty()) {
+            std::memcpy(&out[header.meshes_.offset_], meshes.data(), meshes.size() * sizeof(CacheMeshRecord));
+        }
+        if (!materials.empty()) {
+            std::memcpy(&out[header.materials_.offset_], materials.data(), materials.size() * sizeof(CacheMaterialRecord));
+        }
+        if (!scenes.empty()) {
+            std::memcpy(&out[header.scenes_.offset_], scenes.data(), scenes.size() * sizeof(CacheSceneRecord));
+        }
+        if (!strings_.empty()) {
+            std::memcpy(&out[header.strings_.offset_], strings_.data(), strings_.size());
+        }
+        if (!blob_.empty()) {
+            std::memcpy(&out[blob_base], blob_.data(), blob_.size());
+        }
+    }
+
+private:
+    std::vector<char> blob_;
+    std::string strings_;
+    std::unordered_map<std::string, uint32_t> string_offsets_;
+};
+
+//----------------------------------------------------------------------
+//  メッシュのレコード作成
+CacheMeshRecord makeCacheMeshRecord(
+    const tc::ColladaMesh& mesh,
+    CacheBuilder& builder
+) {
+    CacheMeshRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.primitive_type_ = mesh.getPrimitiveType();
+
+    const tc::ColladaMesh::ArrayData* arrays[3] = {
+        mesh.getVertex(),
+        mesh.getNormals(),
+        mesh.getTexCoord()
+    };
+    for (int a = 0; a < 3; ++a) {
+        record.strides_[a] = arrays[a]->stride_;
+        record.data_[a] = builder.addArray(arrays[a]->data_);
+        record.indices_[a] = builder.addArray(arrays[a]->indices_);
+    }
+
+    const tc::ColladaMesh::InterleavedData* interleaved = mesh.getInterleaved();
+    record.interleaved_stride_ = interleaved->stride_;
+    record.interleaved_layout_ = builder.addArray(interleaved->layout_);
+    record.interleaved_data_ = builder.addArray(interleaved->data_);
+
+    const tc::IndexBuffer* index_buffer = mesh.getIndexBuffer();
+    record.index_type_ = index_buffer->getType();
+    if (index_buffer->getType() == tc::IndexBuffer::TYPE_UINT16) {
+        tc::ArraySpan<uint16_t> indices = index_buffer->getUint16();
+        record.index_buffer_ = builder.addArray(indices.data(), indices.size());
+    }
+    else {
+        tc::ArraySpan<uint32_t> indices = index_buffer->getUint32();
+        record.index_buffer_ = builder.addArray(indices.data(), indices.size());
+    }
+
+    const std::vector<tc::ColladaMesh::SubMesh>& submeshes = *mesh.getSubMeshes();
+    std::vector<tc::SceneCache::SubMesh> submesh_records(submeshes.size());
+    for (size_t i = 0; i < submeshes.size(); ++i) {
+        submesh_records[i].index_offset_ = submeshes[i].index_offset_;
+        submesh_records[i].index_count_ = submeshes[i].index_count_;
+    }
+    record.submeshes_ = builder.addArray(submesh_records);
+    return record;
+}
+
+//----------------------------------------------------------------------
+//  マテリアルのレコード作成
+CacheMaterialRecord makeCacheMaterialRecord(
+    const tc::ColladaMaterial& material,
+    CacheBuilder& builder
+) {
+    CacheMaterialRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.shading_name_ = builder.addString(material.shading_name_);
+    record.texture_name_ = builder.addString(material.texture_name_);
+    record.colors_[0] = builder.addArray(material.diffuse_);
+    record.colors_[1] = builder.addArray(material.ambient_);
+    record.colors_[2] = builder.addArray(material.emission_);
+    record.colors_[3] = builder.addArray(material.specular_);
+    record.colors_[4] = builder.addArray(material.reflective_);
+    record.shininess_ = material.shininess_;
+    record.transparency_ = material.transparency_;
+    record.reflectivity_ = material.reflectivity_;
+    return record;
+}
+
+//----------------------------------------------------------------------
+//  解析結果からキャッシュのバイト列を作る
+//  メッシュとマテリアルは共有されていても1度だけ書く
+//  サブメッシュのマテリアルはシーンごとに解決済みの番号で持つ
+void buildSceneCache(
+    const tc::ColladaScenes& scenes,
+    const tc::ColladaMeshes& meshes,
+    const tc::ColladaNodes& nodes,
+    uint64_t source_size,
+    uint64_t source_hash,
+    std::vector<char>& out
+) {
+    CacheBuilder builder;
+
+    std::vector<CacheMeshRecord> mesh_records;
+    std::unordered_map<const tc::ColladaMesh*, uint32_t> mesh_numbers;
+    mesh_records.reserve(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        mesh_numbers[meshes[i].get()] = static_cast<uint32_t>(mesh_records.size());
+        mesh_records.push_back(makeCacheMeshRecord(*meshes[i], builder));
+    }
+
+    std::vector<CacheMaterialRecord> material_records;
+    std::unordered_map<const tc::ColladaMaterial*, int32_t> material_numbers;
+    auto addMaterial = [&material_records, &material_numbers, &builder](const tc::ColladaMaterial* material) {
+        if (!material) {
+            return -1;
+        }
+        auto found = material_numbers.find(material);
+        if (found == material_numbers.end()) {
+            found = material_numbers.insert(std::make_pair(material, static_cast<int32_t>(material_records.size()))).first;
+            material_records.push_back(makeCacheMaterialRecord(*material, builder));
+        }
+        return found->second;
+    };
+
+    std::vector<CacheSceneRecord> scene_records;
+    scene_records.reserve(scenes.size());
+    tc::Indices scene_meshes;
+    std::vector<int32_t> submesh_materials;
+    for (size_t i = 0; i < scenes.size(); ++i) {
+        const tc::ColladaScene& scene = *scenes[i];
+        CacheSceneRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.matrix_ = builder.addArray(scene.matrix_);
+        record.node_ = scene.node_;
+
+        scene_meshes.clear();
+        submesh_materials.clear();
+        for (size_t m = 0; m < scene.meshes_.size(); ++m) {
+            auto found = mesh_numbers.find(scene.meshes_[m].get());
+            if (found == mesh_numbers.end()) {
+                found = mesh_numbers.insert(std::make_pair(scene.meshes_[m].get(), static_cast<uint32_t>(mesh_records.size()))).first;
+                mesh_records.push_back(makeCacheMeshRecord(*scene.meshes_[m], builder));
+            }
+            scene_meshes.push_back(found->second);
+
+            const std::vector<tc::ColladaMesh::SubMesh>& submeshes = *scene.meshes_[m]->getSubMeshes();
+            for (size_t s = 0; s < submeshes.size(); ++s) {
+                submesh_materials.push_back(addMaterial(scene.findMaterial(submeshes[s].material_).get()));
+            }
+        }
+        record.meshes_ = builder.addArray(scene_meshes);
+        record.submesh_materials_ = builder.addArray(submesh_materials);
+        record.material_ = addMaterial(scene.material_.get());
+        scene_records.push_back(record);
+    }
+
+    CacheNodeTable node_table;
+    std::vector<uint32_t> node_ids(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        node_ids[i] = builder.addString(nodes.ids_[i].c_str());
+    }
+    node_table.parents_ = builder.addArray(nodes.parents_);
+    node_table.ids_ = builder.addArray(node_ids);
+    node_table.local_matrices_ = builder.addArray(nodes.local_matrices_);
+    node_table.world_matrices_ = builder.addArray(nodes.world_matrices_);
+
+    builder.build(mesh_records, material_records, scene_records, node_table, source_size, source_hash, out);
+}
+
+
+//======================================================================
+//  ストリーミングスキャナ
+//  .daeを少しずつ受け取りながら、巨大になる配列要素(float_array, p など)の
+//  テキストをその場で数値に変換して取り除き、残りを骨格XMLとして溜める。
+//  DOMになるのは骨格だけなので、ピークメモリはほぼ変換後の配列分になる
+
+//  開始タグの count から先に確保する要素数の上限
+//  開始タグの時点では本文の長さが分からないので、count をそのまま信じない
+const size_t MAX_RESERVE_COUNT = 1024 * 1024;
+
+class StreamScanner
+{
+public:
+    //  keep_text が true のときは配列を変換せずテキスト範囲だけ覚える
+    //  その場合、投入したデータは解析が終わるまで同じアドレスに残っていること
+    StreamScanner(
+        StreamPayloads* payloads,
+        bool keep_text
+    )   : state_(STATE_TEXT)
+        , quote_(0)
+        , keep_text_(keep_text)
+        , skeleton_()
+        , tag_()
+        , carry_()
+        , payloads_(payloads)
+        , floats_(nullptr)
+        , indices_(nullptr)
+        , text_begin_(nullptr)
+        , text_ranges_(nullptr)
+    {}
+
+public:
+    //----------------------------------------------------------------------
+    //  データ投入
+    //  チャンクの境界がタグや数値の途中でもよい
+    void feed(
+        const char* p,
+        size_t size
+    ) {
+        const char* const end = p + size;
+        while (p < end) {
+            switch (state_) {
+            case STATE_TEXT:
+                p = scanText(p, end);
+                break;
+            case STATE_TAG:
+                p = scanTag(p, end);
+                break;
+            case STATE_PAYLOAD:
+                p = scanPayload(p, end);
+                break;
+            }
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  投入終了
+    //  タグの途中で終わっていたら false
+    bool finish() {
+        if (state_ == STATE_PAYLOAD && !text_ranges_) {
+            flushCarry();
+        }
+        return state_ == STATE_TEXT;
+    }
+
+    //----------------------------------------------------------------------
+    //  骨格XML取得
+    std::string& skeleton() {
+        return skeleton_;
+    }
+
+private:
+    enum State {
+        STATE_TEXT,
+        STATE_TAG,
+        STATE_PAYLOAD
+    };
+
+    //----------------------------------------------------------------------
+    //  タグの外側のテキスト
+    const char* scanText(
+        const char* p,
+        const char* const end
+    ) {
+        const char* lt = static_cast<const char*>(std::memchr(p, '<', end - p));
+        if (!lt) {
+            skeleton_.append(p, end);
+            return end;
+        }
+        skeleton_.append(p, lt);
+        tag_.clear();
+        quote_ = 0;
+        state_ = STATE_TAG;
+        return lt + 1;
+    }
+
+    //----------------------------------------------------------------------
+    //  タグ
+    //  コメントとCDATAは終端記号まで、それ以外はクォート外の '>' まで
+    const char* scanTag(
+        const char* p,
+        const char* const end
+    ) {
+        while (p < end) {
+            const char c = *p++;
+            if (c == '>' && quote_ == 0 && isTagClosed()) {
+                onTagClosed();
+                text_begin_ = p;
+                return p;
+            }
+            if (!isRawTag()) {
+                if (quote_ == 0 && (c == '"' || c == '\'')) {
+                    quote_ = c;
+                }
+                else if (quote_ == c) {
+                    quote_ = 0;
+                }
+            }
+            tag_.push_back(c);
+        }
+        return p;
+    }
+
+    //----------------------------------------------------------------------
+    //  配列要素のテキスト
+    const char* scanPayload(
+        const char* p,
+        const char* const end
+    ) {
+        const char* lt = static_cast<const char*>(std::memchr(p, '<', end - p));
+        const char* seg_end = lt ? lt : end;
+
+        //  テキスト範囲だけ覚える
+        if (text_ranges_) {
+            if (!lt) {
+                return end;
+            }
+            StreamPayloads::TextRange range;
+            range.begin_ = text_begin_;
+            range.end_ = lt;
+            text_ranges_->push_back(range);
+            text_ranges_ = nullptr;
+            tag_.clear();
+            quote_ = 0;
+            state_ = STATE_TAG;
+            return lt + 1;
+        }
+
+        //  前のチャンクから続いている数値
+        if (!carry_.empty()) {
+            while (p < seg_end && !isSpace(*p)) {
+                carry_.push_back(*p++);
+            }
+            if (p == seg_end && !lt) {
+                return end;
+            }
+            flushCarry();
+        }
+
+        if (lt) {
+            readPayload(p, lt);
+            floats_ = nullptr;
+            indices_ = nullptr;
+            tag_.clear();
+            quote_ = 0;
+            state_ = STATE_TAG;
+            return lt + 1;
+        }
+
+        //  チャンク末尾の数値は途中で切れている可能性があるので持ち越す
+        const char* tail = end;
+        while (tail > p && !isSpace(tail[-1])) {
+            --tail;
+        }
+        readPayload(p, tail);
+        carry_.assign(tail, end);
+        return end;
+    }
+
+    //----------------------------------------------------------------------
+    //  持ち越した数値を変換
+    void flushCarry() {
+        if (!carry_.empty()) {
+            readPayload(carry_.data(), carry_.data() + carry_.size());
+            carry_.clear();
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  数値変換
+    void readPayload(
+        const char* begin,
+        const char* end
+    ) {
+        if (floats_) {
+            readArray(begin, end, floats_);
+        }
+        else if (indices_) {
+            readArray(begin, end, indices_);
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  中身をそのまま扱うタグか(コメント、CDATA)
+    bool isRawTag() const {
+        return tag_.compare(0, 3, "!--") == 0 || tag_.compare(0, 8, "![CDATA[") == 0;
+    }
+
+    //----------------------------------------------------------------------
+    //  タグの終端に達しているか
+    bool isTagClosed() const {
+        size_t size = tag_.size();
+        if (tag_.compare(0, 3, "!--") == 0) {
+            return size >= 5 && tag_.compare(size - 2, 2, "--") == 0;
+        }
+        if (tag_.compare(0, 8, "![CDATA[") == 0) {
+            return size >= 10 && tag_.compare(size - 2, 2, "]]") == 0;
+        }
+        return true;
+    }
+
+    //----------------------------------------------------------------------
+    //  タグ確定
+    void onTagClosed() {
+        state_ = STATE_TEXT;
+        skeleton_.push_back('<');
+        skeleton_.append(tag_);
+
+        //  配列要素の開始タグなら数値の受け取り先を用意する
+        const char c = tag_.empty() ? '/' : tag_[0];
+        bool is_start_tag = c != '/' && c != '!' && c != '?' && tag_[tag_.size() - 1] != '/';
+        if (is_start_tag) {
+            size_t name_len = 0;
+            while (name_len < tag_.size() && !isSpace(tag_[name_len])) {
+                ++name_len;
+            }
+            if (isFloatPayload(tag_.data(), name_len)) {
+                if (keep_text_) {
+                    appendPayloadAttribute(FLOAT_PAYLOAD_ATTR_NAME, payloads_->float_texts_.size());
+                    text_ranges_ = &payloads_->float_texts_;
+                }
+                else {
+                    appendPayloadAttribute(FLOAT_PAYLOAD_ATTR_NAME, payloads_->floats_.size());
+                    payloads_->floats_.push_back(std::vector<float>());
+                    floats_ = &payloads_->floats_.back();
+                    //  count は壊れていることがあるので、確保は上限までにして残りは追加時に伸ばす
+                    floats_->reserve(std::min(getCountAttribute(), MAX_RESERVE_COUNT));
+                }
+                state_ = STATE_PAYLOAD;
+            }
+            else if (isIndexPayload(tag_.data(), name_len)) {
+                if (keep_text_) {
+                    appendPayloadAttribute(INDEX_PAYLOAD_ATTR_NAME, payloads_->index_texts_.size());
+                    text_ranges_ = &payloads_->index_texts_;
+                }
+                else {
+                    appendPayloadAttribute(INDEX_PAYLOAD_ATTR_NAME, payloads_->indices_.size());
+                    payloads_->indices_.push_back(tc::Indices());
+                    indices_ = &payloads_->indices_.back();
+                }
+                state_ = STATE_PAYLOAD;
+            }
+        }
+        skeleton_.push_back('>');
+    }
+
+    //----------------------------------------------------------------------
+    //  配列番号アトリビュートを追加
+    void appendPayloadAttribute(
+        const char* attr_name,
+        size_t payload_idx
+    ) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), " %s=\"%lu\"", attr_name, static_cast<unsigned long>(payload_idx));
+        skeleton_.append(buf);
+    }
+
+    //----------------------------------------------------------------------
+    //  count アトリビュート取得(reserve用)
+    //  アトリビュートを順に読み、空白の種類と引用符(" か ')は問わない。無ければ0
+    size_t getCountAttribute() const {
+        const char* p = tag_.c_str();
+        const char* end = p + tag_.size();
+        while (p < end && !isSpace(*p)) {
+            ++p;
+        }
+        while (p < end) {
+            while (p < end && isSpace(*p)) {
+                ++p;
+            }
+            const char* name = p;
+            while (p < end && *p != '=' && !isSpace(*p)) {
+                ++p;
+            }
+            const size_t name_len = p - name;
+            while (p < end && isSpace(*p)) {
+                ++p;
+            }
+            if (p == end || *p != '=') {
+                return 0;
+            }
+            ++p;
+            while (p < end && isSpace(*p)) {
+                ++p;
+            }
+            if (p == end || (*p != '"' && *p != '\'')) {
+                return 0;
+            }
+            const char quote = *p++;
+            const char* value = p;
+            while (p < end && *p != quote) {
+                ++p;
+            }
+            if (name_len == 5 && std::strncmp(name, "count", 5) == 0) {
+                return std::strtoul(value, nullptr, 10);
+            }
+            ++p;
+        }
+        return 0;
+    }
+
+    //----------------------------------------------------------------------
+    //  浮動小数の配列要素か
+    static bool isFloatPayload(
+        const char* name,
+        size_t len
+    ) {
+        return (len == 11 && std::strncmp(name, "float_array", len) == 0)
+            || (len == 9 && std::strncmp(name, "int_array", len) == 0);
+    }
+
+    //----------------------------------------------------------------------
+    //  インデックスの配列要素か
+    static bool isIndexPayload(
+        const char* name,
+        size_t len
+    ) {
+        return (len == 1 && (name[0] == 'p' || name[0] == 'h'))
+            || (len == 6 && std::strncmp(name, "vcount", len) == 0);
+    }
+
+private:
+    State state_;
+    char quote_;
+    bool keep_text_;
+    std::string skeleton_;
+    std::string tag_;
+    std::string carry_;
+    StreamPayloads* payloads_;
+    std::vector<float>* floats_;
+    tc::Indices* indices_;
+    const char* text_begin_;
+    std::vector<StreamPayloads::TextRange>* text_ranges_;
+};
+
+
+//----------------------------------------------------------------------
+//  ソース解析
+void readSourceNode(
+    const xml::XMLElement* const source_node,
+    SourceData* out,
+    const DecodeContext& context
+) {
+    const int ARRAY_TYPE_MAX = 2;
+    char array_types[ARRAY_TYPE_MAX][15] = {
+        "float_array",
+        "int_array"
+    };
+        
+    for (int i = 0; i < ARRAY_TYPE_MAX; ++i) {
+        const xml::XMLElement* array_node = firstChildElement(
+            source_node, 
+            array_types[i]
+        );
+        if (!array_node) {
+            continue;
+        }
+        //  データのストライドを取得
+        out->stride_ = getStride(source_node);
+
+        //  データ数分のメモリをあらかじめリザーブ
+        size_t data_count = 0;
+        const char* count_str = getElementAttribute(array_node, COUNT_ATTR_NAME);
+        if (count_str) {
+            data_count = std::atoi(count_str);
+        }
+        TINY_COLLADA_LOG_DEBUG("reserve %lu", data_count);
+
+        //  データ取得
+        readElementArray(array_node, &out->data_, context, data_count);
+    }
+}
+
+
+//----------------------------------------------------------------------
+//  プリミティブノードの種類を取得
+//  三角形にできない要素なら nullptr
+const PrimitiveSelector* findPrimitiveSelector(
+    const xml::XMLElement* element
+) {
+    const char* name = element->Name();
+    for (int prim_idx = 0; prim_idx < PRIMITIVE_TYPE_NUM; ++prim_idx) {
+        if (std::strcmp(name, PRIMITIVE_TYPE_SELECT[prim_idx].name_) == 0) {
+            return &PRIMITIVE_TYPE_SELECT[prim_idx];
+        }
+    }
+    return nullptr;
+}
+
+//----------------------------------------------------------------------
+//  プリミティブノード取得
+//  メッシュノードの子のうち三角形にできるものを文書順にたどる
+//  previous が nullptr なら最初のもの
+const xml::XMLElement* nextPrimitiveNode(
+    const xml::XMLElement* mesh_node,
+    const xml::XMLElement* previous
+) {
+    const xml::XMLElement* element = previous ? previous->NextSiblingElement() : mesh_node->FirstChildElement();
+    while (element && !findPrimitiveSelector(element)) {
+        element = element->NextSiblingElement();
+    }
+    return element;
+}
+
+//----------------------------------------------------------------------
+//  プリミティブタイプ取得
+tc::ColladaMesh::PrimitiveType getPrimitiveType(
+    const xml::XMLElement* primitive_node
+) {
+    const PrimitiveSelector* selector = primitive_node ? findPrimitiveSelector(primitive_node) : nullptr;
+    return selector ? selector->type_ : tc::ColladaMesh::UNKNOWN_TYPE;
+}
+
+
+//======================================================================
+//  4x4行列
+//  列優先(m[列 * 4 + 行])で、列ベクトルに左から掛ける
+
+//----------------------------------------------------------------------
+//  単位行列
+void setIdentityMatrix(
+    float* m
+) {
+    for (int i = 0; i < 16; ++i) {
+        m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+}
+
+//----------------------------------------------------------------------
+//  out = a * b
+//  a の列を先にレジスタに読み、b は列ごとに読んでから書くので out は a、b のどちらと同じでもよい
+void multiplyMatrix(
+    const float* a,
+    const float* b,
+    float* out
+) {
+#if TINY_COLLADA_USE_SSE2
+    const __m128 a0 = _mm_loadu_ps(a);
+    const __m128 a1 = _mm_loadu_ps(a + 4);
+    const __m128 a2 = _mm_loadu_ps(a + 8);
+    const __m128 a3 = _mm_loadu_ps(a + 12);
+    for (int col = 0; col < 4; ++col) {
+        const float* bc = b + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(out + col * 4, r);
+    }
+#elif TINY_COLLADA_USE_NEON
+    const float32x4_t a0 = vld1q_f32(a);
+    const float32x4_t a1 = vld1q_f32(a + 4);
+    const float32x4_t a2 = vld1q_f32(a + 8);
+    const float32x4_t a3 = vld1q_f32(a + 12);
+    for (int col = 0; col < 4; ++col) {
+        const float32x4_t bc = vld1q_f32(b + col * 4);
+        float32x4_t r = vmulq_laneq_f32(a0, bc, 0);
+        r = vfmaq_laneq_f32(r, a1, bc, 1);
+        r = vfmaq_laneq_f32(r, a2, bc, 2);
+        r = vfmaq_laneq_f32(r, a3, bc, 3);
+        vst1q_f32(out + col * 4, r);
+    }
+#else
+    float result[16];
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            result[col * 4 + row] = a[row] * b[col * 4]
+                + a[4 + row] * b[col * 4 + 1]
+                + a[8 + row] * b[col * 4 + 2]
+                + a[12 + row] * b[col * 4 + 3];
+        }
+    }
+    std::memcpy(out, result, sizeof(result));
+#endif
+}
+
+//----------------------------------------------------------------------
+//  ベクトル演算(lookat 用)
+void normalizeVector(
+    float* v
+) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+void crossVector(
+    const float* a,
+    const float* b,
+    float* out
+) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//----------------------------------------------------------------------
+//  ベクトル列の一括変換
+//  data から stride(float数)おきに並んだ (x, y, z) を m で変換して上書きする
+//  point が true なら位置(平行移動を含める)、false なら方向
+//  各要素は3要素しかないことがあるので、読み書きは3要素だけ行う
+void transformVectors(
+    const float* m,
+    bool point,
+    float* data,
+    size_t count,
+    size_t stride
+) {
+#if TINY_COLLADA_USE_SSE2
+    const __m128 c0 = _mm_loadu_ps(m);
+    const __m128 c1 = _mm_loadu_ps(m + 4);
+    const __m128 c2 = _mm_loadu_ps(m + 8);
+    const __m128 c3 = point ? _mm_loadu_ps(m + 12) : _mm_setzero_ps();
+    for (size_t i = 0; i < count; ++i) {
+        float* v = data + i * stride;
+        __m128 r = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(v[0])));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+        _mm_storel_pi(reinterpret_cast<__m64*>(v), r);
+        _mm_store_ss(v + 2, _mm_movehl_ps(r, r));
+    }
+#elif TINY_COLLADA_USE_NEON
+    const float32x4_t c0 = vld1q_f32(m);
+    const float32x4_t c1 = vld1q_f32(m + 4);
+    const float32x4_t c2 = vld1q_f32(m + 8);
+    const float32x4_t c3 = point ? vld1q_f32(m + 12) : vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        float* v = data + i * stride;
+        float32x4_t r = vfmaq_n_f32(c3, c0, v[0]);
+        r = vfmaq_n_f32(r, c1, v[1]);
+        r = vfmaq_n_f32(r, c2, v[2]);
+        vst1_f32(v, vget_low_f32(r));
+        vst1q_lane_f32(v + 2, r, 2);
+    }
+#else
+    const float w = point ? 1.0f : 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        float* v = data + i * stride;
+        const float x = v[0];
+        const float y = v[1];
+        const float z = v[2];
+        v[0] = m[0] * x + m[4] * y + m[8] * z + m[12] * w;
+        v[1] = m[1] * x + m[5] * y + m[9] * z + m[13] * w;
+        v[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+//  左上3x3の行列式が負(鏡像)か
+//  鏡像で変換した三角形は表裏が逆になる
+bool isMirrorMatrix(
+    const float* m
+) {
+    float cross[3];
+    crossVector(m + 4, m + 8, cross);
+    return m[0] * cross[0] + m[1] * cross[1] + m[2] * cross[2] < 0.0f;
+}
+
+//----------------------------------------------------------------------
+//  法線の一括変換
+//  左上3x3の逆転置行列(余因子行列 / 行列式)で変換して正規化する
+//  正規化するので行列式では割らず、符号だけ掛ける
+void transformNormals(
+    const float* m,
+    float* data,
+    size_t count,
+    size_t stride
+) {
+    float normal_matrix[16] = {};
+    crossVector(m + 4, m + 8, normal_matrix);
+    crossVector(m + 8, m, normal_matrix + 4);
+    crossVector(m, m + 4, normal_matrix + 8);
+    const float det = m[0] * normal_matrix[0] + m[1] * normal_matrix[1] + m[2] * normal_matrix[2];
+    if (det < 0.0f) {
+        for (int i = 0; i < 12; ++i) {
+            normal_matrix[i] = -normal_matrix[i];
+        }
+    }
+    transformVectors(normal_matrix, false, data, count, stride);
+    for (size_t i = 0; i < count; ++i) {
+        normalizeVector(data + i * stride);
+    }
+}
+
+//----------------------------------------------------------------------
+//  変換要素1つを行列にする
+//  変換要素でなければ false
+bool readTransformElement(
+    const xml::XMLElement* element,
+    float* m
+) {
+    const char* name = element->Name();
+    float v[16];
+    const char* text = element->GetText();
+    size_t count = 0;
+    if (text) {
+        count = readNumbersInto(text, text + std::strlen(text), v, 16, std::true_type());
+    }
+
+    setIdentityMatrix(m);
+    if (std::strcmp(name, "matrix") == 0) {
+        //  <matrix> は行優先
+        if (count == 16) {
+            for (int row = 0; row < 4; ++row) {
+                for (int col = 0; col < 4; ++col) {
+                    m[col * 4 + row] = v[row * 4 + col];
+                }
+            }
+        }
+    }
+    else if (std::strcmp(name, "translate") == 0) {
+        if (count == 3) {
+            m[12] = v[0];
+            m[13] = v[1];
+            m[14] = v[2];
+        }
+    }
+    else if (std::strcmp(name, "scale") == 0) {
+        if (count == 3) {
+            m[0] = v[0];
+            m[5] = v[1];
+            m[10] = v[2];
+        }
+    }
+    else if (std::strcmp(name, "rotate") == 0) {
+        //  軸 (x, y, z) まわりに角度(度)だけ回す
+        if (count == 4) {
+            normalizeVector(v);
+            const float angle = v[3] * 3.14159265358979f / 180.0f;
+            const float c = std::cos(angle);
+            const float s = std::sin(angle);
+            const float t = 1.0f - c;
+            const float x = v[0];
+            const float y = v[1];
+            const float z = v[2];
+            m[0] = t * x * x + c;
+            m[1] = t * x * y + s * z;
+            m[2] = t * x * z - s * y;
+            m[4] = t * x * y - s * z;
+            m[5] = t * y * y + c;
+            m[6] = t * y * z + s * x;
+            m[8] = t * x * z + s * y;
+            m[9] = t * y * z - s * x;
+            m[10] = t * z * z + c;
+        }
+    }
+    else if (std::strcmp(name, "lookat") == 0) {
+        //  eye(3) interest(3) up(3)
+        //  eye に置いて -z を interest に向ける
+        if (count == 9) {
+            float forward[3] = {v[3] - v[0], v[4] - v[1], v[5] - v[2]};
+            float right[3];
+            float up[3];
+            normalizeVector(forward);
+            crossVector(forward, v + 6, right);
+            normalizeVector(right);
+            crossVector(right, forward, up);
+            for (int i = 0; i < 3; ++i) {
+                m[i] = right[i];
+                m[4 + i] = up[i];
+                m[8 + i] = -forward[i];
+                m[12 + i] = v[i];
+            }
+        }
+    }
+    else {
+        return false;
+    }
+    if (count == 0) {
+        TINY_COLLADA_LOG_WARNING("<%s> has no value. ignored.", name);
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------
+//  ノードのローカル行列
+//  変換要素を文書順に右から掛ける。変換要素が無ければ単位行列
+void readNodeTransform(
+    const xml::XMLElement* node,
+    float* m
+) {
+    setIdentityMatrix(m);
+    float transform[16];
+    for (const xml::XMLElement* child = node->FirstChildElement(); child; child = child->NextSiblingElement()) {
+        if (readTransformElement(child, transform)) {
+            multiplyMatrix(m, transform, m);
+        }
+    }
+}
+
+
+//----------------------------------------------------------------------
+//  visual scene読み込み
+//  <node> の木を文書順(親が先)にたどって nodes に追加し、
+//  <instance_geometry> ごとにシーンの元になるデータを作る
+//  深い木でもスタックを使わないよう、親をたどって巡回する
+void collectVisualSceneNode(
+    VisualScenes& out,
+    tc::ColladaNodes& nodes,
+    const xml::XMLElement* visual_scene_root,
+    const ParseArenas& arenas
+) {
+    std::vector<uint32_t> ancestors;
+    const xml::XMLElement* visual_scene = firstChildElement(visual_scene_root, "visual_scene");
+    while (visual_scene) {
+        uint32_t parent = tc::ColladaNodes::NO_INDEX;
+        const xml::XMLElement* visual_scene_node = firstChildElement(visual_scene, "node");
+        while (visual_scene_node) {
+            //  ノード登録
+            const uint32_t node_index = static_cast<uint32_t>(nodes.size());
+            const char* id = getElementAttribute(visual_scene_node, ID_ATTR_NAME);
+            nodes.parents_.push_back(parent);
+            nodes.ids_.push_back(id ? id : "");
+            nodes.local_matrices_.resize(nodes.local_matrices_.size() + 16);
+            readNodeTransform(visual_scene_node, &nodes.local_matrices_[node_index * 16]);
+
+            //  ジオメトリ
+            const xml::XMLElement* instance_geometry = firstChildElement(visual_scene_node, "instance_geometry");
+            while (instance_geometry) {
+                std::shared_ptr<VisualSceneData> vs = allocateShared<VisualSceneData>(arenas.scratch_);
+                vs->type_ = VisualSceneData::TYPE_GEOMETRY;
+                vs->node_ = node_index;
+                vs->url_ = arenas.strings_->internUrl(
+                    getElementAttribute(instance_geometry, "url")
+                );
+
+                //  マテリアル取得
+                //  サブメッシュごとに symbol で引くので全て覚えておく
+                const xml::XMLElement* bind_material = firstChildElement(
+                    instance_geometry,
+                    "bind_material"
+                );
+                const xml::XMLElement* technique_common = bind_material ? firstChildElement(
+                    bind_material,
+                    "technique_common"
+                ) : nullptr;
+                const xml::XMLElement* instance_material = technique_common ? firstChildElement(
+                    technique_common,
+                    "instance_material"
+                ) : nullptr;
+                while (instance_material) {
+                    VisualSceneData::BindMaterial bind;
+                    bind.symbol_ = arenas.strings_->intern(getElementAttribute(instance_material, "symbol"));
+                    bind.target_ = arenas.strings_->internUrl(getElementAttribute(instance_material, "target"));
+                    vs->bind_materials_.push_back(bind);
+                    instance_material = instance_material->NextSiblingElement("instance_material");
+                }
+                out.push_back(vs);
+                instance_geometry = instance_geometry->NextSiblingElement("instance_geometry");
+            }
+
+            //  子があれば子へ
+            const xml::XMLElement* child = visual_scene_node->FirstChildElement("node");
+            if (child) {
+                ancestors.push_back(parent);
+                parent = node_index;
+                visual_scene_node = child;
+                continue;
+            }
+
+            //  無ければ兄弟へ。兄弟も無ければ親に戻って親の兄弟へ
+            while (visual_scene_node) {
+                const xml::XMLElement* sibling = visual_scene_node->NextSiblingElement("node");
+                if (sibling) {
+                    visual_scene_node = sibling;
+                    break;
+                }
+                if (ancestors.empty()) {
+                    visual_scene_node = nullptr;
+                    break;
+                }
+                visual_scene_node = visual_scene_node->Parent()->ToElement();
+                parent = ancestors.back();
+                ancestors.pop_back();
+            }
+        }
+        visual_scene = visual_scene->NextSiblingElement("visual_scene");
+    }
+}
+
+
+//----------------------------------------------------------------------
+//  マテリアルノード読み込み
+void collectMaterialNode(
+    Materials& out,
+    const xml::XMLElement* library_materials,
+    const ParseArenas& arenas
+) {
+    const xml::XMLElement* material = firstChildElement(library_materials, "material");
+
+    while (material) {
+        const xml::XMLElement* instance_effect = firstChildElement(material, "instance_effect");
+        std::shared_ptr<MaterialData> md = allocateShared<MaterialData>(arenas.scratch_);
+        md->id_ = arenas.strings_->intern(getElementAttribute(material, "id"));
+        while (instance_effect) {
+            md->url_ = arenas.strings_->internUrl(getElementAttribute(instance_effect, "url"));
+            instance_effect = instance_effect->NextSiblingElement("instance_effect");
+        }
+        
+        out.push_back(md);
+        material = material->NextSiblingElement("material");
+    }
+}
+
+
+//----------------------------------------------------------------------
+//  materialノード読み込み
+void parseEffect(
+    std::shared_ptr<tc::ColladaMaterial>& material,
+    const xml::XMLElement* shading
+) {
+    //  エミッション
+    const xml::XMLElement* emission = firstChildElement(shading, "emission");
+    if (emission) {
+        const xml::XMLElement* color = firstChildElement(emission, "color");
+        if (color) {
+            const char* text = color->GetText();
+            readArray(text, &material->emission_);
+        }
+    }
+    //  アンビエント
+    const xml::XMLElement* ambient = firstChildElement(shading, "ambient");
+    if (ambient) {
+        const xml::XMLElement* color = firstChildElement(ambient, "color");
+        if (color) {
+            const char* text = color->GetText();
+            readArray(text, &material->ambient_);
+        }
+    }
+
+    //  ディフューズ
+    const xml::XMLElement* diffuse = firstChildElement(shading, "diffuse");
+    if (diffuse) {
+        const xml::XMLElement* color = firstChildElement(diffuse, "color");
+        if (color) {
+            const char* text = color->GetText();
+            readArray(text, &material->diffuse_);
+        }
+    }
+
+    //  スペキュラ
+    const xml::XMLElement* specular = firstChildElement(shading, "specular");
+    if (specular) {
+        const xml::XMLElement* color = firstChildElement(specular, "color");
+        if (color) {
+            const char* text = color->GetText();
+            readArray(text, &material->specular_);
+        }
+    }
+
+    //  リフレクティブ
+    const xml::XMLElement* reflective = firstChildElement(shading, "reflective");
+    if (reflective) {
+        const xml::XMLElement* color = firstChildElement(reflective, "color");
+        if (color) {
+            const char* text = color->GetText();
+            readArray(text, &material->reflective_);
+        }
+    }
+    
+    
+    //  リフレクティビティ
+    const xml::XMLElement* reflectivity = firstChildElement(shading, "reflectivity");
+    if (reflectivity) {
+        const xml::XMLElement* data = firstChildElement(reflectivity, "float");
+        const char* val = data->GetText();
+
+        material->reflectivity_ = atof(val);
+    }
+
+    //  シャイネス
+    const xml::XMLElement* shininess = firstChildElement(shading, "shininess");
+    if (shininess) {
+        const xml::XMLElement* data = firstChildElement(shininess, "float");
+        const char* val = data->GetText();
+
+        material->shininess_ = atof(val);
+    }
+    
+    //  透明度
+    const xml::XMLElement* transparency = firstChildElement(shading, "transparency");
+    if (transparency) {
+        const xml::XMLElement* data = firstChildElement(transparency, "float");
+        const char* val = data->GetText();
+
+        material->transparency_ = atof(val);
+    }
+
+}
+
+
+//----------------------------------------------------------------------
+//  エフェクトノード読み込み
+void collectEffectNode(
+    Effects& out,
+    const xml::XMLElement* library_effects,
+    const ParseArenas& arenas
+) {
+
+    const xml::XMLElement* effect = firstChildElement(library_effects, "effect");
+
+    while (effect) {
+
+        std::shared_ptr<EffectData> ed = allocateShared<EffectData>(arenas.scratch_);
+        ed->setupEffectData(effect, arenas);
+        out.push_back(ed);
+        effect = effect->NextSiblingElement("effect");
+    }
+
+}
+
+
+//----------------------------------------------------------------------
+//  画像パス読み込み
+void collectImageNode(
+    Images& out,
+    const xml::XMLElement* library_images,
+    const ParseArenas& arenas
+) {
+    const xml::XMLElement* image = firstChildElement(library_images, "image");
+
+    while (image) {
+        //  ID取得
+        std::shared_ptr<ImageData> image_data = allocateShared<ImageData>(arenas.scratch_);
+        image_data->id_ = arenas.strings_->intern(getElementAttribute(image, "id"));
+
+
+        //  テクスチャパス取得
+        const xml::XMLElement* init_from = firstChildElement(image, "init_from");
+        image_data->init_from_ = arenas.strings_->intern(init_from->GetText());
+        
+
+        //  次へ
+        out.push_back(image_data);
+        image = image->NextSiblingElement("image");
+    }
+
+}
+
+
+//----------------------------------------------------------------------
+//  プリミティブの頂点1つあたりのインデックス数
+size_t getPrimitiveStride(
+    const xml::XMLElement* primitive_node
+) {
+    int max_offset = 0;
+    const xml::XMLElement* input = firstChildElement(primitive_node, INPUT_NODE_NAME);
+    while (input) {
+        int offset = 0;
+        input->QueryIntAttribute(OFFSET_ATTR_NAME, &offset);
+        if (offset > max_offset) {
+            max_offset = offset;
+        }
+        input = input->NextSiblingElement(INPUT_NODE_NAME);
+    }
+    return static_cast<size_t>(max_offset) + 1;
+}
+
+//----------------------------------------------------------------------
+//  p に含まれるはずのインデックス数
+//  triangles なら count * 3、polylist なら vcount の合計にinputのオフセット幅を掛けたもの
+//  分からなければ 0
+size_t getExpectedIndexCount(
+    const xml::XMLElement* primitive_node,
+    const tc::Indices& face_count
+) {
+    size_t corner_count = 0;
+    if (face_count.empty()) {
+        unsigned int count = 0;
+        if (primitive_node->QueryUnsignedAttribute(COUNT_ATTR_NAME, &count) != xml::XML_SUCCESS) {
+            return 0;
+        }
+        corner_count = static_cast<size_t>(count) * 3;
+    }
+    else {
+        for (size_t i = 0; i < face_count.size(); ++i) {
+            corner_count += face_count[i];
+        }
+    }
+    return corner_count * getPrimitiveStride(primitive_node);
+}
+
+//----------------------------------------------------------------------
+//  多角形1つ分のインデックスを追加して頂点数を返す
+//  頂点の組の途中で切れていたら切り捨てる
+uint32_t appendPolygonLoop(
+    const xml::XMLElement* loop_node,
+    tc::Indices& indices,
+    size_t stride,
+    const DecodeContext& context
+) {
+    const size_t before = indices.size();
+    readElementArray(loop_node, &indices, context, 0);
+    const size_t vertex_count = (indices.size() - before) / stride;
+    indices.resize(before + vertex_count * stride);
+    return static_cast<uint32_t>(vertex_count);
+}
+
+//----------------------------------------------------------------------
+//  polygons の読み込み
+//  <p> 1つが1面。<ph> は <p> が外周、続く <h> が穴
+void collectPolygons(
+    const xml::XMLElement* primitive_node,
+    MeshInformation& info,
+    const DecodeContext& context
+) {
+    const size_t stride = getPrimitiveStride(primitive_node);
+    const xml::XMLElement* child = primitive_node->FirstChildElement();
+    while (child) {
+        const char* name = child->Name();
+        if (std::strcmp(name, INDEX_NODE_NAME) == 0) {
+            info.face_count_.push_back(appendPolygonLoop(child, info.raw_indices_, stride, context));
+            info.face_holes_.push_back(0);
+        }
+        else if (std::strcmp(name, POLYGON_HOLE_NODE_NAME) == 0) {
+            const xml::XMLElement* outer = firstChildElement(child, INDEX_NODE_NAME);
+            if (outer) {
+                info.face_count_.push_back(appendPolygonLoop(outer, info.raw_indices_, stride, context));
+                uint32_t hole_count = 0;
+                const xml::XMLElement* hole = firstChildElement(child, HOLE_NODE_NAME);
+                while (hole) {
+                    info.hole_count_.push_back(appendPolygonLoop(hole, info.raw_indices_, stride, context));
+                    ++hole_count;
+                    hole = hole->NextSiblingElement(HOLE_NODE_NAME);
+                }
+                info.face_holes_.push_back(hole_count);
+            }
+        }
+        child = child->NextSiblingElement();
+    }
+}
+
+//----------------------------------------------------------------------
+//  インデックスと面の構成の読み込み
+//  triangles は face_count_ が空のまま、polylist は vcount、polygons は <p> ごとの頂点数が入る
+void collectIndices(
+    const xml::XMLElement* primitive_node,
+    MeshInformation& info,
+    const DecodeContext& context
+) {        
+    if (std::strcmp(primitive_node->Name(), POLYGONS_NODE_NAME) == 0) {
+        collectPolygons(primitive_node, info, context);
+    }
+    else {
+        const xml::XMLElement* vcount_node = firstChildElement(primitive_node, VCOUNT_NODE_NAME);
+        if (vcount_node) {
+            readElementArray(vcount_node, &info.face_count_, context, 0);
+        }
+        const xml::XMLElement* index_node = firstChildElement(primitive_node, INDEX_NODE_NAME);
+        if (index_node) {
+            readElementArray(
+                index_node,
+                &info.raw_indices_,
+                context,
+                getExpectedIndexCount(primitive_node, info.face_count_)
+            );
+        }
+    }
+    
+    TINY_COLLADA_LOG_DEBUG("Collect index size = %lu  face count size = %lu",
+        info.raw_indices_.size(),
+        info.face_count_.size()
+    );
+}
+
+
+
+//----------------------------------------------------------------------
+//  メッシュノードのソース情報を取得
+void collectMeshSources(
+    std::vector<SourceData>& out,
+    const xml::XMLElement* mesh,
+    const DecodeContext& context
+){
+    //  ソースノードを総なめして情報を保存
+    const xml::XMLElement* target = firstChildElement(mesh, SOURCE_NODE_NAME);
+    while (target) {
+        SourceData data;
+        //  ID保存
+        data.id_ = context.strings_->intern(getElementAttribute(target, ID_ATTR_NAME));
+        
+        //  配列データ保存
+        readSourceNode(target, &data, context);
+
+        //  コンテナに追加
+        out.push_back(data);
+        
+        //  次へ
+        target = target->NextSiblingElement(SOURCE_NODE_NAME);
+    }
+}
+
+//----------------------------------------------------------------------
+//  インプット情報を取得
+void collectInputNodeData(
+    std::vector<InputData>& out,
+    const xml::XMLElement* input_node,
+    StringTable& strings
+) {
+    while (input_node) {
+        InputData input;
+        //  sourceアトリビュートを取得
+        //  source_nameの先頭の#は取って登録する
+        input.source_ = strings.internUrl(getElementAttribute(input_node, SOURCE_NODE_NAME));
+        input.semantic_ = strings.intern(getElementAttribute(input_node, SEMANTIC_ATTR_NAME));
+        
+        //  offsetアトリビュートを取得
+        const char* attr_offset = getElementAttribute(input_node, OFFSET_ATTR_NAME);
+        int offset = 0;
+        if (attr_offset) {
+            offset = atoi(attr_offset);
+        }
+        input.offset_ = offset;
+
+
+        //  インプットノード保存
+        out.push_back(input);
+
+        //  次へ
+        input_node = input_node->NextSiblingElement(INPUT_NODE_NAME);
+    }
+ 
+}
+
+//----------------------------------------------------------------------
+//  インプット情報を取得
+//  プリミティブノードのものと、メッシュ共通の <vertices> のもの
+void collectMeshInputs(
+    std::vector<InputData>& out,
+    const xml::XMLElement* mesh,
+    const xml::XMLElement* primitive_node,
+    StringTable& strings
+){
+    const xml::XMLElement* prim_input_node = firstChildElement(primitive_node, INPUT_NODE_NAME);
+    collectInputNodeData(out, prim_input_node, strings);
+    
+    //  vertices_node
+    const xml::XMLElement* vertices =  firstChildElement(mesh, VERTICES_NODE_NAME);
+    const xml::XMLElement* vert_input_node = firstChildElement(vertices, INPUT_NODE_NAME);
+    collectInputNodeData(out, vert_input_node, strings);
+}
+
+//======================================================================
+//  ドキュメント全体のid索引
+//  ライブラリを1回なめて作り、以降の検索は全てここから引く
+struct DocumentIndex
+{
+    void build(
+        const xml::XMLElement* library_geometries,
+        const Materials& materials,
+        const Effects& effects,
+        const Images& images,
+        StringTable& strings
+    ) {
+        //  ジオメトリ
+        if (library_geometries) {
+            const xml::XMLElement* geometry = firstChildElement(
+                library_geometries,
+                GEOMETRY_NODE_NAME
+            );
+            while (geometry) {
+                geometries_.insert(strings.intern(getElementAttribute(geometry, ID_ATTR_NAME)), geometry);
+                geometry = geometry->NextSiblingElement(GEOMETRY_NODE_NAME);
+            }
+        }
+
+        //  マテリアル
+        for (size_t i = 0; i < materials.size(); ++i) {
+            materials_.insert(materials[i]->id_, materials[i].get());
+        }
+
+        //  エフェクト
+        for (size_t i = 0; i < effects.size(); ++i) {
+            effects_.insert(effects[i]->id_, effects[i].get());
+        }
+
+        //  イメージ
+        for (size_t i = 0; i < images.size(); ++i) {
+            images_.insert(images[i]->id_, images[i].get());
+        }
+    }
+
+    IdIndex<const xml::XMLElement*> geometries_;
+    IdIndex<const MaterialData*> materials_;
+    IdIndex<const EffectData*> effects_;
+    IdIndex<const ImageData*> images_;
+};
+
+
+//----------------------------------------------------------------------
+//  バインドされたマテリアルを探す
+std::shared_ptr<tc::ColladaMaterial> searchMaterial(
+    StringId bind_material,
+    const DocumentIndex& index
+) {
+    //  マテリアルを探す
+    const MaterialData* material = index.materials_.find(bind_material);
+    if (!material) {
+        //  指定マテリアルは存在しなかった
+        return nullptr;
+    }
+
+    //  エフェクトを探す
+    const EffectData* effect = index.effects_.find(material->url_);
+    if (!effect) {
+        return nullptr;
+    }
+    return effect->material_;
+}
+
+
+
+//======================================================================
+//  多角形の三角形分割
+//  凸多角形は扇形に、凹多角形と穴あき多角形は耳切り法で分割する
+//  判定は位置を面の法線の主軸に沿って2次元に投影して行う
+//  出力は三角形の頂点ごとの <p> 上の位置で、面の巻き順を保つ
+class PolygonTriangulator
+{
+public:
+    PolygonTriangulator(
+        const MeshInformation& info,
+        const SourceData* position
+    )   : raw_(info.raw_indices_)
+        , stride_(info.getIndexStride())
+        , position_(position && position->input_ && position->stride_ >= 2 ? position : nullptr)
+        , points_()
+        , hole_points_()
+        , merged_()
+        , prev_()
+        , next_()
+        , axis_u_(0)
+        , axis_v_(1)
+        , sign_(1.0f)
+    {}
+
+    PolygonTriangulator& operator=(const PolygonTriangulator&) = delete;	// コピーの禁止
+    PolygonTriangulator(const PolygonTriangulator&) = delete;
+
+public:
+    //----------------------------------------------------------------------
+    //  1面を分割して out に書き込み、書き込んだ数を返す
+    //  at は面の <p> 上の位置、holes は穴ごとの頂点数
+    //  out には (全頂点数 - 2 + 穴の数 * 2) * 3 の空きがあること
+    size_t triangulate(
+        size_t at,
+        uint32_t vertex_count,
+        const uint32_t* holes,
+        uint32_t hole_count,
+        uint32_t* out
+    ) {
+        if (vertex_count == 3 && hole_count == 0) {
+            return writeFan(at, vertex_count, out);
+        }
+        if (!position_ || !setupProjection(at, vertex_count)) {
+            return writeFan(at, vertex_count, out);
+        }
+        loadLoop(at, vertex_count, points_);
+        if (hole_count == 0 && isConvex(points_)) {
+            return writeFan(at, vertex_count, out);
+        }
+
+        //  穴を外周につないで1つの多角形にする
+        merged_ = points_;
+        if (hole_count > 0) {
+            size_t hole_at = at + vertex_count * stride_;
+            hole_points_.resize(hole_count);
+            for (uint32_t i = 0; i < hole_count; ++i) {
+                loadLoop(hole_at, holes[i], hole_points_[i]);
+                hole_at += holes[i] * stride_;
+                //  穴は外周と逆回りにそろえる
+                if (signedArea(hole_points_[i]) * sign_ > 0.0f) {
+                    std::reverse(hole_points_[i].begin(), hole_points_[i].end());
+                }
+            }
+            bridgeHoles(hole_count);
+        }
+        return clipEars(out);
+    }
+
+private:
+    struct Point
+    {
+        float x_;
+        float y_;
+        uint32_t corner_;       //  <p> 上の位置
+    };
+    using Points = std::vector<Point>;
+
+    //----------------------------------------------------------------------
+    //  扇形に分割
+    size_t writeFan(
+        size_t at,
+        uint32_t vertex_count,
+        uint32_t* out
+    ) const {
+        size_t written = 0;
+        for (uint32_t v = 2; v < vertex_count; ++v) {
+            out[written++] = static_cast<uint32_t>(at);
+            out[written++] = static_cast<uint32_t>(at + (v - 1) * stride_);
+            out[written++] = static_cast<uint32_t>(at + v * stride_);
+        }
+        return written;
+    }
+
+    //----------------------------------------------------------------------
+    //  頂点の位置取得
+    //  範囲外は原点
+    void getPosition(
+        size_t corner,
+        float* xyz
+    ) const {
+        xyz[0] = xyz[1] = xyz[2] = 0.0f;
+        size_t at = corner + position_->input_->offset_;
+        if (at >= raw_.size()) {
+            return;
+        }
+        const size_t components = position_->stride_ < 3 ? position_->stride_ : 3;
+        const size_t from = static_cast<size_t>(raw_[at]) * position_->stride_;
+        if (from + components > position_->data_.size()) {
+            return;
+        }
+        for (size_t k = 0; k < components; ++k) {
+            xyz[k] = position_->data_[from + k];
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  投影面の決定
+    //  外周の法線(Newell法)の最大成分の軸を落とす。面積が無ければ false
+    bool setupProjection(
+        size_t at,
+        uint32_t vertex_count
+    ) {
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        float prev[3];
+        getPosition(at + (vertex_count - 1) * stride_, prev);
+        for (uint32_t i = 0; i < vertex_count; ++i) {
+            float cur[3];
+            getPosition(at + i * stride_, cur);
+            normal[0] += (prev[1] - cur[1]) * (prev[2] + cur[2]);
+            normal[1] += (prev[2] - cur[2]) * (prev[0] + cur[0]);
+            normal[2] += (prev[0] - cur[0]) * (prev[1] + cur[1]);
+            prev[0] = cur[0];
+            prev[1] = cur[1];
+            prev[2] = cur[2];
+        }
+        const float ax = std::fabs(normal[0]);
+        const float ay = std::fabs(normal[1]);
+        const float az = std::fabs(normal[2]);
+        if (ax == 0.0f && ay == 0.0f && az == 0.0f) {
+            return false;
+        }
+        int drop = 2;
+        if (ax >= ay && ax >= az) {
+            drop = 0;
+        }
+        else if (ay >= az) {
+            drop = 1;
+        }
+        axis_u_ = (drop + 1) % 3;
+        axis_v_ = (drop + 2) % 3;
+        //  投影後に反時計回りなら正
+        sign_ = normal[drop] >= 0.0f ? 1.0f : -1.0f;
+        return true;
+    }
+
+    //----------------------------------------------------------------------
+    //  1周分を投影して読み込む
+    void loadLoop(
+        size_t at,
+        uint32_t vertex_count,
+        Points& out
+    ) const {
+        out.resize(vertex_count);
+        for (uint32_t i = 0; i < vertex_count; ++i) {
+            float xyz[3];
+            size_t corner = at + i * stride_;
+            getPosition(corner, xyz);
+            out[i].x_ = xyz[axis_u_];
+            out[i].y_ = xyz[axis_v_];
+            out[i].corner_ = static_cast<uint32_t>(corner);
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  幾何計算
+    static float cross(
+        const Point& a,
+        const Point& b,
+        const Point& c
+    ) {
+        return (b.x_ - a.x_) * (c.y_ - a.y_) - (b.y_ - a.y_) * (c.x_ - a.x_);
+    }
+
+    static float signedArea(
+        const Points& points
+    ) {
+        float area = 0.0f;
+        for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+            area += points[j].x_ * points[i].y_ - points[i].x_ * points[j].y_;
+        }
+        return area * 0.5f;
+    }
+
+    static bool isSamePosition(
+        const Point& a,
+        const Point& b
+    ) {
+        return a.x_ == b.x_ && a.y_ == b.y_;
+    }
+
+    //  線分 ab と cd が端点以外で交差するか
+    static bool isCrossing(
+        const Point& a,
+        const Point& b,
+        const Point& c,
+        const Point& d
+    ) {
+        const float d1 = cross(a, b, c);
+        const float d2 = cross(a, b, d);
+        const float d3 = cross(c, d, a);
+        const float d4 = cross(c, d, b);
+        return ((d1 > 0.0f && d2 < 0.0f) || (d1 < 0.0f && d2 > 0.0f))
+            && ((d3 > 0.0f && d4 < 0.0f) || (d3 < 0.0f && d4 > 0.0f));
+    }
+
+    //----------------------------------------------------------------------
+    //  凸判定(同一直線上の頂点は許す)
+    bool isConvex(
+        const Points& points
+    ) const {
+        const size_t count = points.size();
+        for (size_t i = 0; i < count; ++i) {
+            const Point& a = points[(i + count - 1) % count];
+            const Point& b = points[i];
+            const Point& c = points[(i + 1) % count];
+            if (cross(a, b, c) * sign_ < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //----------------------------------------------------------------------
+    //  線分が多角形の辺と交差するか
+    static bool crossesLoop(
+        const Point& a,
+        const Point& b,
+        const Points& loop
+    ) {
+        for (size_t i = 0, j = loop.size() - 1; i < loop.size(); j = i++) {
+            if (isCrossing(a, b, loop[j], loop[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //----------------------------------------------------------------------
+    //  穴を外周につなぐ
+    //  右端(投影後のx最大)が右にある穴から順に、穴の右端の頂点と見える外周の頂点を
+    //  往復の辺で結んで1周の多角形にする
+    void bridgeHoles(
+        uint32_t hole_count
+    ) {
+        std::vector<std::pair<float, uint32_t>> order(hole_count);
+        for (uint32_t i = 0; i < hole_count; ++i) {
+            float max_x = -std::numeric_limits<float>::max();
+            for (size_t k = 0; k < hole_points_[i].size(); ++k) {
+                max_x = std::max(max_x, hole_points_[i][k].x_);
+            }
+            order[i] = std::make_pair(-max_x, i);
+        }
+        std::sort(order.begin(), order.end());
+
+        for (uint32_t n = 0; n < hole_count; ++n) {
+            const Points& hole = hole_points_[order[n].second];
+            if (hole.empty()) {
+                continue;
+            }
+            size_t hole_idx = 0;
+            for (size_t k = 1; k < hole.size(); ++k) {
+                if (hole[k].x_ > hole[hole_idx].x_) {
+                    hole_idx = k;
+                }
+            }
+            const Point& from = hole[hole_idx];
+
+            //  近い順に、どの辺とも交差しない頂点を探す
+            size_t best = 0;
+            float best_distance = std::numeric_limits<float>::max();
+            bool best_visible = false;
+            for (size_t k = 0; k < merged_.size(); ++k) {
+                const float dx = merged_[k].x_ - from.x_;
+                const float dy = merged_[k].y_ - from.y_;
+                const float distance = dx * dx + dy * dy;
+                if (best_visible && distance >= best_distance) {
+                    continue;
+                }
+                bool visible = !crossesLoop(from, merged_[k], merged_);
+                for (uint32_t m = n; visible && m < hole_count; ++m) {
+                    visible = !crossesLoop(from, merged_[k], hole_points_[order[m].second]);
+                }
+                if ((visible && !best_visible) || (visible == best_visible && distance < best_distance)) {
+                    best = k;
+                    best_distance = distance;
+                    best_visible = visible;
+                }
+            }
+
+            //  外周[best] -> 穴[hole_idx] -> 穴を1周 -> 穴[hole_idx] -> 外周[best]
+            Points bridge;
+            bridge.reserve(hole.size() + 2);
+            for (size_t k = 0; k <= hole.size(); ++k) {
+                bridge.push_back(hole[(hole_idx + k) % hole.size()]);
+            }
+            bridge.push_back(merged_[best]);
+            merged_.insert(merged_.begin() + best + 1, bridge.begin(), bridge.end());
+        }
+    }
+
+    //----------------------------------------------------------------------
+    //  耳切り
+    //  耳が見つからない(自己交差など)ときも頂点を1つ切って、三角形の数は必ず頂点数 - 2 にする
+    size_t clipEars(
+        uint32_t* out
+    ) {
+        const size_t count = merged_.size();
+        prev_.resize(count);
+        next_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            prev_[i] = static_cast<uint32_t>((i + count - 1) % count);
+            next_[i] = static_cast<uint32_t>((i + 1) % count);
+        }
+
+        size_t written = 0;
+        size_t remaining = count;
+        uint32_t current = 0;
+        size_t misses = 0;
+        while (remaining > 3) {
+            if (misses < remaining && !isEar(current)) {
+                current = next_[current];
+                ++misses;
+                continue;
+            }
+            written += writeTriangle(prev_[current], current, next_[current], out + written);
+            next_[prev_[current]] = next_[current];
+            prev_[next_[current]] = prev_[current];
+            current = prev_[current];
+            --remaining;
+            misses = 0;
+        }
+        written += writeTriangle(prev_[current], current, next_[current], out + written);
+        return written;
+    }
+
+    size_t writeTriangle(
+        uint32_t a,
+        uint32_t b,
+        uint32_t c,
+        uint32_t* out
+    ) const {
+        out[0] = merged_[a].corner_;
+        out[1] = merged_[b].corner_;
+        out[2] = merged_[c].corner_;
+        return 3;
+    }
+
+    //----------------------------------------------------------------------
+    //  耳判定
+    //  凸で、他の凹頂点が三角形の中に無ければ耳
+    bool isEar(
+        uint32_t current
+    ) const {
+        const Point& a = merged_[prev_[current]];
+        const Point& b = merged_[current];
+        const Point& c = merged_[next_[current]];
+        if (cross(a, b, c) * sign_ <= 0.0f) {
+            return false;
+        }
+        for (uint32_t i = next_[next_[current]]; i != prev_[current]; i = next_[i]) {
+            const Point& p = merged_[i];
+            if (isSamePosition(p, a) || isSamePosition(p, b) || isSamePosition(p, c)) {
+                continue;
+            }
+            if (cross(merged_[prev_[i]], p, merged_[next_[i]]) * sign_ > 0.0f) {
+                continue;
+            }
+            if (cross(a, b, p) * sign_ >= 0.0f
+                && cross(b, c, p) * sign_ >= 0.0f
+                && cross(c, a, p) * sign_ >= 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    const tc::Indices& raw_;
+    const size_t stride_;
+    const SourceData* position_;
+    Points points_;
+    std::vector<Points> hole_points_;
+    Points merged_;
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    int axis_u_;
+    int axis_v_;
+    float sign_;
+};
+
+//----------------------------------------------------------------------
+//  メッシュの全ての面を三角形に分割して info.corners_ に入れる
+//  面ごとの頂点数から三角形の数を先に数えて出力を確保し、1回の走査で書き込む
+//  triangles は分割不要なので何もしない
+void triangulatePolygons(
+    MeshInformation& info
+) {
+    const size_t stride = info.getIndexStride();
+    const tc::Indices& raw = info.raw_indices_;
+    tc::Indices& out = info.corners_;
+    out.clear();
+    if (info.face_count_.empty()) {
+        return;
+    }
+
+    const tc::Indices& face_count = info.face_count_;
+    const bool has_holes = !info.face_holes_.empty();
+    size_t corner_count = 0;
+    size_t hole_idx = 0;
+    for (size_t face = 0; face < face_count.size(); ++face) {
+        size_t vertex_count = face_count[face];
+        const uint32_t holes = has_holes ? info.face_holes_[face] : 0;
+        for (uint32_t h = 0; h < holes && hole_idx < info.hole_count_.size(); ++h) {
+            vertex_count += info.hole_count_[hole_idx++] + 2;
+        }
+        if (face_count[face] >= 3) {
+            corner_count += (vertex_count - 2) * 3;
+        }
+    }
+    out.resize(corner_count);
+
+    PolygonTriangulator triangulator(info, info.searchSourceBySemantic(STRING_POSITION));
+    size_t written = 0;
+    size_t at = 0;
+    hole_idx = 0;
+    for (size_t face = 0; face < face_count.size(); ++face) {
+        const uint32_t vertex_count = face_count[face];
+        uint32_t holes = has_holes ? info.face_holes_[face] : 0;
+        if (hole_idx + holes > info.hole_count_.size()) {
+            holes = static_cast<uint32_t>(info.hole_count_.size() - hole_idx);
+        }
+        size_t loop_size = vertex_count;
+        for (uint32_t h = 0; h < holes; ++h) {
+            loop_size += info.hole_count_[hole_idx + h];
+        }
+        //  <p> が足りなければそこで打ち切る
+        if (at + loop_size * stride > raw.size()) {
+            TINY_COLLADA_LOG_WARNING("polygon %lu exceeds index data. truncated.", face);
+            break;
+        }
+        if (vertex_count >= 3) {
+            written += triangulator.triangulate(
+                at,
+                vertex_count,
+                holes > 0 ? &info.hole_count_[hole_idx] : nullptr,
+                holes,
+                &out[written]
+            );
+        }
+        at += loop_size * stride;
+        hole_idx += holes;
+    }
+    out.resize(written);
+}
+
+
+#if TINY_COLLADA_USE_SSE2
+//----------------------------------------------------------------------
+//  インデックス4つ分の読み書き
+//  並べ替えに shufps を使うので float として扱う(値は変わらない)
+inline __m128 loadIndices4(
+    const uint32_t* src
+) {
+    return _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+}
+
+inline void storeIndices4(
+    uint32_t* dst,
+    size_t at,
+    __m128 v
+) {
+    if (dst) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + at), _mm_castps_si128(v));
+    }
+}
+#elif TINY_COLLADA_USE_NEON
+inline void storeIndices4(
+    uint32_t* dst,
+    size_t at,
+    uint32x4_t v
+) {
+    if (dst) {
+        vst1q_u32(dst + at, v);
+    }
+}
+#endif
+
+//----------------------------------------------------------------------
+//  頂点の組が stride 個ずつ並んだインデックス列を、オフセットごとの列に分ける
+//  dst[k] にオフセット k の値を vertex_count 個書き込む。nullptr のオフセットは捨てる
+//  stride 2/3/4 は4頂点ずつレジスタ内で並べ替える
+void deinterleaveIndices(
+    const uint32_t* src,
+    size_t vertex_count,
+    size_t stride,
+    uint32_t* const* dst
+) {
+    if (stride == 1) {
+        if (dst[0] && vertex_count > 0) {
+            std::memcpy(dst[0], src, vertex_count * sizeof(uint32_t));
+        }
+        return;
+    }
+
+    size_t i = 0;
+#if TINY_COLLADA_USE_SSE2
+    if (stride == 2) {
+        for (; i + 4 <= vertex_count; i += 4, src += 8) {
+            //  a = [0 1 0 1] b = [0 1 0 1]
+            __m128 a = loadIndices4(src);
+            __m128 b = loadIndices4(src + 4);
+            storeIndices4(dst[0], i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            storeIndices4(dst[1], i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+    else if (stride == 3) {
+        for (; i + 4 <= vertex_count; i += 4, src += 12) {
+            //  a = [0 1 2 0] b = [1 2 0 1] c = [2 0 1 2]
+            __m128 a = loadIndices4(src);
+            __m128 b = loadIndices4(src + 4);
+            __m128 c = loadIndices4(src + 8);
+            __m128 x = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2));
+            __m128 y0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1));
+            __m128 y1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 2, 0, 3));
+            __m128 z0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 1, 0, 2));
+            __m128 z1 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 0, 0));
+            storeIndices4(dst[0], i, _mm_shuffle_ps(a, x, _MM_SHUFFLE(2, 0, 3, 0)));
+            storeIndices4(dst[1], i, _mm_shuffle_ps(y0, y1, _MM_SHUFFLE(2, 0, 2, 0)));
+            storeIndices4(dst[2], i, _mm_shuffle_ps(z0, z1, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+    }
+    else if (stride == 4) {
+        for (; i + 4 <= vertex_count; i += 4, src += 16) {
+            __m128 a = loadIndices4(src);
+            __m128 b = loadIndices4(src + 4);
+            __m128 c = loadIndices4(src + 8);
+            __m128 d = loadIndices4(src + 12);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            storeIndices4(dst[0], i, a);
+            storeIndices4(dst[1], i, b);
+            storeIndices4(dst[2], i, c);
+            storeIndices4(dst[3], i, d);
+        }
+    }
+#elif TINY_COLLADA_USE_NEON
+    if (stride == 2) {
+        for (; i + 4 <= vertex_count; i += 4, src += 8) {
+            uint32x4x2_t v = vld2q_u32(src);
+            storeIndices4(dst[0], i, v.val[0]);
+            storeIndices4(dst[1], i, v.val[1]);
+        }
+    }
+    else if (stride == 3) {
+        for (; i + 4 <= vertex_count; i += 4, src += 12) {
+            uint32x4x3_t v = vld3q_u32(src);
+            storeIndices4(dst[0], i, v.val[0]);
+            storeIndices4(dst[1], i, v.val[1]);
+            storeIndices4(dst[2], i, v.val[2]);
+        }
+    }
+    else if (stride == 4) {
+        for (; i + 4 <= vertex_count; i += 4, src += 16) {
+            uint32x4x4_t v = vld4q_u32(src);
+            storeIndices4(dst[0], i, v.val[0]);
+            storeIndices4(dst[1], i, v.val[1]);
+            storeIndices4(dst[2], i, v.val[2]);
+            storeIndices4(dst[3], i, v.val[3]);
+        }
+    }
+#endif
+    //  残りとその他の stride
+    for (; i < vertex_count; ++i, src += stride) {
+        for (size_t k = 0; k < stride; ++k) {
+            if (dst[k]) {
+                dst[k][i] = src[k];
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+//  インデックス列の最大値(空なら 0)
+//  SSE2 には符号なし32bitの max が無いので、符号ビットを反転して符号付きで比べる
+uint32_t findMaxIndex(
+    const uint32_t* src,
+    size_t count
+) {
+    uint32_t result = 0;
+    size_t i = 0;
+#if TINY_COLLADA_USE_SSE2
+    if (count >= 8) {
+        const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+        __m128i max0 = bias;
+        __m128i max1 = bias;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bias);
+            __m128i v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4)), bias);
+            __m128i gt0 = _mm_cmpgt_epi32(v0, max0);
+            __m128i gt1 = _mm_cmpgt_epi32(v1, max1);
+            max0 = _mm_or_si128(_mm_and_si128(gt0, v0), _mm_andnot_si128(gt0, max0));
+            max1 = _mm_or_si128(_mm_and_si128(gt1, v1), _mm_andnot_si128(gt1, max1));
+        }
+        __m128i gt = _mm_cmpgt_epi32(max1, max0);
+        max0 = _mm_or_si128(_mm_and_si128(gt, max1), _mm_andnot_si128(gt, max0));
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_xor_si128(max0, bias));
+        result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    }
+#elif TINY_COLLADA_USE_NEON
+    if (count >= 8) {
+        uint32x4_t max0 = vdupq_n_u32(0);
+        uint32x4_t max1 = vdupq_n_u32(0);
+        for (; i + 8 <= count; i += 8) {
+            max0 = vmaxq_u32(max0, vld1q_u32(src + i));
+            max1 = vmaxq_u32(max1, vld1q_u32(src + i + 4));
+        }
+        result = vmaxvq_u32(vmaxq_u32(max0, max1));
+    }
+#endif
+    for (; i < count; ++i) {
+        result = std::max(result, src[i]);
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------
+//  三角形の頂点ごとの属性インデックスを、全属性まとめて1回の走査で展開する
+//  outs[i] の末尾に offsets[i] の値が三角形の頂点数ちょうど追加される
+//  triangles は <p> をそのまま分け、多角形は分割結果の corners_ から拾う
+void splitAttributeIndices(
+    const MeshInformation& info,
+    const int* offsets,
+    tc::Indices* const* outs,
+    int count
+) {
+    const size_t stride = info.getIndexStride();
+    const size_t corner_count = info.getCornerCount();
+
+    //  オフセットごとの書き込み先
+    //  同じオフセットを使う属性は最初の1つに書いて後で複写する
+    std::vector<uint32_t*> dst(stride, nullptr);
+    uint32_t* firsts[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    for (int i = 0; i < count; ++i) {
+        const size_t before = outs[i]->size();
+        outs[i]->resize(before + corner_count);
+        firsts[i] = outs[i]->data() + before;
+        const int offset = offsets[i];
+        if (corner_count > 0 && offset >= 0 && offset < static_cast<int>(stride) && !dst[offset]) {
+            dst[offset] = firsts[i];
+        }
+    }
+
+    const tc::Indices& raw = info.raw_indices_;
+    if (info.face_count_.empty()) {
+        deinterleaveIndices(raw.data(), corner_count, stride, dst.data());
+    }
+    else {
+        //  corners_ は <p> に収まる面からしか作られないので範囲内
+        const tc::Indices& corners = info.corners_;
+        for (size_t c = 0; c < corner_count; ++c) {
+            const uint32_t* src = &raw[corners[c]];
+            for (size_t k = 0; k < stride; ++k) {
+                if (dst[k]) {
+                    dst[k][c] = src[k];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const int offset = offsets[i];
+        if (offset < 0 || offset >= static_cast<int>(stride)) {
+            std::fill(firsts[i], firsts[i] + corner_count, 0);
+        }
+        else if (dst[offset] && dst[offset] != firsts[i]) {
+            std::copy(dst[offset], dst[offset] + corner_count, firsts[i]);
+        }
+    }
+}
+
+
+//======================================================================
+//  頂点キャッシュ最適化
+//  Tom Forsyth "Linear-Speed Vertex Cache Optimisation" の方式
+
+//  最適化で想定するキャッシュサイズ(LRU)
+const int FORSYTH_CACHE_SIZE = 32;
+
+//  効率計測で想定するキャッシュサイズ(FIFO)
+const uint32_t STATISTICS_CACHE_SIZE = 16;
+
+//  スコア計算の係数
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRI_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+const uint32_t FORSYTH_MAX_VALENCE = 64;
+
+//======================================================================
+//  頂点スコアの表
+struct ForsythScoreTable
+{
+    ForsythScoreTable() {
+        for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+            if (i < 3) {
+                cache_[i] = FORSYTH_LAST_TRI_SCORE;
+            }
+            else {
+                float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                cache_[i] = std::pow(1.0f - (i - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+            }
+        }
+        valence_[0] = 0.0f;
+        for (uint32_t i = 1; i < FORSYTH_MAX_VALENCE; ++i) {
+            valence_[i] = FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -FORSYTH_VALENCE_BOOST_POWER);
+        }
+    }
+
+    //  キャッシュ位置(-1はキャッシュ外)と残り三角形数から頂点スコアを求める
+    float score(
+        int cache_pos,
+        uint32_t remaining
+    ) const {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float s = cache_pos < 0 ? 0.0f : cache_[cache_pos];
+        if (remaining < FORSYTH_MAX_VALENCE) {
+            return s + valence_[remaining];
+        }
+        return s + FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -FORSYTH_VALENCE_BOOST_POWER);
+    }
+
+    float cache_[FORSYTH_CACHE_SIZE];
+    float valence_[FORSYTH_MAX_VALENCE];
+};
+
+//----------------------------------------------------------------------
+//  三角形リストとして扱えるか判定
+bool isValidTriangleList(
+    const tc::Indices& indices,
+    size_t vertex_count
+) {
+    if (indices.empty() || indices.size() % 3 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] >= vertex_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------
+//  キャッシュ効率計測
+tc::VertexCacheStatistics computeCacheStatistics(
+    const tc::Indices& indices,
+    size_t vertex_count
+) {
+    //  タイムスタンプ方式のFIFO
+    //  ミスした時だけ時刻を進めるので、直近 STATISTICS_CACHE_SIZE 回以内に入った頂点がヒットする
+    std::vector<uint32_t> timestamp(vertex_count, 0);
+    uint32_t time = STATISTICS_CACHE_SIZE + 1;
+    size_t misses = 0;
+    size_t used_vertices = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint32_t& stamp = timestamp[indices[i]];
+        if (stamp == 0) {
+            ++used_vertices;
+        }
+        if (time - stamp > STATISTICS_CACHE_SIZE) {
+            stamp = time++;
+            ++misses;
+        }
+    }
+
+    tc::VertexCacheStatistics statistics;
+    if (!indices.empty()) {
+        statistics.acmr_ = static_cast<float>(misses) / (indices.size() / 3);
+        statistics.atvr_ = static_cast<float>(misses) / used_vertices;
+    }
+    return statistics;
+}
+
+//----------------------------------------------------------------------
+//  三角形の並べ替え
+//  order には新しい並びでの元の三角形番号が入る
+void optimizeTriangleOrder(
+    tc::Indices& indices,
+    size_t vertex_count,
+    tc::Indices& order
+) {
+    static const ForsythScoreTable table;
+    const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    const size_t tri_count = indices.size() / 3;
+
+    //  頂点ごとの三角形一覧
+    //  [offsets[v], offsets[v] + remaining[v]) がまだ出力していない三角形
+    tc::Indices offsets(vertex_count + 1, 0);
+    tc::Indices remaining(vertex_count, 0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        ++remaining[indices[i]];
+    }
+    for (size_t v = 0; v < vertex_count; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    tc::Indices vertex_tris(indices.size());
+    {
+        tc::Indices fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            vertex_tris[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    //  初期スコア
+    std::vector<int> cache_pos(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        vertex_score[v] = table.score(-1, remaining[v]);
+    }
+    std::vector<float> tri_score(tri_count);
+    std::vector<char> emitted(tri_count, 0);
+    uint32_t best = 0;
+    for (size_t t = 0; t < tri_count; ++t) {
+        const uint32_t* tri = &indices[t * 3];
+        tri_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+        if (tri_score[t] > tri_score[best]) {
+            best = static_cast<uint32_t>(t);
+        }
+    }
+
+    tc::Indices output;
+    output.reserve(indices.size());
+    order.clear();
+    order.reserve(tri_count);
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t next_cache[FORSYTH_CACHE_SIZE + 3];
+    int cache_size = 0;
+    size_t scan = 0;
+    for (size_t n = 0; n < tri_count; ++n) {
+        //  候補がなければ未出力の三角形を先頭から探す
+        if (best == NONE) {
+            while (emitted[scan]) {
+                ++scan;
+            }
+            best = static_cast<uint32_t>(scan);
+        }
+
+        //  出力
+        const uint32_t* tri = &indices[best * 3];
+        emitted[best] = 1;
+        order.push_back(best);
+        output.insert(output.end(), tri, tri + 3);
+
+        //  頂点の未出力一覧から外す
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = tri[k];
+            uint32_t* list = &vertex_tris[offsets[v]];
+            uint32_t last = remaining[v] - 1;
+            for (uint32_t j = 0; j <= last; ++j) {
+                if (list[j] == best) {
+                    std::swap(list[j], list[last]);
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        //  キャッシュ更新(LRU)
+        int next_size = 0;
+        for (int k = 0; k < 3; ++k) {
+            next_cache[next_size++] = tri[k];
+        }
+        for (int i = 0; i < cache_size; ++i) {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                next_cache[next_size++] = v;
+            }
+        }
+
+        //  スコア更新
+        //  あふれた頂点もスコアが変わるので更新する
+        for (int i = 0; i < next_size; ++i) {
+            uint32_t v = next_cache[i];
+            cache_pos[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            vertex_score[v] = table.score(cache_pos[v], remaining[v]);
+        }
+        best = NONE;
+        float best_score = -1.0f;
+        for (int i = 0; i < next_size; ++i) {
+            uint32_t v = next_cache[i];
+            const uint32_t* list = &vertex_tris[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = list[j];
+                const uint32_t* t_idx = &indices[t * 3];
+                float score = vertex_score[t_idx[0]] + vertex_score[t_idx[1]] + vertex_score[t_idx[2]];
+                tri_score[t] = score;
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        cache_size = next_size < FORSYTH_CACHE_SIZE ? next_size : FORSYTH_CACHE_SIZE;
+        std::memcpy(cache, next_cache, cache_size * sizeof(uint32_t));
+    }
+
+    indices.swap(output);
+}
+
+//----------------------------------------------------------------------
+//  三角形単位の配列を order の順に並べ替える
+void reorderTriangles(
+    tc::Indices& corner_indices,
+    const tc::Indices& order
+) {
+    if (corner_indices.size() != order.size() * 3) {
+        return;
+    }
+    tc::Indices src;
+    src.swap(corner_indices);
+    corner_indices.reserve(src.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const uint32_t* tri = &src[order[i] * 3];
+        corner_indices.insert(corner_indices.end(), tri, tri + 3);
+    }
+}
+
+//----------------------------------------------------------------------
+//  頂点を初出順に並べ替える
+//  remap には元の頂点番号から新しい頂点番号への対応が入る
+//  使われていない頂点は末尾に残す
+void optimizeVertexFetch(
+    tc::Indices& indices,
+    size_t vertex_count,
+    tc::Indices& remap
+) {
+    const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    remap.assign(vertex_count, UNUSED);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint32_t& to = remap[indices[i]];
+        if (to == UNUSED) {
+            to = next++;
+        }
+        indices[i] = to;
+    }
+    for (size_t v = 0; v < vertex_count; ++v) {
+        if (remap[v] == UNUSED) {
+            remap[v] = next++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+//  頂点データを remap に従って並べ替える
+//  頂点数に足りないデータは触らない
+void remapVertexData(
+    std::vector<float>& data,
+    size_t stride,
+    const tc::Indices& remap
+) {
+    if (stride == 0 || data.size() < remap.size() * stride) {
+        return;
+    }
+    std::vector<float> src(data.begin(), data.begin() + remap.size() * stride);
+    for (size_t v = 0; v < remap.size(); ++v) {
+        std::memcpy(&data[remap[v] * stride], &src[v * stride], stride * sizeof(float));
+    }
+}
+
+
+}   // unname namespace
+
+
+namespace tc {
+
+
+
+namespace {
+
+//======================================================================
+//  メッシュの解析
+//  パーサーの解析中にも、遅延解析でパーサーが無くなった後にも使えるよう、
+//  メッシュの解析に必要な設定と参照先をまとめて持つ
+//  解析中は状態を変えないので、複数スレッドから同時に使ってよい
+class MeshDecoder
+{
+public:
+MeshDecoder()
+    : context_()
+    , scratch_()
+    , profiler_(nullptr)
+    , log_()
+    , interleaved_output_(false)
+    , vertex_cache_optimization_(false)
+{
+}
+
+
+//----------------------------------------------------------------------
+//  メッシュノードを解析して mesh に格納する
+//  失敗したら mesh は空になる
+Result decode(
+    const xml::XMLElement* mesh_node,
+    tc::ColladaMesh& mesh
+) const {
+    //  ワーカースレッドでも解析したパーサーの出力先を使う
+    LogScope log_scope(&log_);
+    Indices indices;
+    Result result = parseMeshNode(mesh_node, mesh, indices);
+    if (result.isFailed()) {
+        mesh.vertex_ = tc::ColladaMesh::ArrayData();
+        mesh.normal_ = tc::ColladaMesh::ArrayData();
+        mesh.uv_ = tc::ColladaMesh::ArrayData();
+        mesh.interleaved_ = tc::ColladaMesh::InterleavedData();
+        mesh.submeshes_.clear();
+        return result;
+    }
+
+    //  頂点キャッシュ最適化
+    if (vertex_cache_optimization_) {
+        ScopedPhase phase(profiler_, tc::ParseStatistics::PHASE_VERTEX_CACHE);
+        optimizeMesh(mesh, indices);
+    }
+    {
+        ScopedPhase phase(profiler_, tc::ParseStatistics::PHASE_INDEX_SETUP);
+        mesh.index_buffer_.assign(indices);
+    }
+
+    //  頂点と法線の並びが同じになっているかチェック
+    if (mesh.vertex_.isValidate() && mesh.normal_.isValidate()) {
+        size_t visize = mesh.vertex_.data_.size();
+        size_t nisize = mesh.normal_.data_.size();
+        TINY_COLLADA_LOG_DEBUG("%lu[v] == %lu[n]", visize, nisize);
+        TINY_COLLADA_ASSERT(visize == nisize);
+    }
+    return Result::Code::SUCCESS;
+}
+
+
+private:
+//----------------------------------------------------------------------
+//  メッシュノードの解析
+//  プリミティブ要素ごとにサブメッシュを作り、頂点データとインデックスは1本にまとめる
+//  indices には描画用のインデックスが入る
+Result parseMeshNode(
+    const xml::XMLElement* mesh_node,
+    tc::ColladaMesh& data,
+    Indices& indices
+) const {
+    std::shared_ptr<MeshInformation> info = allocateShared<MeshInformation>(scratch_);
+    {
+        //  ソースノードの情報保存
+        ScopedPhase decode_phase(profiler_, tc::ParseStatistics::PHASE_SOURCE_DECODE);
+        collectMeshSources(info->sources_, mesh_node, context_);
+    }
+
+    //  プリミティブ要素ごとにインデックスを展開してつなげる
+    AttributeStream streams[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    const xml::XMLElement* primitive_node = nextPrimitiveNode(mesh_node, nullptr);
+    data.setPrimitiveType(getPrimitiveType(primitive_node));
+    while (primitive_node) {
+        Result result = appendPrimitive(mesh_node, primitive_node, *info, streams, data.submeshes_);
+        if (result.isFailed()) {
+            return result;
+        }
+        primitive_node = nextPrimitiveNode(mesh_node, primitive_node);
+    }
+
+    //  統計
+    if (profiler_) {
+        uint64_t float_count = 0;
+        for (size_t i = 0; i < info->sources_.size(); ++i) {
+            float_count += info->sources_[i].data_.size();
+        }
+        profiler_->add(&tc::ParseStatistics::source_count_, info->sources_.size());
+        profiler_->add(&tc::ParseStatistics::float_count_, float_count);
+    }
+
+    //  属性ごとの参照先を1つにする
+    SourceData merged[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    const SourceData* sources[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    for (int a = 0; a < tc::ColladaMesh::ATTRIBUTE_COUNT; ++a) {
+        sources[a] = mergeAttributeSources(streams[a], merged[a]);
+    }
+
+    if (interleaved_output_) {
+        ScopedPhase phase(profiler_, tc::ParseStatistics::PHASE_ATTRIBUTE_REMAP);
+        setupInterleavedMesh(sources, streams, data, indices);
+    }
+    else {
+        setupMesh(sources, streams, data);
+        indices = data.vertex_.indices_;
+    }
+
+    //  統計
+    if (profiler_) {
+        uint64_t vertex_count = data.interleaved_.getVertexCount();
+        if (data.vertex_.stride_ > 0) {
+            vertex_count = data.vertex_.data_.size() / data.vertex_.stride_;
+        }
+        profiler_->add(&tc::ParseStatistics::vertex_count_, vertex_count);
+    }
+    return Result::Code::SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//  プリミティブ要素1つを解析し、属性ごとのインデックスの後ろにつなげてサブメッシュを追加する
+//  ここを通ったインデックスは範囲チェック無しで使ってよい
+Result appendPrimitive(
+    const xml::XMLElement* mesh_node,
+    const xml::XMLElement* primitive_node,
+    MeshInformation& info,
+    AttributeStream* streams,
+    std::vector<tc::ColladaMesh::SubMesh>& submeshes
+) const {
+    static const StringId SEMANTICS[tc::ColladaMesh::ATTRIBUTE_COUNT] = {
+        STRING_POSITION,
+        STRING_NORMAL,
+        STRING_TEXCOORD
+    };
+    static const char* SEMANTIC_NAMES[tc::ColladaMesh::ATTRIBUTE_COUNT] = {
+        "POSITION",
+        "NORMAL",
+        "TEXCOORD"
+    };
+
+    {
+        ScopedPhase decode_phase(profiler_, tc::ParseStatistics::PHASE_SOURCE_DECODE);
+        info.clearPrimitive();
+
+        //  インデックス情報保存
+        collectIndices(primitive_node, info, context_);
+
+        //  インプットノードの情報保存
+        collectMeshInputs(info.inputs_, mesh_node, primitive_node, *context_.strings_);
+
+        info.dump(*context_.strings_);
+
+        //  ソースとインプットを関連付け
+        relateSourcesToInputs(info);
+        for (int i = 0; i < info.sources_.size(); ++i) {
+            SourceData* src = &info.sources_[i];
+            if (src->input_) {
+                TINY_COLLADA_LOG_DEBUG("SRC:%s - INPUT:%s  DATA size %lu",
+                    context_.strings_->get(src->id_),
+                    context_.strings_->get(src->input_->source_),
+                    src->data_.size()
+                );
+            }
+        }
+    }
+
+    //  三角形分割
+    {
+        ScopedPhase phase(profiler_, tc::ParseStatistics::PHASE_TRIANGULATE);
+        triangulatePolygons(info);
+    }
+    if (profiler_) {
+        profiler_->add(&tc::ParseStatistics::index_count_, info.raw_indices_.size());
+    }
+
+    ScopedPhase phase(profiler_, tc::ParseStatistics::PHASE_INDEX_SETUP);
+    const size_t corner_first = submeshes.empty() ? 0 : submeshes.back().index_offset_ + submeshes.back().index_count_;
+    const size_t corner_count = info.getCornerCount();
+    tc::ColladaMesh::SubMesh submesh;
+    submesh.index_offset_ = static_cast<uint32_t>(corner_first);
+    submesh.index_count_ = static_cast<uint32_t>(corner_count);
+    submesh.material_ = context_.strings_->get(
+        context_.strings_->intern(getElementAttribute(primitive_node, MATERIAL_ATTR_NAME))
+    );
+    TINY_COLLADA_LOG_DEBUG("submesh %s  material = %s  corners = %lu",
+        primitive_node->Name(),
+        submesh.material_ ? submesh.material_ : "-",
+        corner_count
+    );
+    if (corner_count == 0) {
+        submeshes.push_back(submesh);
+        return Result::Code::SUCCESS;
+    }
+
+    //  インデックスは全属性まとめて展開
+    //  要素の無い位置を参照していればエラーにするため、位置だけはストライド0でも展開する
+    const SourceData* sources[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    int attributes[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    int offsets[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    Indices* outs[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    int count = 0;
+    for (int a = 0; a < tc::ColladaMesh::ATTRIBUTE_COUNT; ++a) {
+        AttributeStream& stream = streams[a];
+        const SourceData* source = info.searchSourceBySemantic(SEMANTICS[a]);
+        if (!source || (source->stride_ == 0 && a != tc::ColladaMesh::ATTRIBUTE_POSITION)) {
+            //  前のプリミティブ要素が持っている属性なら0の要素で埋める
+            if (!stream.sources_.empty()) {
+                stream.indices_.resize(corner_first + corner_count, MISSING_ELEMENT);
+                stream.missing_ = true;
+            }
+            continue;
+        }
+        //  前のプリミティブ要素が持っていなかった属性ならその分を埋める
+        if (stream.sources_.empty() && corner_first > 0) {
+            stream.indices_.assign(corner_first, MISSING_ELEMENT);
+            stream.missing_ = true;
+        }
+        sources[count] = source;
+        attributes[count] = a;
+        offsets[count] = source->input_->offset_;
+        outs[count++] = &stream.indices_;
+    }
+    splitAttributeIndices(info, offsets, outs, count);
+
+    //  範囲チェックをしてから、参照先をつなげた位置にずらす
+    for (int i = 0; i < count; ++i) {
+        AttributeStream& stream = streams[attributes[i]];
+        const SourceData* source = sources[i];
+        const char* semantic = SEMANTIC_NAMES[attributes[i]];
+        uint32_t* first = &stream.indices_[corner_first];
+        Result result = validateIndices(mesh_node, semantic, first, corner_count, getElementCount(source));
+        if (result.isFailed()) {
+            return result;
+        }
+
+        size_t source_idx = 0;
+        while (source_idx < stream.sources_.size() && stream.sources_[source_idx] != source) {
+            ++source_idx;
+        }
+        if (source_idx == stream.sources_.size()) {
+            if (!stream.sources_.empty() && stream.sources_[0]->stride_ != source->stride_) {
+                char message[256];
+                std::snprintf(
+                    message,
+                    sizeof(message),
+                    "geometry '%s' %s sources have different strides. %u != %u",
+                    getGeometryId(mesh_node),
+                    semantic,
+                    stream.sources_[0]->stride_,
+                    source->stride_
+                );
+                TINY_COLLADA_LOG_ERROR("%s", message);
+                return Result(Result::Code::PERSE_ERROR, message);
+            }
+            const uint32_t base = stream.sources_.empty() ? 0
+                : stream.bases_.back() + static_cast<uint32_t>(getElementCount(stream.sources_.back()));
+            stream.sources_.push_back(source);
+            stream.bases_.push_back(base);
+        }
+        const uint32_t base = stream.bases_[source_idx];
+        if (base > 0) {
+            for (size_t c = 0; c < corner_count; ++c) {
+                first[c] += base;
+            }
+        }
+    }
+    submeshes.push_back(submesh);
+    return Result::Code::SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//  属性の参照先を1つにまとめる
+//  参照先が1つだけならそのまま返し、複数あるか属性を持たないプリミティブ要素があれば
+//  つなげたものを merged に作る。属性が無ければ nullptr
+const SourceData* mergeAttributeSources(
+    AttributeStream& stream,
+    SourceData& merged
+) const {
+    if (stream.sources_.empty()) {
+        return nullptr;
+    }
+    if (stream.sources_.size() == 1 && !stream.missing_) {
+        return stream.sources_[0];
+    }
+
+    const uint32_t stride = stream.sources_[0]->stride_;
+    merged.stride_ = stride;
+    for (size_t i = 0; i < stream.sources_.size(); ++i) {
+        const SourceData* source = stream.sources_[i];
+        merged.data_.insert(merged.data_.end(), source->data_.begin(), source->data_.begin() + getElementCount(source) * stride);
+    }
+    if (stream.missing_) {
+        const uint32_t zero = static_cast<uint32_t>(getElementCount(&merged));
+        merged.data_.resize(merged.data_.size() + stride, 0.0f);
+        std::replace(stream.indices_.begin(), stream.indices_.end(), MISSING_ELEMENT, zero);
+    }
+    return &merged;
+}
+
+//----------------------------------------------------------------------
+//  ソースの要素数
+static size_t getElementCount(
+    const SourceData* source
+) {
+    return source->stride_ > 0 ? source->data_.size() / source->stride_ : 0;
+}
+
+//----------------------------------------------------------------------
+//  エラー表示用のジオメトリid
+static const char* getGeometryId(
+    const xml::XMLElement* mesh_node
+) {
+    const xml::XMLElement* geometry = mesh_node->Parent() ? mesh_node->Parent()->ToElement() : nullptr;
+    const char* geometry_id = geometry ? getElementAttribute(geometry, ID_ATTR_NAME) : nullptr;
+    return geometry_id ? geometry_id : "";
+}
+
+//----------------------------------------------------------------------
+//  属性のインデックスが参照先の要素数に収まっているか確認する
+//  最大値だけをまとめて求め、範囲外のときだけ位置を探してエラーにする
+Result validateIndices(
+    const xml::XMLElement* mesh_node,
+    const char* semantic,
+    const uint32_t* indices,
+    size_t count,
+    size_t element_count
+) const {
+    if (count == 0) {
+        return Result::Code::SUCCESS;
+    }
+    if (element_count > 0 && findMaxIndex(indices, count) < element_count) {
+        return Result::Code::SUCCESS;
+    }
+
+    size_t at = 0;
+    while (indices[at] < element_count) {
+        ++at;
+    }
+    char message[256];
+    std::snprintf(
+        message,
+        sizeof(message),
+        "geometry '%s' %s index %u (triangle corner %lu) is out of range. count = %lu",
+        getGeometryId(mesh_node),
+        semantic,
+        indices[at],
+        static_cast<unsigned long>(at),
+        static_cast<unsigned long>(element_count)
+    );
+    TINY_COLLADA_LOG_ERROR("%s", message);
+    return Result(Result::Code::INDEX_OUT_OF_RANGE, message);
+}
+
+//----------------------------------------------------------------------
+//  属性ごとのデータ設定
+//  法線と uv は位置のインデックスに合わせて並べ替える
+void setupMesh(
+    const SourceData* const* sources,
+    AttributeStream* streams,
+    tc::ColladaMesh& mesh
+) const {
+    const SourceData* pos_source = sources[tc::ColladaMesh::ATTRIBUTE_POSITION];
+    const SourceData* normal_source = sources[tc::ColladaMesh::ATTRIBUTE_NORMAL];
+    const SourceData* uv_source = sources[tc::ColladaMesh::ATTRIBUTE_TEXCOORD];
+    mesh.vertex_.indices_.swap(streams[tc::ColladaMesh::ATTRIBUTE_POSITION].indices_);
+    mesh.normal_.indices_.swap(streams[tc::ColladaMesh::ATTRIBUTE_NORMAL].indices_);
+    mesh.uv_.indices_.swap(streams[tc::ColladaMesh::ATTRIBUTE_TEXCOORD].indices_);
+    TINY_COLLADA_LOG_DEBUG("index size = %lu", mesh.vertex_.indices_.size());
+
+    //  頂点情報
+    if (pos_source) {
+        TINY_COLLADA_LOG_DEBUG("pos_source size %lu", pos_source->data_.size());
+        mesh.vertex_.data_ = pos_source->data_;
+        mesh.vertex_.stride_ = pos_source->stride_;
+    }
+
+    //  法線情報
+    if (normal_source && pos_source) {
+        TINY_COLLADA_LOG_DEBUG("normal_source size %lu", normal_source->data_.size());
+        
+        mesh.normal_.stride_ = normal_source->stride_;
+        
+        //  頂点インデックスにあわせてデータ変更
+        ScopedPhase remap_phase(profiler_, tc::ParseStatistics::PHASE_ATTRIBUTE_REMAP);
+        const Indices& vindices = mesh.vertex_.indices_;
+        const Indices& nindices = mesh.normal_.indices_;
+        const size_t nstride = normal_source->stride_;
+        mesh.normal_.data_.resize(
+            std::max(pos_source->data_.size(), getElementCount(pos_source) * nstride),
+            8.8
+        );
+        const float* from = normal_source->data_.data();
+        float* to = mesh.normal_.data_.data();
+        for (size_t vert_idx = 0; vert_idx < vindices.size(); ++vert_idx) {
+            const size_t from_idx = static_cast<size_t>(nindices[vert_idx]) * nstride;
+            const size_t to_idx = static_cast<size_t>(vindices[vert_idx]) * nstride;
+            for (size_t di = 0; di < nstride; ++di) {
+                to[to_idx + di] = from[from_idx + di];
+            }
+        }
+        
+    }
+
+
+    //  uv
+    if (uv_source && pos_source) {
+        TINY_COLLADA_LOG_DEBUG("uv_source size %lu", uv_source->data_.size());
+        
+        mesh.uv_.stride_ = uv_source->stride_;
+        
+        //  頂点インデックスにあわせてデータ変更
+        ScopedPhase remap_phase(profiler_, tc::ParseStatistics::PHASE_ATTRIBUTE_REMAP);
+        const Indices& vindices = mesh.vertex_.indices_;
+        const Indices& nindices = mesh.uv_.indices_;
+        const size_t nstride = uv_source->stride_;
+        mesh.uv_.data_.resize(
+            std::max(pos_source->data_.size(), getElementCount(pos_source) * nstride),
+            8.8888f
+        );
+        const float* from = uv_source->data_.data();
+        float* to = mesh.uv_.data_.data();
+        for (size_t vert_idx = 0; vert_idx < vindices.size(); ++vert_idx) {
+            const size_t from_idx = static_cast<size_t>(nindices[vert_idx]) * nstride;
+            const size_t to_idx = static_cast<size_t>(vindices[vert_idx]) * nstride;
+            for (size_t di = 0; di < nstride; ++di) {
+                to[to_idx + di] = from[from_idx + di];
+            }
+        }
+        
+    }
+}
+
+
+
+
+//----------------------------------------------------------------------
+//  インターリーブ頂点データのセットアップ
+//  <p> の (位置, 法線, uv) インデックスの組をハッシュで溶接して一意な頂点にし、
+//  1本の頂点バッファと共通インデックスを作る
+void setupInterleavedMesh(
+    const SourceData* const* attribute_sources,
+    AttributeStream* streams,
+    tc::ColladaMesh& mesh,
+    Indices& indices
+) const {
+    //  レイアウト決定
+    const SourceData* sources[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    const uint32_t* keys_by_attribute[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    int attribute_count = 0;
+    tc::ColladaMesh::InterleavedData& out = mesh.interleaved_;
+    uint8_t stride = 0;
+    for (int i = 0; i < tc::ColladaMesh::ATTRIBUTE_COUNT; ++i) {
+        const SourceData* source = attribute_sources[i];
+        if (!source) {
+            continue;
+        }
+        tc::ColladaMesh::InterleavedData::Element element;
+        element.attribute_ = static_cast<tc::ColladaMesh::Attribute>(i);
+        element.components_ = static_cast<uint8_t>(source->stride_);
+        element.offset_ = stride;
+        out.layout_.push_back(element);
+        stride += element.components_;
+
+        sources[attribute_count] = source;
+        keys_by_attribute[attribute_count] = streams[i].indices_.data();
+        ++attribute_count;
+    }
+    if (attribute_count == 0) {
+        return;
+    }
+    out.stride_ = stride;
+
+    //  サブメッシュの切れ目は気にせず、全ての三角形の頂点をまとめて溶接する
+    //  属性ごとのインデックスは全て三角形の頂点数ちょうどある
+    const size_t corner_count = streams[out.layout_[0].attribute_].indices_.size();
+
+    //  溶接用ハッシュテーブル
+    //  頂点番号を入れる。キーは頂点ごとのインデックスの組
+    const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+    size_t table_size = 16;
+    while (table_size < corner_count * 2) {
+        table_size <<= 1;
+    }
+    const size_t table_mask = table_size - 1;
+    std::vector<uint32_t> table(table_size, EMPTY);
+    Indices keys;
+    keys.reserve(corner_count * attribute_count);
+    out.data_.reserve(corner_count * stride);
+    indices.reserve(corner_count);
+
+    uint32_t key[tc::ColladaMesh::ATTRIBUTE_COUNT];
+    for (size_t c = 0; c < corner_count; ++c) {
+        uint32_t hash = 2166136261u;
+        for (int a = 0; a < attribute_count; ++a) {
+            key[a] = keys_by_attribute[a][c];
+            hash = (hash ^ key[a]) * 16777619u;
+        }
+
+        size_t slot = hash & table_mask;
+        uint32_t vertex = EMPTY;
+        while (table[slot] != EMPTY) {
+            const uint32_t* stored = &keys[table[slot] * attribute_count];
+            if (std::memcmp(stored, key, attribute_count * sizeof(uint32_t)) == 0) {
+                vertex = table[slot];
+                break;
+            }
+            slot = (slot + 1) & table_mask;
+        }
+
+        //  新しい組み合わせなら頂点を追加
+        if (vertex == EMPTY) {
+            vertex = static_cast<uint32_t>(keys.size() / attribute_count);
+            table[slot] = vertex;
+            keys.insert(keys.end(), key, key + attribute_count);
+            for (int a = 0; a < attribute_count; ++a) {
+                const size_t components = sources[a]->stride_;
+                const float* from = sources[a]->data_.data() + static_cast<size_t>(key[a]) * components;
+                out.data_.insert(out.data_.end(), from, from + components);
+            }
+        }
+        indices.push_back(vertex);
+    }
+    TINY_COLLADA_LOG_DEBUG("interleaved %lu corners -> %lu vertices", corner_count, out.getVertexCount());
+}
+
+//----------------------------------------------------------------------
+//  頂点キャッシュ最適化
+//  三角形を並べ替えた後、頂点データを初出順に並べ直す
+//  三角形はサブメッシュの中だけで並べ替えるので、サブメッシュの範囲は変わらない
+//  通常出力では法線とuvのインデックスも三角形と一緒に並べ替える
+void optimizeMesh(
+    tc::ColladaMesh& mesh,
+    Indices& indices
+) const {
+    const bool interleaved = mesh.interleaved_.isValidate();
+    size_t vertex_count = 0;
+    if (interleaved) {
+        vertex_count = mesh.interleaved_.getVertexCount();
+    }
+    else if (mesh.vertex_.isValidate()) {
+        vertex_count = mesh.vertex_.data_.size() / mesh.vertex_.stride_;
+    }
+    if (!isValidTriangleList(indices, vertex_count)) {
+        return;
+    }
+
+    mesh.original_cache_statistics_ = computeCacheStatistics(indices, vertex_count);
+
+    //  三角形の並べ替え
+    Indices order;
+    if (mesh.submeshes_.size() <= 1) {
+        optimizeTriangleOrder(indices, vertex_count, order);
+    }
+    else {
+        Indices range;
+        Indices range_order;
+        order.reserve(indices.size() / 3);
+        for (size_t i = 0; i < mesh.submeshes_.size(); ++i) {
+            const tc::ColladaMesh::SubMesh& submesh = mesh.submeshes_[i];
+            if (submesh.index_count_ == 0) {
+                continue;
+            }
+            Indices::iterator first = indices.begin() + submesh.index_offset_;
+            range.assign(first, first + submesh.index_count_);
+            optimizeTriangleOrder(range, vertex_count, range_order);
+            std::copy(range.begin(), range.end(), first);
+            const uint32_t first_triangle = submesh.index_offset_ / 3;
+            for (size_t t = 0; t < range_order.size(); ++t) {
+                order.push_back(range_order[t] + first_triangle);
+            }
+        }
+    }
+    if (!interleaved) {
+        mesh.vertex_.indices_ = indices;
+        reorderTriangles(mesh.normal_.indices_, order);
+        reorderTriangles(mesh.uv_.indices_, order);
+    }
+
+    //  頂点の並べ替え
+    Indices remap;
+    optimizeVertexFetch(indices, vertex_count, remap);
+    if (interleaved) {
+        remapVertexData(mesh.interleaved_.data_, mesh.interleaved_.stride_, remap);
+    }
+    else {
+        mesh.vertex_.indices_ = indices;
+        remapVertexData(mesh.vertex_.data_, mesh.vertex_.stride_, remap);
+        remapVertexData(mesh.normal_.data_, mesh.normal_.stride_, remap);
+        remapVertexData(mesh.uv_.data_, mesh.uv_.stride_, remap);
+    }
+
+    mesh.cache_statistics_ = computeCacheStatistics(indices, vertex_count);
+    TINY_COLLADA_LOG_DEBUG("ACMR %f -> %f  ATVR %f -> %f",
+        mesh.original_cache_statistics_.acmr_,
+        mesh.cache_statistics_.acmr_,
+        mesh.original_cache_statistics_.atvr_,
+        mesh.cache_statistics_.atvr_
+    );
+}
+
+//----------------------------------------------------------------------
+//  メッシュから抜いたinputsとsourcesを関連付ける
+void relateSourcesToInputs(
+    MeshInformation& info
+) const {
+    TINY_COLLADA_LOG_DEBUG("%s", __FUNCTION__);
+    auto src_it = info.sources_.begin();
+    auto src_end = info.sources_.end();
+    
+
+	while (src_it != src_end) {
+		InputData* input = info.searchInputBySource(src_it->id_);
+		src_it->input_ = input;
+		
+		if (input) {
+			TINY_COLLADA_LOG_DEBUG(" %u OK  %u %u", src_it->id_, input->semantic_, input->source_);
+		}
+		else {
+			TINY_COLLADA_LOG_DEBUG(" %u NG", src_it->id_);
+		}
+		++src_it;
+	}
+}
+
+
+public:
+    DecodeContext context_;
+    std::shared_ptr<Arena> scratch_;    //  途中のデータの確保先
+    ParseProfiler* profiler_;           //  統計を取らないなら nullptr
+    LogContext log_;
+    bool interleaved_output_;
+    bool vertex_cache_optimization_;
+};  // class MeshDecoder
+
+
+//======================================================================
+//  静的バッチ
+//  シーンのサブメッシュをマテリアルごとにまとめ、ワールド行列で変換済みの
+//  頂点とインデックスを1本ずつ作る
+
+//  バッチに入れるサブメッシュ1つ
+struct BatchItem
+{
+    const tc::ColladaScene* scene_;
+    const tc::ColladaMesh* mesh_;
+    tc::ColladaBatch::Range range_;     //  scene_, mesh_, submesh_ だけ設定済み
+};
+
+//  同じマテリアルを使うサブメッシュの集まり
+struct BatchGroup
+{
+    std::shared_ptr<tc::ColladaMaterial> material_;
+    std::vector<BatchItem> items_;
+};
+using BatchGroups = std::vector<BatchGroup>;
+
+//  メッシュの頂点属性の参照先
+//  通常出力でもインターリーブ出力でも、頂点 i の属性は data_ + i * stride_ から components_ 個
+struct BatchAttribute
+{
+    BatchAttribute()
+        : data_(nullptr)
+        , stride_(0)
+        , components_(0)
+    {}
+
+    const float* data_;
+    size_t stride_;
+    size_t components_;
+};
+
+//----------------------------------------------------------------------
+//  メッシュの属性を取得
+//  持っていなければ data_ は nullptr
+BatchAttribute getBatchAttribute(
+    const tc::ColladaMesh& mesh,
+    tc::ColladaMesh::Attribute attribute
+) {
+    BatchAttribute result;
+    if (mesh.interleaved_.isValidate()) {
+        const tc::ColladaMesh::InterleavedData& interleaved = mesh.interleaved_;
+        const tc::ColladaMesh::InterleavedData::Element* element = interleaved.findElement(attribute);
+        if (element) {
+            result.data_ = interleaved.data_.data() + element->offset_;
+            result.stride_ = interleaved.stride_;
+            result.components_ = element->components_;
+        }
+        return result;
+    }
+
+    //  通常出力の法線と uv は位置の並びに並べ替え済み
+    const tc::ColladaMesh::ArrayData* array = &mesh.vertex_;
+    if (attribute == tc::ColladaMesh::ATTRIBUTE_NORMAL) {
+        array = &mesh.normal_;
+    }
+    else if (attribute == tc::ColladaMesh::ATTRIBUTE_TEXCOORD) {
+        array = &mesh.uv_;
+    }
+    if (array->isValidate() && !array->data_.empty()) {
+        result.data_ = array->data_.data();
+        result.stride_ = static_cast<size_t>(array->stride_);
+        result.components_ = static_cast<size_t>(array->stride_);
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------
+//  メッシュの頂点数
+size_t getBatchVertexCount(
+    const tc::ColladaMesh& mesh
+) {
+    if (mesh.interleaved_.isValidate()) {
+        return mesh.interleaved_.getVertexCount();
+    }
+    if (!mesh.vertex_.isValidate()) {
+        return 0;
+    }
+    return mesh.vertex_.data_.size() / static_cast<size_t>(mesh.vertex_.stride_);
+}
+
+//----------------------------------------------------------------------
+//  サブメッシュをマテリアルごとに分ける
+//  グループはマテリアルの初出順、グループ内はシーン、メッシュ、サブメッシュの順
+//  位置を持たないメッシュや三角形でないメッシュは入れない
+void collectBatchGroups(
+    const tc::ColladaScenes& scenes,
+    size_t first_scene,
+    BatchGroups& groups
+) {
+    std::unordered_map<const tc::ColladaMaterial*, size_t> group_index;
+    for (size_t scene_idx = first_scene; scene_idx < scenes.size(); ++scene_idx) {
+        const tc::ColladaScene* scene = scenes[scene_idx].get();
+        for (size_t mesh_idx = 0; mesh_idx < scene->meshes_.size(); ++mesh_idx) {
+            const tc::ColladaMesh* mesh = scene->meshes_[mesh_idx].get();
+            if (!mesh
+             || mesh->getPrimitiveType() != tc::ColladaMesh::PRIMITIVE_TRIANGLES
+             || getBatchVertexCount(*mesh) == 0
+             || !getBatchAttribute(*mesh, tc::ColladaMesh::ATTRIBUTE_POSITION).data_) {
+                continue;
+            }
+            const std::vector<tc::ColladaMesh::SubMesh>& submeshes = *mesh->getSubMeshes();
+            for (size_t sub_idx = 0; sub_idx < submeshes.size(); ++sub_idx) {
+                if (submeshes[sub_idx].index_count_ == 0) {
+                    continue;
+                }
+                const std::shared_ptr<tc::ColladaMaterial>& material = scene->findMaterial(
+                    submeshes[sub_idx].material_
+                );
+                auto found = group_index.find(material.get());
+                if (found == group_index.end()) {
+                    found = group_index.insert(std::make_pair(material.get(), groups.size())).first;
+                    groups.push_back(BatchGroup());
+                    groups.back().material_ = material;
+                }
+
+                BatchItem item;
+                std::memset(&item.range_, 0, sizeof(item.range_));
+                item.scene_ = scene;
+                item.mesh_ = mesh;
+                item.range_.scene_ = static_cast<uint32_t>(scene_idx);
+                item.range_.mesh_ = static_cast<uint32_t>(mesh_idx);
+                item.range_.submesh_ = static_cast<uint32_t>(sub_idx);
+                groups[found->second].items_.push_back(item);
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+//  グループ1つ分のバッチ作成
+//  サブメッシュごとに使っている頂点だけを初出順に取り出し、バッチの頂点として追加してから
+//  追加した範囲をまとめて変換する
+void buildBatch(
+    const BatchGroup& group,
+    tc::ColladaBatch& batch
+) {
+    const uint32_t NO_VERTEX = 0xFFFFFFFF;
+
+    //  レイアウト決定
+    //  位置は3要素。法線と uv はどれか1つでも持っていれば全頂点に置く
+    bool has_normal = false;
+    size_t uv_components = 0;
+    for (size_t item_idx = 0; item_idx < group.items_.size(); ++item_idx) {
+        const tc::ColladaMesh& mesh = *group.items_[item_idx].mesh_;
+        has_normal |= getBatchAttribute(mesh, tc::ColladaMesh::ATTRIBUTE_NORMAL).data_ != nullptr;
+        uv_components = std::max(
+            uv_components,
+            getBatchAttribute(mesh, tc::ColladaMesh::ATTRIBUTE_TEXCOORD).components_
+        );
+    }
+    tc::ColladaMesh::InterleavedData& out = batch.vertices_;
+    out.layout_.clear();
+    out.stride_ = 0;
+    const tc::ColladaMesh::InterleavedData::Element position_element = {
+        tc::ColladaMesh::ATTRIBUTE_POSITION, 3, 0
+    };
+    out.layout_.push_back(position_element);
+    out.stride_ += 3;
+    if (has_normal) {
+        const tc::ColladaMesh::InterleavedData::Element normal_element = {
+            tc::ColladaMesh::ATTRIBUTE_NORMAL, 3, out.stride_
+        };
+        out.layout_.push_back(normal_element);
+        out.stride_ += 3;
+    }
+    if (uv_components > 0) {
+        const tc::ColladaMesh::InterleavedData::Element uv_element = {
+            tc::ColladaMesh::ATTRIBUTE_TEXCOORD,
+            static_cast<uint8_t>(uv_components),
+            out.stride_
+        };
+        out.layout_.push_back(uv_element);
+        out.stride_ += static_cast<uint8_t>(uv_components);
+    }
+    const size_t stride = out.stride_;
+    const size_t normal_offset = 3;
+    const size_t uv_offset = has_normal ? 6 : 3;
+
+    Indices indices;
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> used;
+    batch.ranges_.reserve(group.items_.size());
+    for (size_t item_idx = 0; item_idx < group.items_.size(); ++item_idx) {
+        const BatchItem& item = group.items_[item_idx];
+        const tc::ColladaMesh& mesh = *item.mesh_;
+        const tc::ColladaMesh::SubMesh& submesh = mesh.submeshes_[item.range_.submesh_];
+        const size_t vertex_count = getBatchVertexCount(mesh);
+        const size_t first_vertex = out.getVertexCount();
+
+        //  使っている頂点を初出順に番号付けし直す
+        remap.assign(vertex_count, NO_VERTEX);
+        used.clear();
+        tc::ColladaBatch::Range range = item.range_;
+        range.index_offset_ = static_cast<uint32_t>(indices.size());
+        range.vertex_offset_ = static_cast<uint32_t>(first_vertex);
+        const tc::IndexBuffer& source_indices = mesh.index_buffer_;
+        const size_t index_end = std::min(
+            static_cast<size_t>(submesh.index_offset_) + submesh.index_count_,
+            source_indices.size()
+        );
+        for (size_t i = submesh.index_offset_; i < index_end; ++i) {
+            const uint32_t vertex = source_indices[i];
+            if (vertex >= vertex_count) {
+                //  解析時に検査済みなので来ないはず
+                continue;
+            }
+            if (remap[vertex] == NO_VERTEX) {
+                remap[vertex] = static_cast<uint32_t>(first_vertex + used.size());
+                used.push_back(vertex);
+            }
+            indices.push_back(remap[vertex]);
+        }
+        //  三角形に満たない端数は捨てる
+        indices.resize(range.index_offset_ + (indices.size() - range.index_offset_) / 3 * 3);
+        range.index_count_ = static_cast<uint32_t>(indices.size() - range.index_offset_);
+        range.vertex_count_ = static_cast<uint32_t>(used.size());
+
+        //  頂点の取り出し
+        out.data_.resize((first_vertex + used.size()) * stride, 0.0f);
+        float* dst = out.data_.data() + first_vertex * stride;
+        const BatchAttribute attributes[] = {
+            getBatchAttribute(mesh, tc::ColladaMesh::ATTRIBUTE_POSITION),
+            getBatchAttribute(mesh, tc::ColladaMesh::ATTRIBUTE_NORMAL),
+            getBatchAttribute(mesh, tc::ColladaMesh::ATTRIBUTE_TEXCOORD)
+        };
+        const size_t offsets[] = {0, normal_offset, uv_offset};
+        const size_t max_components[] = {3, 3, uv_components};
+        for (int attr = 0; attr < tc::ColladaMesh::ATTRIBUTE_COUNT; ++attr) {
+            const BatchAttribute& source = attributes[attr];
+            if (!source.data_) {
+                continue;
+            }
+            const size_t components = std::min(source.components_, max_components[attr]);
+            for (size_t i = 0; i < used.size(); ++i) {
+                const float* from = source.data_ + used[i] * source.stride_;
+                float* to = dst + i * stride + offsets[attr];
+                for (size_t c = 0; c < components; ++c) {
+                    to[c] = from[c];
+                }
+            }
+        }
+
+        //  ワールド行列で変換
+        const std::vector<float>& matrix = item.scene_->matrix_;
+        if (matrix.size() >= 16) {
+            transformVectors(matrix.data(), true, dst, used.size(), stride);
+            if (attributes[tc::ColladaMesh::ATTRIBUTE_NORMAL].data_) {
+                transformNormals(matrix.data(), dst + normal_offset, used.size(), stride);
+            }
+            //  鏡像なら三角形の表を保つために巡回を逆にする
+            if (isMirrorMatrix(matrix.data())) {
+                for (size_t i = range.index_offset_; i < indices.size(); i += 3) {
+                    std::swap(indices[i + 1], indices[i + 2]);
+                }
+            }
+        }
+        batch.ranges_.push_back(range);
+    }
+    batch.indices_.assign(indices);
+}
+
+//----------------------------------------------------------------------
+//  静的バッチ作成
+//  first_scene 以降のシーンをまとめて batches の後ろに追加する
+//  バッチの枠は呼び出し側スレッドで作り、中身はグループ単位で並列に作る
+void buildStaticBatches(
+    const tc::ColladaScenes& scenes,
+    size_t first_scene,
+    const std::shared_ptr<Arena>& arena,
+    TaskPool* pool,
+    tc::ColladaBatches& batches
+) {
+    BatchGroups groups;
+    collectBatchGroups(scenes, first_scene, groups);
+
+    const size_t first_batch = batches.size();
+    for (size_t group_idx = 0; group_idx < groups.size(); ++group_idx) {
+        std::shared_ptr<tc::ColladaBatch> batch = allocateShared<tc::ColladaBatch>(arena);
+        batch->material_ = groups[group_idx].material_;
+        batches.push_back(batch);
+    }
+    auto build = [&groups, &batches, first_batch](size_t group_idx) {
+        buildBatch(groups[group_idx], *batches[first_batch + group_idx]);
+    };
+    if (pool) {
+        pool->parallelFor(groups.size(), build);
+    }
+    else {
+        for (size_t group_idx = 0; group_idx < groups.size(); ++group_idx) {
+            build(group_idx);
+        }
+    }
+}
+
+
+//======================================================================
+//  遅延解析用に残しておく文書
+//  骨格DOM、配列要素の位置とその参照先の入力を、
+//  全てのメッシュが解析されるか破棄されるまで保持する
+struct LazyDocument
+{
+    LazyDocument()
+        : file_()
+        , buffer_()
+        , skeleton_()
+        , payloads_()
+        , strings_()
+        , allocator_(nullptr)
+        , decoder_()
+    {}
+
+    LazyDocument& operator=(const LazyDocument&) = delete;	// コピーの禁止
+    LazyDocument(const LazyDocument&) = delete;
+
+    MappedFile file_;                   //  ファイルを解析した場合のマップ
+    std::vector<char> buffer_;          //  マップできなかった場合の読み込み先
+    xml::XMLDocument skeleton_;
+    StreamPayloads payloads_;
+    std::shared_ptr<StringTable> strings_;
+    tc::Allocator* allocator_;          //  途中のデータの確保に使う
+    MeshDecoder decoder_;               //  解析時の設定
+};
+
+
+}   // unname namespace
+
+
+//======================================================================
+//  遅延解析の状態
+//  メッシュ1つにつき1つ。解析は1回だけ行い、終わったら文書への参照を手放す
+class ColladaMesh::LazyDecoder
+{
+public:
+    LazyDecoder(
+        const std::shared_ptr<LazyDocument>& document,
+        const xml::XMLElement* mesh_node
+    )   : document_(document)
+        , mesh_node_(mesh_node)
+        , once_()
+        , decoded_(false)
+        , result_()
+    {}
+
+    LazyDecoder& operator=(const LazyDecoder&) = delete;	// コピーの禁止
+    LazyDecoder(const LazyDecoder&) = delete;
+
+public:
+    //----------------------------------------------------------------------
+    //  解析
+    //  pool があれば配列の読み込みを並列に行う
+    //  解析中に他のスレッドから呼ばれた場合は終わるまで待つ
+    //  失敗したときは mesh は空のままで、2回目以降も同じ結果を返す
+    Result decode(
+        ColladaMesh& mesh,
+        TaskPool* pool
+    ) {
+        std::call_once(once_, [this, &mesh, pool]() {
+            MeshDecoder decoder(document_->decoder_);
+            decoder.context_.pool_ = pool;
+            decoder.scratch_ = std::make_shared<Arena>(document_->allocator_);
+            result_ = decoder.decode(mesh_node_, mesh);
+
+            //  他のメッシュが使い終わっていれば入力もここで解放される
+            document_.reset();
+            mesh_node_ = nullptr;
+            decoded_.store(true, std::memory_order_release);
+        });
+        return result_;
+    }
+
+    bool isDecoded() const {
+        return decoded_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::shared_ptr<LazyDocument> document_;
+    const xml::XMLElement* mesh_node_;
+    std::once_flag once_;
+    std::atomic<bool> decoded_;
+    Result result_;
+};
+
+
+
+class Parser::Impl
+{
+public:
+Impl()
+    : scenes_()
+    , meshes_()
+    , nodes_()
+    , batches_()
+    , streaming_mode_(false)
+    , interleaved_output_(false)
+    , vertex_cache_optimization_(false)
+    , lazy_decoding_(false)
+    , static_batching_(false)
+    , payloads_()
+    , decoder_()
+    , thread_count_(1)
+    , pool_()
+    , allocator_(nullptr)
+    , arena_()
+    , strings_()
+    , scratch_arena_()
+    , document_()
+    , arenas_()
+    , log_()
+    , statistics_enabled_(false)
+    , statistics_()
+    , profiler_()
+{
+}
+
+~Impl()
+{
+}
+
+    
+//----------------------------------------------------------------------
+//  lazy があればメッシュは解析せず、最初に参照されたときに解析する
+Result parseCollada(
+    const xml::XMLDocument* const doc,
+    const std::shared_ptr<LazyDocument>& lazy
+) {
+    
+    //  ルートノード取得
+    const xml::XMLElement* root_node = doc->RootElement();
+
+    //  確保先
+    //  途中のデータは解析が終わったらまとめて捨てる
+    //  名前は解析結果と同じアリーナに置く
+    if (!arena_) {
+        arena_ = std::make_shared<Arena>(allocator_);
+        strings_.reset(new StringTable(arena_));
+    }
+    if (scratch_arena_ && scratch_arena_.use_count() == 1) {
+        scratch_arena_->rewind();
+    }
+    else {
+        scratch_arena_ = std::make_shared<Arena>(allocator_);
+    }
+    arenas_.scratch_ = scratch_arena_;
+    arenas_.document_ = arena_;
+    arenas_.strings_ = strings_.get();
+
+    //  統計用に解析前の状態を覚えておく
+    ParseProfiler* profiler = profiler_.get();
+    size_t scene_count_before = scenes_.size();
+    size_t document_allocation_before = arena_->getAllocationCount();
+    size_t document_block_before = arena_->getBlockCount();
+    size_t document_allocated_before = arena_->getAllocatedBytes();
+    size_t document_reserved_before = arena_->getReservedBytes();
+    if (profiler) {
+        profiler->add(&tc::ParseStatistics::element_count_, countElements(root_node));
+    }
+
+
+    //  visual_scene解析
+    ScopedPhase visual_scene_phase(profiler, tc::ParseStatistics::PHASE_VISUAL_SCENE);
+    VisualScenes visual_scenes;
+    const xml::XMLElement* library_visual_scene = firstChildElement(
+        root_node,
+        "library_visual_scenes"
+    );
+    const size_t node_count_before = nodes_.size();
+    if (library_visual_scene) {
+        collectVisualSceneNode(visual_scenes, nodes_, library_visual_scene, arenas_);
+    }
+    nodes_.updateWorldMatrices(node_count_before);
+    visual_scene_phase.finish();
+
+    //  マテリアルノード解析
+    ScopedPhase material_phase(profiler, tc::ParseStatistics::PHASE_MATERIAL);
+    Materials materials;
+    const xml::XMLElement* library_materials = firstChildElement(root_node, "library_materials");
+    if (library_materials) {
+        collectMaterialNode(materials, library_materials, arenas_);
+    }
+    
+    //  エフェクトノード解析
+    Effects effects;
+    const xml::XMLElement* library_effects = firstChildElement(root_node, "library_effects");
+    if (library_effects) {
+        collectEffectNode(effects, library_effects, arenas_);
+    }
+
+    //  テクスチャパス解析
+    Images images;
+    const xml::XMLElement* library_images = firstChildElement(root_node, "library_images");
+    if (library_images) {
+        collectImageNode(images, library_images, arenas_);
+    }
+    material_phase.finish();
+
+
+    //  ダンプ
+    for (int i = 0; i < visual_scenes.size(); ++i) {
+        visual_scenes[i]->dump(*strings_);
+    }
+    for (int i = 0; i < materials.size(); ++i) {
+        materials[i]->dump(*strings_);
+    }
+    for (int i = 0; i < effects.size(); ++i) {
+        effects[i]->dump(*strings_);
+    }
+    for (int i = 0; i < images.size(); ++i) {
+        images[i]->dump(*strings_);
+    }
+
+    //  ジオメトリノード解析
+    const xml::XMLElement* library_geometries = firstChildElement(
+        root_node,
+        LIB_GEOMETRY_NODE_NAME
+    );
+
+    //  id索引作成
+    ScopedPhase scene_phase(profiler, tc::ParseStatistics::PHASE_SCENE_BUILD);
+    DocumentIndex index;
+    index.build(library_geometries, materials, effects, images, *strings_);
+    
+    
+    //  シーンとメッシュの枠をドキュメント順に作っておき、
+    //  メッシュの中身は後でまとめて(並列に)解析する
+    //  メッシュノード1つにつきメッシュは1つだけ作り、参照する全シーンで共有する
+    MeshJobs jobs;
+    std::unordered_map<const xml::XMLElement*, size_t> job_index;
+    for (int vs_idx = 0; vs_idx < visual_scenes.size(); ++vs_idx) {
+        std::shared_ptr<VisualSceneData>& vs = visual_scenes[vs_idx];
+        if (vs->type_ != VisualSceneData::TYPE_GEOMETRY) {
+            continue;
+        }
+
+        //  シーン作成
+        std::shared_ptr<ColladaScene> scene = allocateShared<ColladaScene>(arena_);
+
+        //  マトリックス登録
+        const float* world_matrix = nodes_.getWorldMatrix(vs->node_);
+        scene->matrix_.assign(world_matrix, world_matrix + 16);
+        scene->node_ = vs->node_;
+        scenes_.push_back(scene);
+        //  マテリアル設定
+        //  material_ はサブメッシュを区別しない場合に使う最初のもの
+        for (size_t bind_idx = 0; bind_idx < vs->bind_materials_.size(); ++bind_idx) {
+            ColladaScene::MaterialBinding binding;
+            binding.symbol_ = strings_->get(vs->bind_materials_[bind_idx].symbol_);
+            binding.material_ = searchMaterial(vs->bind_materials_[bind_idx].target_, index);
+            scene->material_bindings_.push_back(binding);
+        }
+        if (!scene->material_bindings_.empty()) {
+            scene->material_ = scene->material_bindings_[0].material_;
+        }
+    
+        //  メッシュ情報生成
+        const xml::XMLElement* geometry = index.geometries_.find(vs->url_);
+        if (!geometry) {
+            TINY_COLLADA_LOG_WARNING("geometry %s NOT FOUND.", strings_->get(vs->url_));
+            continue;
+        }
+        const xml::XMLElement* mesh_node = firstChildElement(
+            geometry,
+            MESH_NODE_NAME
+        );
+        while (mesh_node) {
+            //  初めて参照されたメッシュノードならジョブを作る
+            auto found = job_index.find(mesh_node);
+            if (found == job_index.end()) {
+                found = job_index.insert(std::make_pair(mesh_node, jobs.size())).first;
+                jobs.push_back(MeshJob());
+                jobs.back().mesh_node_ = mesh_node;
+                jobs.back().output_ = allocateShared<ColladaMesh>(arena_);
+                meshes_.push_back(jobs.back().output_);
+            }
+
+            //  データ登録
+            scene->meshes_.push_back(jobs[found->second].output_);
+            
+            //  次へ
+            mesh_node = mesh_node->NextSiblingElement(MESH_NODE_NAME);
+        }
+    }
+
+    scene_phase.finish();
+
+    //  メッシュ解析
+    MeshDecoder& decoder = lazy ? lazy->decoder_ : decoder_;
+    decoder.context_.strings_ = strings_.get();
+    decoder.log_ = log_;
+    decoder.interleaved_output_ = interleaved_output_;
+    decoder.vertex_cache_optimization_ = vertex_cache_optimization_;
+    if (lazy) {
+        //  遅延解析ではメッシュノードを覚えておくだけにする
+        lazy->strings_ = strings_;
+        lazy->allocator_ = allocator_;
+        lazy->decoder_.context_.payloads_ = &lazy->payloads_;
+        for (size_t job_idx = 0; job_idx < jobs.size(); ++job_idx) {
+            jobs[job_idx].output_->lazy_ = std::make_shared<ColladaMesh::LazyDecoder>(
+                lazy,
+                jobs[job_idx].mesh_node_
+            );
+        }
+    }
+    else {
+        TaskPool* pool = getTaskPool();
+        decoder_.context_.pool_ = pool;
+        decoder_.scratch_ = arenas_.scratch_;
+        decoder_.profiler_ = profiler;
+        if (pool) {
+            pool->parallelFor(jobs.size(), [this, &jobs](size_t job_idx) {
+                jobs[job_idx].result_ = decoder_.decode(jobs[job_idx].mesh_node_, *jobs[job_idx].output_);
+            });
+        }
+        else {
+            for (size_t job_idx = 0; job_idx < jobs.size(); ++job_idx) {
+                jobs[job_idx].result_ = decoder_.decode(jobs[job_idx].mesh_node_, *jobs[job_idx].output_);
+            }
+        }
+        decoder_.context_.pool_ = nullptr;
+        decoder_.scratch_.reset();
+        decoder_.profiler_ = nullptr;
+    }
+
+    //  統計
+    if (profiler) {
+        const Arena& scratch = *arenas_.scratch_;
+        profiler->add(&tc::ParseStatistics::scene_count_, scenes_.size() - scene_count_before);
+        profiler->add(&tc::ParseStatistics::mesh_count_, jobs.size());
+        profiler->add(&tc::ParseStatistics::material_count_, effects.size());
+        profiler->add(&tc::ParseStatistics::string_count_, strings_->size());
+        profiler->add(
+            &tc::ParseStatistics::arena_allocation_count_,
+            scratch.getAllocationCount() + arena_->getAllocationCount() - document_allocation_before
+        );
+        profiler->add(
+            &tc::ParseStatistics::arena_block_count_,
+            scratch.getBlockCount() + arena_->getBlockCount() - document_block_before
+        );
+        profiler->add(
+            &tc::ParseStatistics::arena_allocated_bytes_,
+            scratch.getAllocatedBytes() + arena_->getAllocatedBytes() - document_allocated_before
+        );
+        profiler->add(
+            &tc::ParseStatistics::arena_reserved_bytes_,
+            scratch.getReservedBytes() + arena_->getReservedBytes() - document_reserved_before
+        );
+    }
+
+    //  途中のデータは残っている参照が消えた時点でまとめて解放される
+    arenas_.scratch_.reset();
+    arenas_.document_.reset();
+    arenas_.strings_ = nullptr;
+    decoder_.context_.strings_ = nullptr;
+
+    //  失敗したメッシュがあれば <geometry> の並びで最初のものを返す
+    for (size_t job_idx = 0; job_idx < jobs.size(); ++job_idx) {
+        if (jobs[job_idx].result_.isFailed()) {
+            return jobs[job_idx].result_;
+        }
+    }
+
+    //  静的バッチ作成
+    if (static_batching_) {
+        if (lazy) {
+            //  バッチには頂点が要るので、遅延解析でもここで全て解析する
+            ColladaMeshes decode_meshes;
+            decode_meshes.reserve(jobs.size());
+            for (size_t job_idx = 0; job_idx < jobs.size(); ++job_idx) {
+                decode_meshes.push_back(jobs[job_idx].output_);
+            }
+            Result result = prefetch(decode_meshes);
+            if (result.isFailed()) {
+                return result;
+            }
+        }
+        ScopedPhase batch_phase(profiler, tc::ParseStatistics::PHASE_BATCH);
+        buildStaticBatches(scenes_, scene_count_before, arena_, getTaskPool(), batches_);
+    }
+    return Result::Code::SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//  並列解析用のタスクプール取得
+//  シングルスレッド設定なら nullptr
+TaskPool* getTaskPool() {
+    unsigned int thread_count = thread_count_;
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+    if (thread_count <= 1) {
+        return nullptr;
+    }
+    if (!pool_ || pool_->threadCount() != thread_count) {
+        pool_.reset(new TaskPool(thread_count));
+    }
+    return pool_.get();
+}
+
+//----------------------------------------------------------------------
+//  ファイル解析
+//  メモリマップして解析する。マップできないファイルは従来どおり読み込む
+Result parseFile(
+    const char* const dae_path
+) {
+    LogScope log_scope(&log_);
+    if (lazy_decoding_) {
+        return parseLazyFile(dae_path);
+    }
+    MappedFile file;
+    ScopedPhase load_phase(profiler_.get(), tc::ParseStatistics::PHASE_FILE_LOAD);
+    bool mapped = file.open(dae_path);
+    load_phase.finish();
+    if (!mapped) {
+        if (streaming_mode_) {
+            return parseStreamingFile(dae_path);
+        }
+        //  読み込みと字句解析は分けられないのでまとめて字句解析とする
+        ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+        xml::XMLError load_error = document_.LoadFile(dae_path);
+        xml_phase.finish();
+        if (load_error != xml::XML_SUCCESS) {
+            TINY_COLLADA_LOG_ERROR("%s load failed. error = %d", dae_path, load_error);
+            document_.Clear();
+            return Result::Code::READ_ERROR;
+        }
+        if (profiler_) {
+            profiler_->add(&tc::ParseStatistics::input_bytes_, getFileSize(dae_path));
+        }
+        return parseDocument();
+    }
+
+    return parseMemory(file.data(), file.size(), &file);
+}
+
+//----------------------------------------------------------------------
+//  遅延解析用のファイル解析
+//  入力はメッシュが全て解析されるまで残すので、マップできなければ全体を読み込む
+Result parseLazyFile(
+    const char* const dae_path
+) {
+    std::shared_ptr<LazyDocument> document = std::make_shared<LazyDocument>();
+    ScopedPhase load_phase(profiler_.get(), tc::ParseStatistics::PHASE_FILE_LOAD);
+    const char* data = nullptr;
+    size_t size = 0;
+    if (document->file_.open(dae_path)) {
+        data = document->file_.data();
+        size = document->file_.size();
+    }
+    else {
+        if (!readFile(dae_path, document->buffer_)) {
+            TINY_COLLADA_LOG_ERROR("%s load failed.", dae_path);
+            return Result::Code::READ_ERROR;
+        }
+        data = document->buffer_.data();
+        size = document->buffer_.size();
+    }
+    load_phase.finish();
+    if (profiler_) {
+        profiler_->add(&tc::ParseStatistics::input_bytes_, size);
+    }
+    return parseLazy(document, data, size);
+}
+
+//----------------------------------------------------------------------
+//  メモリ上のデータを解析
+//  file はマップ元(読み終えたページを手放すのに使う)。無ければ nullptr
+Result parseMemory(
+    const char* const data,
+    const size_t size,
+    MappedFile* file
+) {
+    LogScope log_scope(&log_);
+    if (profiler_) {
+        profiler_->add(&tc::ParseStatistics::input_bytes_, size);
+    }
+    if (lazy_decoding_) {
+        //  入力は呼び出し側のデータをそのまま参照する
+        return parseLazy(std::make_shared<LazyDocument>(), data, size);
+    }
+    if (streaming_mode_) {
+        return parseStreaming(data, size, file);
+    }
+
+    //  tinyxml2 は内部バッファにコピーしてから解析する
+    ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+    xml::XMLError parse_error = document_.Parse(data, size);
+    xml_phase.finish();
+    if (parse_error != xml::XML_SUCCESS) {
+        TINY_COLLADA_LOG_ERROR("xml parse failed. error = %d", parse_error);
+        document_.Clear();
+        return Result::Code::PERSE_ERROR;
+    }
+    return parseDocument();
+}
+
+//----------------------------------------------------------------------
+//  読み込んだ document_ を解析
+//  終わったらテキストを解放する。ノードはプールに戻り、次の解析で使い回される
+Result parseDocument() {
+    Result parse_result = parseCollada(&document_, nullptr);
+    document_.Clear();
+    return parse_result;
+}
+
+//----------------------------------------------------------------------
+//  ストリーミング解析
+//  メモリ上のデータをその場で走査する
+Result parseStreaming(
+    const char* const data,
+    const size_t size,
+    MappedFile* file
+) {
+    const size_t WINDOW_SIZE = 16 * 1024 * 1024;
+
+    //  並列に解析できるときは配列の変換を後回しにして、メッシュ解析時に
+    //  チャンク分割して変換する。その場合は入力を最後まで残しておく
+    bool keep_text = getTaskPool() != nullptr;
+
+    payloads_.clear();
+    StreamScanner scanner(&payloads_, keep_text);
+    ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+    for (size_t offset = 0; offset < size; offset += WINDOW_SIZE) {
+        size_t window = size - offset < WINDOW_SIZE ? size - offset : WINDOW_SIZE;
+        scanner.feed(data + offset, window);
+        if (file && !keep_text) {
+            file->release(offset, window);
+        }
+    }
+    xml_phase.finish();
+    return parseStreamedSkeleton(scanner);
+}
+
+//----------------------------------------------------------------------
+//  ストリーミング解析
+//  ファイルをチャンク単位で読みながら配列要素を数値化する
+Result parseStreamingFile(
+    const char* const dae_path
+) {
+    const size_t CHUNK_SIZE = 1024 * 1024;
+
+    FILE* fp = std::fopen(dae_path, "rb");
+    if (!fp) {
+        TINY_COLLADA_LOG_ERROR("%s open failed.", dae_path);
+        return Result::Code::READ_ERROR;
+    }
+
+    payloads_.clear();
+    StreamScanner scanner(&payloads_, false);
+    std::vector<char> chunk(CHUNK_SIZE);
+    size_t read_size = 0;
+    for (;;) {
+        ScopedPhase load_phase(profiler_.get(), tc::ParseStatistics::PHASE_FILE_LOAD);
+        read_size = std::fread(chunk.data(), 1, CHUNK_SIZE, fp);
+        load_phase.finish();
+        if (read_size == 0) {
+            break;
+        }
+        if (profiler_) {
+            profiler_->add(&tc::ParseStatistics::input_bytes_, read_size);
+        }
+        ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+        scanner.feed(chunk.data(), read_size);
+    }
+    bool read_failed = std::ferror(fp) != 0;
+    std::fclose(fp);
+    if (read_failed) {
+        TINY_COLLADA_LOG_ERROR("%s read failed.", dae_path);
+        payloads_.clear();
+        return Result::Code::READ_ERROR;
+    }
+    return parseStreamedSkeleton(scanner);
+}
+
+//----------------------------------------------------------------------
+//  遅延解析
+//  ストリーミング解析と同じ走査で配列要素の範囲だけ記録し、骨格を解析する
+Result parseLazy(
+    const std::shared_ptr<LazyDocument>& document,
+    const char* const data,
+    const size_t size
+) {
+    StreamScanner scanner(&document->payloads_, true);
+    ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+    scanner.feed(data, size);
+    xml_phase.finish();
+    Result skeleton_result = parseSkeleton(scanner, document->skeleton_);
+    if (skeleton_result.isFailed()) {
+        return skeleton_result;
+    }
+    return parseCollada(&document->skeleton_, document);
+}
+
+//----------------------------------------------------------------------
+//  ストリーミングで残った骨格XMLを解析
+Result parseStreamedSkeleton(
+    StreamScanner& scanner
+) {
+    Result skeleton_result = parseSkeleton(scanner, document_);
+    if (skeleton_result.isFailed()) {
+        document_.Clear();
+        payloads_.clear();
+        return skeleton_result;
+    }
+
+    //  解析
+    decoder_.context_.payloads_ = &payloads_;
+    Result parse_result = parseDocument();
+    decoder_.context_.payloads_ = nullptr;
+    payloads_.clear();
+    return parse_result;
+}
+
+//----------------------------------------------------------------------
+//  走査し終えた骨格XMLをDOMにする
+//  tinyxml2は内部にコピーを持つので骨格は即座に解放する
+Result parseSkeleton(
+    StreamScanner& scanner,
+    xml::XMLDocument& doc
+) {
+    ScopedPhase xml_phase(profiler_.get(), tc::ParseStatistics::PHASE_XML_PARSE);
+    if (!scanner.finish()) {
+        TINY_COLLADA_LOG_ERROR("stream scan failed.");
+        return Result::Code::PERSE_ERROR;
+    }
+
+    std::string& skeleton = scanner.skeleton();
+    xml::XMLError parse_error = doc.Parse(skeleton.data(), skeleton.size());
+    std::string().swap(skeleton);
+    xml_phase.finish();
+    if (parse_error != xml::XML_SUCCESS) {
+        TINY_COLLADA_LOG_ERROR("xml parse failed. error = %d", parse_error);
+        return Result::Code::PERSE_ERROR;
+    }
+    return Result::Code::SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//  メッシュリスト取得
+const ColladaScenes* getScenes() const {
+    return &scenes_;
+}
+
+//----------------------------------------------------------------------
+//  ノード階層取得
+const ColladaNodes* getNodes() const {
+    return &nodes_;
+}
+
+//----------------------------------------------------------------------
+//  静的バッチ取得
+const ColladaBatches* getBatches() const {
+    return &batches_;
+}
+
+//----------------------------------------------------------------------
+//  ジオメトリ単位のメッシュ一覧
+const ColladaMeshes* getMeshList() const {
+    return &meshes_;
+}
+
+//----------------------------------------------------------------------
+//  解析結果を消して次の解析に備える
+//  解析結果がどこからも参照されていなければアリーナと文字列表を巻き戻して使い回す
+//  参照が残っていれば、その寿命は参照側に任せて次の解析では新しく作る
+void reset() {
+    scenes_.clear();
+    meshes_.clear();
+    nodes_.clear();
+    batches_.clear();
+    statistics_.clear();
+    if (!arena_) {
+        return;
+    }
+    //  arena_ を参照しているのが自分と文字列表だけなら誰も使っていない
+    if (strings_.use_count() == 1 && arena_.use_count() == 2) {
+        arena_->rewind();
+        strings_->clear();
+    }
+    else {
+        arena_.reset();
+        strings_.reset();
+    }
+}
+
+//----------------------------------------------------------------------
+//  ストリーミング解析の設定
+void setStreamingMode(
+    bool enable
+) {
+    streaming_mode_ = enable;
+}
+
+bool isStreamingMode() const {
+    return streaming_mode_;
+}
+
+//----------------------------------------------------------------------
+//  解析スレッド数の設定
+void setThreadCount(
+    unsigned int thread_count
+) {
+    thread_count_ = thread_count;
+}
+
+unsigned int getThreadCount() const {
+    return thread_count_;
+}
+
+//----------------------------------------------------------------------
+//  インターリーブ出力モードの設定
+void setInterleavedOutput(
+    bool enable
+) {
+    interleaved_output_ = enable;
+}
+
+bool isInterleavedOutput() const {
+    return interleaved_output_;
+}
+
+//----------------------------------------------------------------------
+//  頂点キャッシュ最適化の設定
+void setVertexCacheOptimization(
+    bool enable
+) {
+    vertex_cache_optimization_ = enable;
+}
+
+bool isVertexCacheOptimization() const {
+    return vertex_cache_optimization_;
+}
+
+//----------------------------------------------------------------------
+//  遅延解析の設定
+void setLazyDecoding(
+    bool enable
+) {
+    lazy_decoding_ = enable;
+}
+
+bool isLazyDecoding() const {
+    return lazy_decoding_;
+}
+
+//----------------------------------------------------------------------
+//  静的バッチの設定
+void setStaticBatching(
+    bool enable
+) {
+    static_batching_ = enable;
+}
+
+bool isStaticBatching() const {
+    return static_batching_;
+}
+
+//----------------------------------------------------------------------
+//  遅延解析のメッシュをまとめて解析
+//  失敗したメッシュがあれば meshes の並びで最初のもののエラーを返す
+Result prefetch(
+    const ColladaMeshes& meshes
+) {
+    TaskPool* pool = getTaskPool();
+    std::vector<Result> results(meshes.size());
+    auto decode = [&meshes, &results, pool](size_t mesh_idx) {
+        const ColladaMesh* mesh = meshes[mesh_idx].get();
+        if (mesh && mesh->lazy_) {
+            results[mesh_idx] = mesh->lazy_->decode(const_cast<ColladaMesh&>(*mesh), pool);
+        }
+    };
+    if (pool) {
+        pool->parallelFor(meshes.size(), decode);
+    }
+    else {
+        for (size_t mesh_idx = 0; mesh_idx < meshes.size(); ++mesh_idx) {
+            decode(mesh_idx);
+        }
+    }
+    for (size_t mesh_idx = 0; mesh_idx < results.size(); ++mesh_idx) {
+        if (results[mesh_idx].isFailed()) {
+            return results[mesh_idx];
+        }
+    }
+    return Result::Code::SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//  アロケータの設定
+//  次の解析から新しいアリーナで使われる
+void setAllocator(
+    tc::Allocator* allocator
+) {
+    allocator_ = allocator;
+    arena_.reset();
+    strings_.reset();
+    scratch_arena_.reset();
+}
+
+tc::Allocator* getAllocator() const {
+    return allocator_;
+}
+
+//----------------------------------------------------------------------
+//  ログ設定
+void setLogSink(
+    tc::LogSink sink,
+    void* user_data
+) {
+    log_.sink_ = sink;
+    log_.user_data_ = user_data;
+}
+
+void setLogLevel(
+    tc::LogLevel level
+) {
+    log_.level_ = level;
+}
+
+tc::LogLevel getLogLevel() const {
+    return log_.level_;
+}
+
+//----------------------------------------------------------------------
+//  解析統計
+void setStatisticsEnabled(
+    bool enable
+) {
+    statistics_enabled_ = enable;
+}
+
+bool isStatisticsEnabled() const {
+    return statistics_enabled_;
+}
+
+const tc::ParseStatistics& getStatistics() const {
+    return statistics_;
+}
+
+//----------------------------------------------------------------------
+//  解析の前後で呼ぶ
+//  無効なら前回の統計は消しておく
+void beginStatistics() {
+    if (statistics_enabled_) {
+        profiler_.reset(new ParseProfiler(&statistics_));
+    }
+    else {
+        statistics_.clear();
+    }
+}
+
+void endStatistics() {
+    if (profiler_) {
+        profiler_->finish();
+        profiler_.reset();
+    }
+}
+
+//----------------------------------------------------------------------
+//  バイナリキャッシュ書き出し
+Result writeCache(
+    const char* const cache_path,
+    const char* const source_path
+) const {
+    uint64_t source_size = 0;
+    uint64_t source_hash = 0;
+    if (!hashFile(source_path, &source_size, &source_hash)) {
+        return Result::Code::READ_ERROR;
+    }
+
+    std::vector<char> data;
+    buildSceneCache(scenes_, meshes_, nodes_, source_size, source_hash, data);
+
+    FILE* fp = std::fopen(cache_path, "wb");
+    if (!fp) {
+        return Result::Code::WRITE_ERROR;
+    }
+    size_t written = std::fwrite(data.data(), 1, data.size(), fp);
+    if (std::fclose(fp) != 0 || written != data.size()) {
+        return Result::Code::WRITE_ERROR;
+    }
+    return Result::Code::SUCCESS;
+}
+
+
+private:
+    ColladaScenes scenes_;
+    ColladaMeshes meshes_;
+    ColladaNodes nodes_;
+    ColladaBatches batches_;
+    bool streaming_mode_;
+    bool interleaved_output_;
+    bool vertex_cache_optimization_;
+    bool lazy_decoding_;
+    bool static_batching_;
+    StreamPayloads payloads_;
+    MeshDecoder decoder_;               //  解析中の設定(遅延解析でなければ)
+    unsigned int thread_count_;
+    std::unique_ptr<TaskPool> pool_;
+    tc::Allocator* allocator_;
+    std::shared_ptr<Arena> arena_;      //  解析結果の確保先
+    std::shared_ptr<StringTable> strings_;  //  名前の登録先(arena_に置く。遅延解析中のメッシュと共有)
+    std::shared_ptr<Arena> scratch_arena_;  //  途中のデータの確保先(巻き戻して使い回す)
+    xml::XMLDocument document_;         //  ノードのプールを使い回すため解析ごとに作り直さない
+    ParseArenas arenas_;                //  解析中だけ有効
+    LogContext log_;
+    bool statistics_enabled_;
+    tc::ParseStatistics statistics_;
+    std::unique_ptr<ParseProfiler> profiler_;   //  統計が有効な解析中だけある
+};  // class Parser::Impl
+
+
+
+//======================================================================
+//  解析統計
+
+//----------------------------------------------------------------------
+void ParseStatistics::clear()
+{
+    total_seconds_ = 0.0;
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        phase_seconds_[i] = 0.0;
+    }
+    input_bytes_ = 0;
+    element_count_ = 0;
+    scene_count_ = 0;
+    mesh_count_ = 0;
+    material_count_ = 0;
+    source_count_ = 0;
+    float_count_ = 0;
+    index_count_ = 0;
+    vertex_count_ = 0;
+    string_count_ = 0;
+    arena_allocation_count_ = 0;
+    arena_block_count_ = 0;
+    arena_allocated_bytes_ = 0;
+    arena_reserved_bytes_ = 0;
+    events_.clear();
+}
+
+//----------------------------------------------------------------------
+const char* ParseStatistics::getPhaseName(
+    Phase phase
+) {
+    const char* PHASE_NAME[PHASE_COUNT] = {
+        "file_load",
+        "xml_parse",
+        "visual_scene",
+        "material",
+        "scene_build",
+        "source_decode",
+        "triangulate",
+        "index_setup",
+        "attribute_remap",
+        "vertex_cache",
+        "batch"
+    };
+    if (phase < 0 || phase >= PHASE_COUNT) {
+        return "unknown";
+    }
+    return PHASE_NAME[phase];
+}
+
+//----------------------------------------------------------------------
+//  Chrome trace 書き出し
+//  区間は "X"(complete)イベント、件数は otherData に入れる
+Result ParseStatistics::writeChromeTrace(
+    const char* const path
+) const {
+    FILE* fp = std::fopen(path, "w");
+    if (!fp) {
+        return Result::Code::WRITE_ERROR;
+    }
+
+    std::fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const Event& event = events_[i];
+        std::fprintf(fp,
+            "{\"name\":\"%s\",\"cat\":\"tiny_collada\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+            getPhaseName(event.phase_),
+            event.thread_,
+            event.begin_,
+            event.duration_,
+            i + 1 < events_.size() ? "," : ""
+        );
+    }
+    std::fprintf(fp, "],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\n");
+    std::fprintf(fp, "\"total_seconds\":%f,\n", total_seconds_);
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        std::fprintf(fp, "\"%s_seconds\":%f,\n", getPhaseName(static_cast<Phase>(i)), phase_seconds_[i]);
+    }
+    const struct {
+        const char* name_;
+        uint64_t value_;
+    } COUNTERS[] = {
+        {"input_bytes", input_bytes_},
+        {"element_count", element_count_},
+        {"scene_count", scene_count_},
+        {"mesh_count", mesh_count_},
+        {"material_count", material_count_},
+        {"source_count", source_count_},
+        {"float_count", float_count_},
+        {"index_count", index_count_},
+        {"vertex_count", vertex_count_},
+        {"string_count", string_count_},
+        {"arena_allocation_count", arena_allocation_count_},
+        {"arena_block_count", arena_block_count_},
+        {"arena_allocated_bytes", arena_allocated_bytes_},
+        {"arena_reserved_bytes", arena_reserved_bytes_}
+    };
+    const size_t COUNTER_NUM = sizeof(COUNTERS) / sizeof(COUNTERS[0]);
+    for (size_t i = 0; i < COUNTER_NUM; ++i) {
+        std::fprintf(fp, "\"%s\":%llu%s\n",
+            COUNTERS[i].name_,
+            static_cast<unsigned long long>(COUNTERS[i].value_),
+            i + 1 < COUNTER_NUM ? "," : ""
+        );
+    }
+    std::fprintf(fp, "}}\n");
+
+    bool write_failed = std::ferror(fp) != 0;
+    if (std::fclose(fp) != 0 || write_failed) {
+        return Result::Code::WRITE_ERROR;
+    }
+    return Result::Code::SUCCESS;
+}
+
+
+//----------------------------------------------------------------------
+Parser::Parser()
+    : impl_(nullptr)
+{
+    impl_.reset(new Impl());
+}
+
+//----------------------------------------------------------------------
+Parser::~Parser()
+{
+}
+
+//----------------------------------------------------------------------
+Result Parser::parse(
+    const char* const dae_path
+) {
+    //  .daeをメモリマップして解析
+    impl_->beginStatistics();
+    Result result = impl_->parseFile(dae_path);
+    impl_->endStatistics();
+    return result;
+}
+
+//----------------------------------------------------------------------
+Result Parser::parse(
+    const char* const data,
+    size_t size
+) {
+    //  呼び出し側が持っているデータをそのまま解析
+    if (!data || size == 0) {
+        return Result::Code::READ_ERROR;
+    }
+    impl_->beginStatistics();
+    Result result = impl_->parseMemory(data, size, nullptr);
+    impl_->endStatistics();
+    return result;
+}
+
+//----------------------------------------------------------------------
+void Parser::reset()
+{
+    impl_->reset();
+}
+
+//----------------------------------------------------------------------
+void Parser::setStreamingMode(
+    bool enable
+) {
+    impl_->setStreamingMode(enable);
+}
+
+//----------------------------------------------------------------------
+bool Parser::isStreamingMode() const
+{
+    return impl_->isStreamingMode();
+}
+
+//----------------------------------------------------------------------
+void Parser::setThreadCount(
+    unsigned int thread_count
+) {
+    impl_->setThreadCount(thread_count);
 }
 
+//----------------------------------------------------------------------
+unsigned int Parser::getThreadCount() const
+{
+    return impl_->getThreadCount();
+}
 
 //----------------------------------------------------------------------
-//  エフェクトノード読み込み
-void collectEffectNode(
-    Effects& out,
-    const xml::XMLElement* library_effects
+void Parser::setInterleavedOutput(
+    bool enable
 ) {
+    impl_->setInterleavedOutput(enable);
+}
 
-    const xml::XMLElement* effect = firstChildElement(library_effects, "effect");
+//----------------------------------------------------------------------
+bool Parser::isInterleavedOutput() const
+{
+    return impl_->isInterleavedOutput();
+}
 
-    while (effect) {
+//----------------------------------------------------------------------
+void Parser::setVertexCacheOptimization(
+    bool enable
+) {
+    impl_->setVertexCacheOptimization(enable);
+}
 
-        std::shared_ptr<EffectData> ed = std::make_shared<EffectData>();
-        ed->setupEffectData(effect);        
-        out.push_back(ed);
-        effect = effect->NextSiblingElement("effect");
-    }
+//----------------------------------------------------------------------
+bool Parser::isVertexCacheOptimization() const
+{
+    return impl_->isVertexCacheOptimization();
+}
 
+//----------------------------------------------------------------------
+void Parser::setLazyDecoding(
+    bool enable
+) {
+    impl_->setLazyDecoding(enable);
 }
 
+//----------------------------------------------------------------------
+bool Parser::isLazyDecoding() const
+{
+    return impl_->isLazyDecoding();
+}
 
 //----------------------------------------------------------------------
-//  画像パス読み込み
-void collectImageNode(
-    Images& out,
-    const xml::XMLElement* library_images
+Result Parser::prefetch(
+    const ColladaMeshes& meshes
 ) {
-    const xml::XMLElement* image = firstChildElement(library_images, "image");
+    return impl_->prefetch(meshes);
+}
 
-    while (image) {
-        //  ID取得
-        std::shared_ptr<ImageData> image_data = std::make_shared<ImageData>();
-        image_data->id_ = getElementAttribute(image, "id");
+//----------------------------------------------------------------------
+void Parser::setStaticBatching(
+    bool enable
+) {
+    impl_->setStaticBatching(enable);
+}
 
+//----------------------------------------------------------------------
+bool Parser::isStaticBatching() const
+{
+    return impl_->isStaticBatching();
+}
 
-        //  テクスチャパス取得
-        const xml::XMLElement* init_from = firstChildElement(image, "init_from");
-        image_data->init_from_ = init_from->GetText();
-        
+//----------------------------------------------------------------------
+void Parser::setAllocator(
+    Allocator* allocator
+) {
+    impl_->setAllocator(allocator);
+}
 
-        //  次へ
-        out.push_back(image_data);
-        image = image->NextSiblingElement("image");
-    }
+//----------------------------------------------------------------------
+Allocator* Parser::getAllocator() const
+{
+    return impl_->getAllocator();
+}
 
+//----------------------------------------------------------------------
+void Parser::setLogSink(
+    LogSink sink,
+    void* user_data
+) {
+    impl_->setLogSink(sink, user_data);
 }
 
+//----------------------------------------------------------------------
+void Parser::setLogLevel(
+    LogLevel level
+) {
+    impl_->setLogLevel(level);
+}
 
 //----------------------------------------------------------------------
-//  インデックス読み込み
-void collectIndices(
-    const xml::XMLElement* mesh_node,
-    tc::Indices& indices
-) {        
-    const xml::XMLElement* primitive_node = getPrimitiveNode(mesh_node);
+LogLevel Parser::getLogLevel() const
+{
+    return impl_->getLogLevel();
+}
 
-    //  インデックス値読み込み
-    if (primitive_node) {
-        const xml::XMLElement* index_node = firstChildElement(primitive_node, INDEX_NODE_NAME);
-        const char* text = index_node->GetText();
-        readArray(text, &indices);
-    }
-    
-    TINY_COLLADA_TRACE("Collect index size = %lu\n", indices.size());
+//----------------------------------------------------------------------
+void Parser::setStatisticsEnabled(
+    bool enable
+) {
+    impl_->setStatisticsEnabled(enable);
 }
 
 //----------------------------------------------------------------------
-//  面の頂点数読み込み
-void collectFaceCount(
-    const xml::XMLElement* mesh_node,
-    std::vector<char>& face_count
-) {        
-    const xml::XMLElement* primitive_node = getPrimitiveNode(mesh_node);
+bool Parser::isStatisticsEnabled() const
+{
+    return impl_->isStatisticsEnabled();
+}
 
-    //  インデックス値読み込み
-    if (primitive_node) {
-        const xml::XMLElement* vcount_node = primitive_node->FirstChildElement("vcount");
-        if (vcount_node) {
-            char* text = const_cast<char*>(vcount_node->GetText());
-            readArray(text, &face_count);
-        }
-    }
-    
-    TINY_COLLADA_TRACE("Collect face count size = %lu\n", face_count.size());
+//----------------------------------------------------------------------
+const ParseStatistics& Parser::getStatistics() const
+{
+    return impl_->getStatistics();
 }
 
+//----------------------------------------------------------------------
+const ColladaMeshes* Parser::meshes() const
+{
+    return impl_->getMeshList();
+}
 
+//----------------------------------------------------------------------
+const ColladaScenes* Parser::scenes() const
+{
+    return impl_->getScenes();
+}
 
 //----------------------------------------------------------------------
-//  メッシュノードのソース情報を取得
-void collectMeshSources(
-    std::vector<SourceData>& out,
-    const xml::XMLElement* mesh
-){
-    //  ソースノードを総なめして情報を保存
-    const xml::XMLElement* target = firstChildElement(mesh, SOURCE_NODE_NAME);
-    while (target) {
-        SourceData data;
-        //  ID保存
-        data.id_ = getElementAttribute(target, ID_ATTR_NAME);
-        
-        //  配列データ保存
-        readSourceNode(target, &data);
+const ColladaNodes* Parser::nodes() const
+{
+    return impl_->getNodes();
+}
 
-        //  コンテナに追加
-        out.push_back(data);
-        
-        //  次へ
-        target = target->NextSiblingElement(SOURCE_NODE_NAME);
-    }
+//----------------------------------------------------------------------
+const ColladaBatches* Parser::batches() const
+{
+    return impl_->getBatches();
 }
 
 //----------------------------------------------------------------------
-//  インプット情報を取得
-void collectInputNodeData(
-    std::vector<InputData>& out,
-    const xml::XMLElement* input_node
-) {
-    while (input_node) {
-        InputData input;
-        //  sourceアトリビュートを取得
-        const char* attr_source = getElementAttribute(input_node, SOURCE_NODE_NAME);
-        //  source_nameの先頭の#を取る
-        if (attr_source[0] == '#') {
-            attr_source = &attr_source[1];
-        }
-        input.source_ = attr_source;
-        input.semantic_ = getElementAttribute(input_node, SEMANTIC_ATTR_NAME);
-        
-        //  offsetアトリビュートを取得
-        const char* attr_offset = getElementAttribute(input_node, OFFSET_ATTR_NAME);
-        int offset = 0;
-        if (attr_offset) {
-            offset = atoi(attr_offset);
-        }
-        input.offset_ = offset;
+Result Parser::writeCache(
+    const char* const cache_path,
+    const char* const source_path
+) const {
+    return impl_->writeCache(cache_path, source_path);
+}
 
 
-        //  インプットノード保存
-        out.push_back(input);
 
-        //  次へ
-        input_node = input_node->NextSiblingElement(INPUT_NODE_NAME);
-    }
- 
-}
+//======================================================================
+//  複数ファイルの一括解析
+//  スレッドごとに Parser を1つ持ち、reset して使い回す
+//  ファイルは paths の順に取り出し、合計サイズが上限を超えるなら他のファイルが終わるのを待つ
+const uint64_t BATCH_DEFAULT_MAX_IN_FLIGHT_BYTES = 1024ull * 1024 * 1024;
 
-//----------------------------------------------------------------------
-//  インプット情報を取得
-void collectMeshInputs(
-    std::vector<InputData>& out,
-    const xml::XMLElement* mesh
-){
-    //  primitiveノード
-    const xml::XMLElement* primitive_node = getPrimitiveNode(mesh);
-	if (!primitive_node) {
-		return;
-	}
-    const xml::XMLElement* prim_input_node = firstChildElement(primitive_node, INPUT_NODE_NAME);
-    collectInputNodeData(out, prim_input_node);
-    
-    //  vertices_node
-    const xml::XMLElement* vertices =  firstChildElement(mesh, VERTICES_NODE_NAME);
-    const xml::XMLElement* vert_input_node = firstChildElement(vertices, INPUT_NODE_NAME);
-    collectInputNodeData(out, vert_input_node);
+class BatchParser::Impl
+{
+public:
+Impl()
+    : thread_count_(0)
+    , max_in_flight_bytes_(BATCH_DEFAULT_MAX_IN_FLIGHT_BYTES)
+    , setup_(nullptr)
+    , setup_user_data_(nullptr)
+{
 }
 
-std::shared_ptr<tc::ColladaMaterial> searchMaterial(
-    const char* bind_material,
-    const Materials& materials,
-    const Effects& effects
+//----------------------------------------------------------------------
+//  解析
+Result parse(
+    const char* const* paths,
+    size_t count,
+    Callback callback,
+    void* user_data
 ) {
-    //  マテリアルを探す
-    const char* effect_url = nullptr;
-    for (int i = 0; i < materials.size(); ++i) {
-        if (std::strncmp(materials[i]->id_, bind_material, 64) == 0) {
-            //  あった
-            effect_url = materials[i]->url_;
-            break;
-        }
+    Batch batch;
+    batch.paths_ = paths;
+    batch.count_ = count;
+    batch.callback_ = callback;
+    batch.user_data_ = user_data;
+    batch.sizes_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        batch.sizes_[i] = getFileSize(paths[i]);
     }
 
-    if (!effect_url) {
-        //  指定マテリアルは存在しなかった
-        return nullptr;
+    unsigned int thread_count = thread_count_;
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (thread_count > count) {
+        thread_count = static_cast<unsigned int>(count);
     }
 
-    //  エフェクトを探す
-    std::shared_ptr<tc::ColladaMaterial> mat = nullptr;
-    for (int i = 0; i < effects.size(); ++i) {
-        if (std::strncmp(effect_url, effects[i]->id_, 64) == 0) {
-            //  あった
-            mat = effects[i]->material_;
-        }
+    //  呼び出し側スレッドも1つ分として働く
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < thread_count; ++i) {
+        workers.push_back(std::thread(&Impl::workerMain, this, &batch));
+    }
+    workerMain(&batch);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
     }
 
+    if (batch.exception_) {
+        std::rethrow_exception(batch.exception_);
+    }
+    return batch.result_;
+}
 
-    
-    return mat;
+//----------------------------------------------------------------------
+//  設定
+void setThreadCount(
+    unsigned int thread_count
+) {
+    thread_count_ = thread_count;
+}
+
+unsigned int getThreadCount() const {
+    return thread_count_;
+}
+
+void setMaxInFlightBytes(
+    uint64_t bytes
+) {
+    max_in_flight_bytes_ = bytes;
+}
+
+uint64_t getMaxInFlightBytes() const {
+    return max_in_flight_bytes_;
 }
 
+void setParserSetup(
+    Setup setup,
+    void* user_data
+) {
+    setup_ = setup;
+    setup_user_data_ = user_data;
+}
 
 
-void transposeMatrix(std::vector<float>& mtx)
+private:
+//----------------------------------------------------------------------
+//  1回の parse で共有する状態
+struct Batch
 {
-    for (int x = 0; x < 4; ++x) {
-        for (int y = x; y < 4;++y) {
-            if (x == y) {
-                continue;
+    Batch()
+        : paths_(nullptr)
+        , count_(0)
+        , callback_(nullptr)
+        , user_data_(nullptr)
+        , sizes_()
+        , mutex_()
+        , cond_()
+        , next_(0)
+        , in_flight_bytes_(0)
+        , result_()
+        , failed_index_(0)
+        , exception_()
+    {}
+
+    const char* const* paths_;
+    size_t count_;
+    Callback callback_;
+    void* user_data_;
+    std::vector<uint64_t> sizes_;
+
+    //  以下は mutex_ で守る
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    size_t next_;                   //  次に解析するファイル
+    uint64_t in_flight_bytes_;      //  解析中のファイルの合計サイズ
+    Result result_;
+    size_t failed_index_;
+    std::exception_ptr exception_;
+};
+
+//----------------------------------------------------------------------
+//  解析スレッド
+//  取り出せるファイルが無くなるか、どこかで例外が出たら終わる
+void workerMain(
+    Batch* batch
+) {
+    Parser parser;
+    if (setup_) {
+        setup_(parser, setup_user_data_);
+    }
+
+    for (;;) {
+        size_t index = 0;
+        uint64_t size = 0;
+        {
+            std::unique_lock<std::mutex> lock(batch->mutex_);
+            for (;;) {
+                if (batch->next_ >= batch->count_ || batch->exception_) {
+                    return;
+                }
+                //  他に解析中のものが無ければ上限を超えるファイルでも始める
+                size = batch->sizes_[batch->next_];
+                if (batch->in_flight_bytes_ == 0 || batch->in_flight_bytes_ + size <= max_in_flight_bytes_) {
+                    break;
+                }
+                batch->cond_.wait(lock);
             }
-            int xy = x * 4 + y;
-            int yx = y * 4 + x;
-            std::swap(mtx[xy], mtx[yx]);
+            index = batch->next_++;
+            batch->in_flight_bytes_ += size;
         }
-    }
 
+        Result result;
+        std::exception_ptr exception;
+        try {
+            result = parser.parse(batch->paths_[index]);
+            if (batch->callback_) {
+                batch->callback_(index, batch->paths_[index], result, parser.scenes(), batch->user_data_);
+            }
+        }
+        catch (...) {
+            exception = std::current_exception();
+        }
+        //  結果を手放してから次のファイルを始める
+        parser.reset();
+
+        {
+            std::lock_guard<std::mutex> lock(batch->mutex_);
+            batch->in_flight_bytes_ -= size;
+            if (exception && !batch->exception_) {
+                batch->exception_ = exception;
+            }
+            if (result.isFailed() && (batch->result_.isSucceed() || index < batch->failed_index_)) {
+                batch->result_ = result;
+                batch->failed_index_ = index;
+            }
+        }
+        batch->cond_.notify_all();
+    }
 }
 
-}   // unname namespace
-
-
-namespace tc {
 
+private:
+    unsigned int thread_count_;
+    uint64_t max_in_flight_bytes_;
+    Setup setup_;
+    void* setup_user_data_;
+};  // class BatchParser::Impl
 
 
-class Parser::Impl
+//----------------------------------------------------------------------
+BatchParser::BatchParser()
+    : impl_(nullptr)
 {
-public:
-Impl()
-    : scenes_()
+    impl_.reset(new Impl());
+}
+
+//----------------------------------------------------------------------
+BatchParser::~BatchParser()
 {
 }
 
-~Impl()
+//----------------------------------------------------------------------
+void BatchParser::setThreadCount(
+    unsigned int thread_count
+) {
+    impl_->setThreadCount(thread_count);
+}
+
+//----------------------------------------------------------------------
+unsigned int BatchParser::getThreadCount() const
 {
+    return impl_->getThreadCount();
 }
 
-    
 //----------------------------------------------------------------------
-Result parseCollada(
-    const xml::XMLDocument* const doc
+void BatchParser::setMaxInFlightBytes(
+    uint64_t bytes
 ) {
-    
-    //  ルートノード取得
-    const xml::XMLElement* root_node = doc->RootElement();
+    impl_->setMaxInFlightBytes(bytes);
+}
 
+//----------------------------------------------------------------------
+uint64_t BatchParser::getMaxInFlightBytes() const
+{
+    return impl_->getMaxInFlightBytes();
+}
 
-    //  visual_scene解析
-    VisualScenes visual_scenes;
-    const xml::XMLElement* library_visual_scene = firstChildElement(
-        root_node,
-        "library_visual_scenes"
-    );
-    collectVisualSceneNode(visual_scenes, library_visual_scene);
+//----------------------------------------------------------------------
+void BatchParser::setParserSetup(
+    Setup setup,
+    void* user_data
+) {
+    impl_->setParserSetup(setup, user_data);
+}
 
-    //  マテリアルノード解析
-    Materials materials;
-    const xml::XMLElement* library_materials = firstChildElement(root_node, "library_materials");
-    if (library_materials) {
-        collectMaterialNode(materials, library_materials);
-    }
-    
-    //  エフェクトノード解析
-    Effects effects;
-    const xml::XMLElement* library_effects = firstChildElement(root_node, "library_effects");
-    if (library_effects) {
-        collectEffectNode(effects, library_effects);
+//----------------------------------------------------------------------
+Result BatchParser::parse(
+    const char* const* paths,
+    size_t count,
+    Callback callback,
+    void* user_data
+) {
+    if (!paths || count == 0) {
+        return Result::Code::SUCCESS;
     }
+    return impl_->parse(paths, count, callback, user_data);
+}
+
+
+
+//======================================================================
+//  バイナリキャッシュ読み込み
+class SceneCache::Impl
+{
+public:
+Impl()
+    : file_()
+    , buffer_()
+    , data_(nullptr)
+    , size_(0)
+    , header_(nullptr)
+{
+}
 
-    //  テクスチャパス解析
-    Images images;
-    const xml::XMLElement* library_images = firstChildElement(root_node, "library_images");
-    if (library_images) {
-        collectImageNode(images, library_images);
-    }
+~Impl()
+{
+}
 
+//----------------------------------------------------------------------
+//  キャッシュを開く
+Result open(
+    const char* const cache_path,
+    const char* const source_path
+) {
+    close();
 
-    //  ダンプ
-    for (int i = 0; i < visual_scenes.size(); ++i) {
-        visual_scenes[i]->dump();
-    }
-    for (int i = 0; i < materials.size(); ++i) {
-        materials[i]->dump();
+    //  マップできなければ読み込む
+    if (file_.open(cache_path)) {
+        data_ = file_.data();
+        size_ = file_.size();
     }
-    for (int i = 0; i < effects.size(); ++i) {
-        effects[i]->dump();
+    else {
+        FILE* fp = std::fopen(cache_path, "rb");
+        if (!fp) {
+            return Result::Code::READ_ERROR;
+        }
+        std::string data;
+        char chunk[64 * 1024];
+        size_t read_size = 0;
+        while ((read_size = std::fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+            data.append(chunk, read_size);
+        }
+        std::fclose(fp);
+        //  配列を直接参照できるよう8バイト境界のバッファに置く
+        buffer_.resize((data.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        if (!data.empty()) {
+            std::memcpy(buffer_.data(), data.data(), data.size());
+        }
+        data_ = reinterpret_cast<const char*>(buffer_.data());
+        size_ = data.size();
     }
-    for (int i = 0; i < images.size(); ++i) {
-        images[i]->dump();
+
+    if (!validate()) {
+        close();
+        return Result::Code::CACHE_MISMATCH;
     }
 
-    //  ジオメトリノード解析
-    const xml::XMLElement* library_geometries = firstChildElement(
-        root_node,
-        LIB_GEOMETRY_NODE_NAME
-    );
-    
-    
-    for (int vs_idx = 0; vs_idx < visual_scenes.size(); ++vs_idx) {
-        std::shared_ptr<VisualSceneData>& vs = visual_scenes[vs_idx];
-        if (vs->type_ != VisualSceneData::TYPE_GEOMETRY) {
-            continue;
+    //  元の.daeとの照合
+    if (source_path) {
+        uint64_t source_size = 0;
+        uint64_t source_hash = 0;
+        if (!hashFile(source_path, &source_size, &source_hash)) {
+            close();
+            return Result::Code::READ_ERROR;
         }
-
-        const xml::XMLElement* geometry = firstChildElement(
-            library_geometries,
-            GEOMETRY_NODE_NAME
-        );
-
-        //  シーン作成
-        std::shared_ptr<ColladaScene> scene = std::make_shared<ColladaScene>();
-
-        //  マトリックス登録
-        transposeMatrix(vs->matrix_);
-        scene->matrix_ = vs->matrix_;
-        scenes_.push_back(scene);
-        //  マテリアル設定
-        scene->material_ = searchMaterial(vs->bind_material_, materials, effects);
-    
-        //  メッシュ情報生成
-        while (geometry) {
-            const char* geometry_id = getElementAttribute(geometry, "id");
-            
-            printf("a%s ", geometry_id);
-            printf("b%s" , vs->url_);
-            if (std::strncmp(vs->url_, geometry_id, STRING_COMP_SIZE) != 0) {
-                //  次のジオメトリ
-                geometry = geometry->NextSiblingElement(GEOMETRY_NODE_NAME);
-            }
-        
-            //  メッシュデータ解析
-            const xml::XMLElement* mesh_node = firstChildElement(
-                geometry,
-                MESH_NODE_NAME
-            );
-            while (mesh_node) {
-            
-                std::shared_ptr<ColladaMesh> data = std::make_shared<ColladaMesh>();
-                parseMeshNode(mesh_node, data);
-            
-                //  頂点と法線の並びが同じになっているかチェック
-                if (data->hasVertex()) {
-                    const ColladaMesh::ArrayData* varray = data->getVertex();
-                    if (data->hasNormal()) {
-                        const ColladaMesh::ArrayData* narray = data->getNormals();
-                        size_t visize = varray->data_.size();
-                        size_t nisize = narray->data_.size();
-                        TINY_COLLADA_TRACE("%lu[v] == %lu[n]\n", visize, nisize);
-                        TINY_COLLADA_ASSERT(visize == nisize);
-                    }
-                }
-
-                //  データ登録
-                scene->meshes_.push_back(data);
-                
-                //  次へ
-                mesh_node = mesh_node->NextSiblingElement(MESH_NODE_NAME);
-            }
-            break;
+        if (source_size != header_->source_size_ || source_hash != header_->source_hash_) {
+            close();
+            return Result::Code::CACHE_MISMATCH;
         }
-        
     }
-    
-    
-    
     return Result::Code::SUCCESS;
 }
 
 //----------------------------------------------------------------------
-//  メッシュノードの解析
-void parseMeshNode(
-    const xml::XMLElement* mesh_node,
-    ::std::shared_ptr<tc::ColladaMesh> data
-) {
-    std::shared_ptr<MeshInformation> info = std::make_shared<MeshInformation>();
+void close() {
+    file_.close();
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+}
 
-    //  インデックス情報保存
-    collectIndices(mesh_node, info->raw_indices_);
-    collectFaceCount(mesh_node, info->face_count_);
+//----------------------------------------------------------------------
+size_t getSceneCount() const {
+    return header_ ? static_cast<size_t>(header_->scenes_.count_) : 0;
+}
 
-    //  ソースノードの情報保存
-    collectMeshSources(info->sources_, mesh_node);
-    
-    //  インプットノードの情報保存
-    collectMeshInputs(info->inputs_, mesh_node);
-    
-    info->dump();
-    
-    //  ソースとインプットを関連付け
-    relateSourcesToInputs(info);
-    printf("\n\n");
-    for (int i = 0; i < info->sources_.size(); ++i) {
-        SourceData* src = &info->sources_[i];
-		if (src->input_) {
-			printf("SRC:%s - INPUT:%s\n", src->id_, src->input_->source_);
-			printf("  DATA size %lu\n", src->data_.size());
-		}
+SceneCache::Scene getScene(
+    size_t idx
+) const {
+    const CacheSceneRecord& record = table<CacheSceneRecord>(header_->scenes_)[idx];
+    SceneCache::Scene scene;
+    scene.matrix_ = span<float>(record.matrix_);
+    scene.meshes_ = span<uint32_t>(record.meshes_);
+    scene.material_ = record.material_;
+    scene.node_ = record.node_;
+    scene.submesh_materials_ = span<int32_t>(record.submesh_materials_);
+    return scene;
+}
+
+//----------------------------------------------------------------------
+size_t getMeshCount() const {
+    return header_ ? static_cast<size_t>(header_->meshes_.count_) : 0;
+}
+
+SceneCache::Mesh getMesh(
+    size_t idx
+) const {
+    const CacheMeshRecord& record = table<CacheMeshRecord>(header_->meshes_)[idx];
+    SceneCache::Mesh mesh;
+    mesh.primitive_type_ = static_cast<ColladaMesh::PrimitiveType>(record.primitive_type_);
+    SceneCache::ArrayData* arrays[3] = {
+        &mesh.vertex_,
+        &mesh.normal_,
+        &mesh.uv_
+    };
+    for (int a = 0; a < 3; ++a) {
+        arrays[a]->stride_ = record.strides_[a];
+        arrays[a]->data_ = span<float>(record.data_[a]);
+        arrays[a]->indices_ = span<uint32_t>(record.indices_[a]);
+    }
+    mesh.interleaved_stride_ = record.interleaved_stride_;
+    mesh.interleaved_layout_ = span<ColladaMesh::InterleavedData::Element>(record.interleaved_layout_);
+    mesh.interleaved_data_ = span<float>(record.interleaved_data_);
+    mesh.index_type_ = static_cast<IndexBuffer::Type>(record.index_type_);
+    if (mesh.index_type_ == IndexBuffer::TYPE_UINT16) {
+        mesh.indices16_ = span<uint16_t>(record.index_buffer_);
+    }
+    else {
+        mesh.indices32_ = span<uint32_t>(record.index_buffer_);
     }
-    printf("\n\n");
+    mesh.submeshes_ = span<SceneCache::SubMesh>(record.submeshes_);
+    return mesh;
+}
 
+//----------------------------------------------------------------------
+size_t getMaterialCount() const {
+    return header_ ? static_cast<size_t>(header_->materials_.count_) : 0;
+}
 
-    setupMesh(mesh_node, info, data);
-    
+SceneCache::Material getMaterial(
+    size_t idx
+) const {
+    const CacheMaterialRecord& record = table<CacheMaterialRecord>(header_->materials_)[idx];
+    SceneCache::Material material;
+    material.shading_name_ = stringAt(record.shading_name_);
+    material.texture_name_ = stringAt(record.texture_name_);
+    material.diffuse_ = span<float>(record.colors_[0]);
+    material.ambient_ = span<float>(record.colors_[1]);
+    material.emission_ = span<float>(record.colors_[2]);
+    material.specular_ = span<float>(record.colors_[3]);
+    material.reflective_ = span<float>(record.colors_[4]);
+    material.shininess_ = record.shininess_;
+    material.transparency_ = record.transparency_;
+    material.reflectivity_ = record.reflectivity_;
+    return material;
 }
 
 //----------------------------------------------------------------------
-void setupMesh(
-    const xml::XMLElement* mesh_node,
-    std::shared_ptr<MeshInformation> info,
-    std::shared_ptr<tc::ColladaMesh> mesh
-) {
-    //  プリミティブの描画タイプを設定
-    tc::ColladaMesh::PrimitiveType prim_type = getPrimitiveType(mesh_node);
-    mesh->setPrimitiveType(prim_type);
+SceneCache::Nodes getNodes() const {
+    SceneCache::Nodes nodes;
+    if (header_) {
+        nodes.parents_ = span<uint32_t>(header_->nodes_.parents_);
+        nodes.local_matrices_ = span<float>(header_->nodes_.local_matrices_);
+        nodes.world_matrices_ = span<float>(header_->nodes_.world_matrices_);
+    }
+    return nodes;
+}
 
-    int offset_size = info->getIndexStride();
+const char* getNodeId(
+    size_t idx
+) const {
+    return stringAt(span<uint32_t>(header_->nodes_.ids_)[idx]);
+}
 
-    //  頂点情報
-    const SourceData* pos_source = info->searchSourceBySemantic("POSITION");
-    if (pos_source) {
-        printf("pos_source size %lu\n", pos_source->data_.size());
-        mesh->vertex_.data_ = pos_source->data_;
-        mesh->vertex_.stride_ = pos_source->stride_;
-        if (info->face_count_.empty()) {
-            setupIndices(
-                mesh->vertex_.indices_,
-                info->raw_indices_,
-                pos_source->input_->offset_,
-                offset_size
-            );
+
+private:
+//----------------------------------------------------------------------
+//  ヘッダと全ての配列がファイル内に収まっているか確認
+bool validate() {
+    if (size_ < sizeof(CacheHeader)) {
+        return false;
+    }
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data_);
+    if (std::memcmp(header->magic_, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+     || header->version_ != CACHE_VERSION
+     || header->endian_tag_ != CACHE_ENDIAN_TAG
+     || header->file_size_ != size_) {
+        return false;
+    }
+    if (!isInside(header->meshes_, sizeof(CacheMeshRecord))
+     || !isInside(header->materials_, sizeof(CacheMaterialRecord))
+     || !isInside(header->scenes_, sizeof(CacheSceneRecord))
+     || !isInside(header->strings_, 1)) {
+        return false;
+    }
+    if (header->strings_.count_ > 0 && data_[header->strings_.offset_ + header->strings_.count_ - 1] != '\0') {
+        return false;
+    }
+    header_ = header;
+
+    const CacheMeshRecord* meshes = table<CacheMeshRecord>(header->meshes_);
+    for (size_t i = 0; i < header->meshes_.count_; ++i) {
+        const CacheMeshRecord& mesh = meshes[i];
+        for (int a = 0; a < 3; ++a) {
+            if (!isInside(mesh.data_[a], sizeof(float)) || !isInside(mesh.indices_[a], sizeof(uint32_t))) {
+                return false;
+            }
         }
-        else {
-            setupIndicesMultiFace(
-                mesh->vertex_.indices_,
-                info,
-                pos_source->input_->offset_,
-                offset_size
-            );
+        size_t index_size = mesh.index_type_ == IndexBuffer::TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        if (!isInside(mesh.interleaved_layout_, sizeof(ColladaMesh::InterleavedData::Element))
+         || !isInside(mesh.interleaved_data_, sizeof(float))
+         || !isInside(mesh.index_buffer_, index_size)
+         || !isInside(mesh.submeshes_, sizeof(SceneCache::SubMesh))) {
+            return false;
+        }
+        const SceneCache::SubMesh* submeshes = span<SceneCache::SubMesh>(mesh.submeshes_).data();
+        for (size_t s = 0; s < mesh.submeshes_.count_; ++s) {
+            if (static_cast<uint64_t>(submeshes[s].index_offset_) + submeshes[s].index_count_ > mesh.index_buffer_.count_) {
+                return false;
+            }
         }
     }
-
-    //  法線情報
-    const SourceData* normal_source = info->searchSourceBySemantic("NORMAL");
-    if (normal_source) {
-        printf("normal_source size %lu\n", normal_source->data_.size());
-        
-        mesh->normal_.stride_ = normal_source->stride_;
-        if (info->face_count_.empty()) {
-            setupIndices(
-                mesh->normal_.indices_,
-                info->raw_indices_,
-                normal_source->input_->offset_,
-                offset_size
-            );
+    const CacheMaterialRecord* materials = table<CacheMaterialRecord>(header->materials_);
+    for (size_t i = 0; i < header->materials_.count_; ++i) {
+        for (int c = 0; c < 5; ++c) {
+            if (!isInside(materials[i].colors_[c], sizeof(float))) {
+                return false;
+            }
         }
-        else {
-            setupIndicesMultiFace(
-                mesh->normal_.indices_,
-                info,
-                normal_source->input_->offset_,
-                offset_size
-            );
+        if (!isString(materials[i].shading_name_) || !isString(materials[i].texture_name_)) {
+            return false;
         }
-        
-        //  頂点インデックスにあわせてデータ変更
-        Indices& vindices = mesh->vertex_.indices_;
-        Indices& nindices = mesh->normal_.indices_;
-        mesh->normal_.data_.resize(pos_source->data_.size(), 8.8);
-        for (int vert_idx = 0; vert_idx < vindices.size(); ++vert_idx) {
-            uint32_t vidx = vindices.at(vert_idx);
-            uint32_t nidx = nindices.at(vert_idx);
-            uint32_t nstride = normal_source->stride_;
-            uint32_t from_idx = nidx * nstride;
-            uint32_t to_idx = vidx * nstride;
-            printf("%d-%d\n", vidx, nidx);
-            for (int di = 0; di < nstride; ++di) {
-                int to = to_idx + di;
-                int from = from_idx + di;
-                printf("　　%d -> %d\n", from, to );
-                mesh->normal_.data_[to_idx + di] = normal_source->data_.at(from_idx + di);
+    }
+    const CacheSceneRecord* scenes = table<CacheSceneRecord>(header->scenes_);
+    for (size_t i = 0; i < header->scenes_.count_; ++i) {
+        if (!isInside(scenes[i].matrix_, sizeof(float)) || !isInside(scenes[i].meshes_, sizeof(uint32_t))) {
+            return false;
+        }
+        if (scenes[i].material_ >= static_cast<int64_t>(header->materials_.count_)) {
+            return false;
+        }
+        const uint32_t* mesh_numbers = span<uint32_t>(scenes[i].meshes_).data();
+        for (size_t m = 0; m < scenes[i].meshes_.count_; ++m) {
+            if (mesh_numbers[m] >= header->meshes_.count_) {
+                return false;
             }
         }
-        
-    }
-
-
-    //  uv
-    const SourceData* uv_source = info->searchSourceBySemantic("TEXCOORD");
-    if (uv_source) {
-        printf("uv_source size %lu\n", uv_source->data_.size());
-        
-        mesh->uv_.stride_ = uv_source->stride_;
-        if (info->face_count_.empty()) {
-            setupIndices(
-                mesh->uv_.indices_,
-                info->raw_indices_,
-                uv_source->input_->offset_,
-                offset_size
-            );
+        if (scenes[i].node_ != ColladaNodes::NO_INDEX && scenes[i].node_ >= header->nodes_.parents_.count_) {
+            return false;
         }
-        else {
-            setupIndicesMultiFace(
-                mesh->uv_.indices_,
-                info,
-                uv_source->input_->offset_,
-                offset_size
-            );
+        if (!isInside(scenes[i].submesh_materials_, sizeof(int32_t))) {
+            return false;
         }
-        
-        //  頂点インデックスにあわせてデータ変更
-        Indices& vindices = mesh->vertex_.indices_;
-        Indices& nindices = mesh->uv_.indices_;
-        mesh->uv_.data_.resize(pos_source->data_.size(), 8.8888f);
-        for (int vert_idx = 0; vert_idx < vindices.size(); ++vert_idx) {
-            uint32_t vidx = vindices.at(vert_idx);
-            uint32_t nidx = nindices.at(vert_idx);
-            uint32_t nstride = uv_source->stride_;
-            uint32_t from_idx = nidx * nstride;
-            uint32_t to_idx = vidx * nstride;
-            printf("%d-%d\n", vidx, nidx);
-            for (int di = 0; di < nstride; ++di) {
-                int to = to_idx + di;
-                int from = from_idx + di;
-                printf("　　%d -> %d\n", from, to );
-                mesh->uv_.data_[to_idx + di] = uv_source->data_.at(from_idx + di);
+        const int32_t* submesh_materials = span<int32_t>(scenes[i].submesh_materials_).data();
+        for (size_t s = 0; s < scenes[i].submesh_materials_.count_; ++s) {
+            if (submesh_materials[s] < -1 || submesh_materials[s] >= static_cast<int64_t>(header->materials_.count_)) {
+                return false;
             }
         }
-        
     }
+
+    //  ノードは親が前にあること
+    const CacheNodeTable& nodes = header->nodes_;
+    const uint64_t node_count = nodes.parents_.count_;
+    if (!isInside(nodes.parents_, sizeof(uint32_t))
+     || !isInside(nodes.ids_, sizeof(uint32_t))
+     || !isInside(nodes.local_matrices_, sizeof(float))
+     || !isInside(nodes.world_matrices_, sizeof(float))
+     || nodes.ids_.count_ != node_count
+     || nodes.local_matrices_.count_ != node_count * 16
+     || nodes.world_matrices_.count_ != node_count * 16) {
+        return false;
+    }
+    const uint32_t* parents = span<uint32_t>(nodes.parents_).data();
+    const uint32_t* ids = span<uint32_t>(nodes.ids_).data();
+    for (size_t i = 0; i < node_count; ++i) {
+        if ((parents[i] != ColladaNodes::NO_INDEX && parents[i] >= i) || !isString(ids[i])) {
+            return false;
+        }
+    }
+    return true;
 }
 
+//----------------------------------------------------------------------
+//  配列がファイル内に収まり、境界が揃っているか
+bool isInside(
+    const CacheArray& array,
+    size_t element_size
+) const {
+    if (array.count_ == 0) {
+        return true;
+    }
+    if (array.offset_ > size_ || array.count_ > (size_ - array.offset_) / element_size) {
+        return false;
+    }
+    return element_size == 1 || array.offset_ % CACHE_ALIGNMENT == 0;
+}
 
+bool isString(
+    uint32_t offset
+) const {
+    return offset == CACHE_NO_STRING || offset < header_->strings_.count_;
+}
 
+template <typename T>
+const T* table(
+    const CacheArray& array
+) const {
+    return reinterpret_cast<const T*>(data_ + array.offset_);
+}
 
-//----------------------------------------------------------------------
-//  事前に抜いておいたインデックス一覧からインデックスのセットアップ
-void setupIndices(
-    Indices& out,
-    Indices& src,
-    int start_offset,
-    int stride
-) {
-    TINY_COLLADA_TRACE("%s start_offset = %d stride = %d\n", __FUNCTION__, start_offset, stride);
-    for (int i = start_offset; i < src.size(); i += stride) {
-        out.push_back(src.at(i));
+template <typename T>
+ArraySpan<T> span(
+    const CacheArray& array
+) const {
+    if (array.count_ == 0) {
+        return ArraySpan<T>();
     }
-    TINY_COLLADA_TRACE("index size = %lu\n", out.size());
+    return ArraySpan<T>(table<T>(array), static_cast<size_t>(array.count_));
 }
 
-//----------------------------------------------------------------------
-//  事前に抜いておいたインデックス一覧からインデックスのセットアップ2
-void setupIndicesMultiFace(
-    Indices& out,
-    std::shared_ptr<MeshInformation>& info,
-    int start_offset,
-    int stride
-) {
-    int idx = start_offset;
-    for (int i = 0; i < info->face_count_.size(); ++ i) {
-        int vcnt = info->face_count_.at(i);
+const char* stringAt(
+    uint32_t offset
+) const {
+    if (offset == CACHE_NO_STRING) {
+        return nullptr;
+    }
+    return data_ + header_->strings_.offset_ + offset;
+}
 
-        if (vcnt == 3) {
-            uint32_t idx1 = info->raw_indices_.at(idx);
-            idx += stride;
-            uint32_t idx2 = info->raw_indices_.at(idx);
-            idx += stride;
-            uint32_t idx3 = info->raw_indices_.at(idx);
-            idx += stride;
-            out.push_back(idx1);
-            out.push_back(idx2);
-            out.push_back(idx3);
 
-        }
-        else if (vcnt == 4) {
-            uint32_t idx1 = info->raw_indices_.at(idx);
-            idx += stride;
-            uint32_t idx2 = info->raw_indices_.at(idx);
-            idx += stride;
-            uint32_t idx3 = info->raw_indices_.at(idx);
-            idx += stride;
-            uint32_t idx4 = info->raw_indices_.at(idx);
-            idx += stride;
+private:
+    MappedFile file_;
+    std::vector<uint64_t> buffer_;
+    const char* data_;
+    size_t size_;
+    const CacheHeader* header_;
+};  // class SceneCache::Impl
 
-            out.push_back(idx1);
-            out.push_back(idx2);
-            out.push_back(idx3);
 
-            out.push_back(idx1);
-            out.push_back(idx3);
-            out.push_back(idx4);
-        }
-    }
+//----------------------------------------------------------------------
+SceneCache::SceneCache()
+    : impl_(nullptr)
+{
+    impl_.reset(new Impl());
 }
 
-    
 //----------------------------------------------------------------------
-//  メッシュから抜いたinputsとsourcesを関連付ける
-void relateSourcesToInputs(
-    std::shared_ptr<MeshInformation>& info
-)
+SceneCache::~SceneCache()
 {
-    TINY_COLLADA_TRACE("%s\n", __FUNCTION__);
-    auto src_it = info->sources_.begin();
-    auto src_end = info->sources_.end();
-    
-
-	while (src_it != src_end) {
-		InputData* input = info->searchInputBySource(src_it->id_);
-		src_it->input_ = input;
-		
-		TINY_COLLADA_TRACE(" %s", src_it->id_);
-		if (input) {
-			TINY_COLLADA_TRACE(" OK\n");
-			TINY_COLLADA_TRACE("  %s %s\n", input->semantic_, input->source_);
-		}
-		else {
-			TINY_COLLADA_TRACE(" NG\n");
-		}
-		++src_it;
-	}
 }
-    
 
+//----------------------------------------------------------------------
+Result SceneCache::open(
+    const char* const cache_path,
+    const char* const source_path
+) {
+    return impl_->open(cache_path, source_path);
+}
 
 //----------------------------------------------------------------------
-//  メッシュリスト取得
-const ColladaScenes* getScenes() const {
-    return &scenes_;
+void SceneCache::close()
+{
+    impl_->close();
 }
 
+//----------------------------------------------------------------------
+size_t SceneCache::getSceneCount() const
+{
+    return impl_->getSceneCount();
+}
 
-private:
-    ColladaScenes scenes_;
-};  // class Parser::Impl
+//----------------------------------------------------------------------
+SceneCache::Scene SceneCache::getScene(
+    size_t idx
+) const {
+    return impl_->getScene(idx);
+}
 
+//----------------------------------------------------------------------
+size_t SceneCache::getMeshCount() const
+{
+    return impl_->getMeshCount();
+}
 
+//----------------------------------------------------------------------
+SceneCache::Mesh SceneCache::getMesh(
+    size_t idx
+) const {
+    return impl_->getMesh(idx);
+}
 
 //----------------------------------------------------------------------
-Parser::Parser()
-    : impl_(nullptr)
+size_t SceneCache::getMaterialCount() const
 {
-    impl_.reset(new Impl());
+    return impl_->getMaterialCount();
 }
 
 //----------------------------------------------------------------------
-Parser::~Parser()
+SceneCache::Material SceneCache::getMaterial(
+    size_t idx
+) const {
+    return impl_->getMaterial(idx);
+}
+
+//----------------------------------------------------------------------
+SceneCache::Nodes SceneCache::getNodes() const
 {
+    return impl_->getNodes();
 }
 
 //----------------------------------------------------------------------
-Result Parser::parse(
-    const char* const dae_path
-) {
-   
-    //  tiny xmlを使って.daeを読み込む
-    xml::XMLDocument doc;
-    xml::XMLError load_error = doc.LoadFile(dae_path);
-    if (load_error != xml::XML_SUCCESS) {
-        return Result::Code::READ_ERROR;
-    }
-//    doc.Print();
+const char* SceneCache::getNodeId(
+    size_t idx
+) const {
+    return impl_->getNodeId(idx);
+}
 
 
-    //  解析
-    Result parse_result = impl_->parseCollada(&doc);
-    if (parse_result.isFailed()) {
-        return parse_result;
-    }
+//----------------------------------------------------------------------
+//  数値テキスト解析(浮動小数)
+size_t readFloatArray(
+    const char* text,
+    size_t length,
+    Vertices* out
+) {
+    return readArray(text, text + length, out);
+}
 
-    return Result::Code::SUCCESS;
+//----------------------------------------------------------------------
+//  数値テキスト解析(インデックス)
+size_t readIndexArray(
+    const char* text,
+    size_t length,
+    Indices* out
+) {
+    return readArray(text, text + length, out);
 }
 
-    
-//const Meshes* Parser::meshes() const
-//{
-//    return impl_->getMeshList();
-//}
+//----------------------------------------------------------------------
+//  データをコンソールに出力
+bool ColladaMesh::isDecoded() const
+{
+    return !lazy_ || lazy_->isDecoded();
+}
 
-const ColladaScenes* Parser::scenes() const
+//----------------------------------------------------------------------
+void ColladaMesh::decodeLazy() const
 {
-    return impl_->getScenes();
+    //  解析結果を書き込むだけで、利用者から見た状態は変わらない
+    lazy_->decode(const_cast<ColladaMesh&>(*this), nullptr);
 }
 
 //----------------------------------------------------------------------
-//  データをコンソールに出力
-void ColladaMesh::dump()
+void ColladaMesh::dump() const
 {
+    decode();
     printf("--- Vertex data dump ---\n");
     vertex_.dump();
     printf("\n");
     printf("--- Normal data dump ---\n");
     normal_.dump();
     printf("\n");
+    printf("--- SubMesh dump ---\n");
+    for (size_t i = 0; i < submeshes_.size(); ++i) {
+        printf("offset = %u  count = %u  material = %s\n",
+            submeshes_[i].index_offset_,
+            submeshes_[i].index_count_,
+            submeshes_[i].material_ ? submeshes_[i].material_ : "-"
+        );
+    }
+    printf("\n");
     
 }
 
 //----------------------------------------------------------------------
 //  データをコンソールに出力
-void ColladaMesh::ArrayData::dump()
+void ColladaMesh::ArrayData::dump() const
 {
     if (!isValidate()) {
         printf("This ArrayData is invalidate data.\n");
@@ -1503,5 +8028,81 @@ void ColladaMesh::ArrayData::dump()
     
 }
 
+//----------------------------------------------------------------------
+//  シンボルに結び付けられたマテリアル
+//  シンボルはどちらも同じ文字列表のものなので、まずアドレスで比べる
+const std::shared_ptr<ColladaMaterial>& ColladaScene::findMaterial(
+    const char* symbol
+) const {
+    if (symbol) {
+        for (size_t i = 0; i < material_bindings_.size(); ++i) {
+            const char* bound = material_bindings_[i].symbol_;
+            if (bound && (bound == symbol || std::strcmp(bound, symbol) == 0)) {
+                return material_bindings_[i].material_;
+            }
+        }
+    }
+    return material_;
+}
+
+//----------------------------------------------------------------------
+//  静的バッチ
+//  範囲はインデックス位置の昇順なので二分探索する
+const ColladaBatch::Range* ColladaBatch::findRange(
+    size_t triangle
+) const {
+    const size_t index = triangle * 3;
+    auto found = std::upper_bound(
+        ranges_.begin(),
+        ranges_.end(),
+        index,
+        [](size_t value, const Range& range) {
+            return value < range.index_offset_;
+        }
+    );
+    if (found == ranges_.begin()) {
+        return nullptr;
+    }
+    --found;
+    if (index >= static_cast<size_t>(found->index_offset_) + found->index_count_) {
+        return nullptr;
+    }
+    return &*found;
+}
+
+//----------------------------------------------------------------------
+//  ノード階層
+const uint32_t ColladaNodes::NO_INDEX;
+
+//----------------------------------------------------------------------
+//  ワールド行列の計算
+//  親のワールド行列は計算済みなので、先頭から順に 親 * ローカル を求める
+void ColladaNodes::updateWorldMatrices(
+    size_t first
+) {
+    world_matrices_.resize(local_matrices_.size());
+    for (size_t i = first; i < parents_.size(); ++i) {
+        const float* local = &local_matrices_[i * 16];
+        float* world = &world_matrices_[i * 16];
+        const uint32_t parent = parents_[i];
+        if (parent >= i) {
+            //  ルート(親が後ろにある壊れた並びもルートとして扱う)
+            std::memcpy(world, local, 16 * sizeof(float));
+        }
+        else {
+            multiplyMatrix(&world_matrices_[parent * 16], local, world);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void ColladaNodes::clear()
+{
+    parents_.clear();
+    ids_.clear();
+    local_matrices_.clear();
+    world_matrices_.clear();
+}
+
 }   // namespace tc
 
@@ -6,9 +6,28 @@
 // Include files.
 #include <vector>
 #include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <string>
 
 
+//  ログの出力レベル
+//  TINY_COLLADA_LOG_LEVEL より詳しいレベルのログはコンパイル時に消える
+//  未定義なら NDEBUG のときは警告まで、それ以外はデバッグまで残す
+#define TINY_COLLADA_LOG_LEVEL_NONE     0
+#define TINY_COLLADA_LOG_LEVEL_ERROR    1
+#define TINY_COLLADA_LOG_LEVEL_WARNING  2
+#define TINY_COLLADA_LOG_LEVEL_INFO     3
+#define TINY_COLLADA_LOG_LEVEL_DEBUG    4
+
+#ifndef TINY_COLLADA_LOG_LEVEL
+    #if defined(NDEBUG)
+        #define TINY_COLLADA_LOG_LEVEL  TINY_COLLADA_LOG_LEVEL_WARNING
+    #else
+        #define TINY_COLLADA_LOG_LEVEL  TINY_COLLADA_LOG_LEVEL_DEBUG
+    #endif
+#endif
+
 
 namespace tc {
 
@@ -22,16 +41,28 @@ public:
         SUCCESS,
         READ_ERROR,
         PERSE_ERROR,
+        WRITE_ERROR,
+        CACHE_MISMATCH,     //  キャッシュが壊れている、または元の.daeと一致しない
+        INDEX_OUT_OF_RANGE, //  <p> のインデックスが参照先の配列の範囲外
     };
 
 
 public:
     Result()
         : code_(Code::SUCCESS)
+        , message_()
     {}
     
     Result(Code code)
         : code_(code)
+        , message_()
+    {}
+
+    Result(
+        Code code,
+        const char* message
+    )   : code_(code)
+        , message_(message)
     {}
 
 public:
@@ -47,6 +78,11 @@ public:
     Code getErrorCode() const {
         return code_;
     }
+
+    //  エラーの詳細(無ければ空文字列)
+    const char* getErrorMessage() const {
+        return message_.c_str();
+    }
     
 private:
     //  エラーコードを設定
@@ -59,12 +95,267 @@ private:
     
 private:
     Code code_;
+    std::string message_;
 };
 
 class ColladaMesh;
 using Indices = ::std::vector<uint32_t>;
+using Indices16 = ::std::vector<uint16_t>;
 using Vertices = ::std::vector<float>;
-using Meshes =  ::std::vector<::std::shared_ptr<ColladaMesh>>;
+using Meshes =  ::std::vector<::std::shared_ptr<const ColladaMesh>>;
+
+//  読み取り専用の配列参照
+template <typename T>
+class ArraySpan
+{
+public:
+    ArraySpan()
+        : data_(nullptr)
+        , size_(0)
+    {}
+
+    ArraySpan(
+        const T* data,
+        size_t size
+    )   : data_(data)
+        , size_(size)
+    {}
+
+public:
+    const T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    const T& operator[](size_t idx) const {
+        return data_[idx];
+    }
+
+private:
+    const T* data_;
+    size_t size_;
+};
+
+
+//  インデックスバッファ
+//  最大インデックスが16bitに収まれば uint16_t、収まらなければ uint32_t で保持する
+class IndexBuffer
+{
+public:
+    enum Type {
+        TYPE_UINT16,
+        TYPE_UINT32
+    };
+
+public:
+    IndexBuffer()
+        : type_(TYPE_UINT16)
+        , indices16_()
+        , indices32_()
+    {}
+
+public:
+    //  インデックス設定
+    //  値の範囲を見て幅を決める
+    void assign(
+        const Indices& src
+    ) {
+        uint32_t max_index = 0;
+        for (size_t i = 0; i < src.size(); ++i) {
+            max_index = src[i] > max_index ? src[i] : max_index;
+        }
+        indices16_.clear();
+        indices32_.clear();
+        if (max_index <= 0xFFFF) {
+            type_ = TYPE_UINT16;
+            indices16_.assign(src.begin(), src.end());
+        }
+        else {
+            type_ = TYPE_UINT32;
+            indices32_ = src;
+        }
+    }
+
+    //  インデックスの型
+    Type getType() const {
+        return type_;
+    }
+
+    //  1インデックスのバイト数
+    size_t getElementSize() const {
+        return type_ == TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    //  インデックス数
+    size_t size() const {
+        return type_ == TYPE_UINT16 ? indices16_.size() : indices32_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    //  先頭アドレス(GPU転送用)
+    const void* data() const {
+        if (type_ == TYPE_UINT16) {
+            return indices16_.data();
+        }
+        return indices32_.data();
+    }
+
+    size_t getByteSize() const {
+        return size() * getElementSize();
+    }
+
+    //  型付きの参照
+    //  型が違う場合は空を返す
+    ArraySpan<uint16_t> getUint16() const {
+        if (type_ != TYPE_UINT16) {
+            return ArraySpan<uint16_t>();
+        }
+        return ArraySpan<uint16_t>(indices16_.data(), indices16_.size());
+    }
+
+    ArraySpan<uint32_t> getUint32() const {
+        if (type_ != TYPE_UINT32) {
+            return ArraySpan<uint32_t>();
+        }
+        return ArraySpan<uint32_t>(indices32_.data(), indices32_.size());
+    }
+
+    //  型に関係なく1つ取得
+    uint32_t operator[](size_t idx) const {
+        if (type_ == TYPE_UINT16) {
+            return indices16_[idx];
+        }
+        return indices32_[idx];
+    }
+
+private:
+    Type type_;
+    Indices16 indices16_;
+    Indices indices32_;
+};
+
+
+//  メモリ確保のフック
+//  Parser は解析中に作るオブジェクト(シーン、メッシュ、マテリアルと途中のデータ)を
+//  ここから確保したブロック(アリーナ)に詰めて置き、ブロック単位でまとめて解放する
+//  allocate は malloc と同じく任意の型に使える境界に揃えた領域を返すこと
+//  解析結果が残っている間はブロックが使われるので、解析結果より長く生存させること
+class Allocator
+{
+public:
+    virtual ~Allocator() {}
+
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+};
+
+
+//  ログ
+enum LogLevel {
+    LOG_ERROR = TINY_COLLADA_LOG_LEVEL_ERROR,
+    LOG_WARNING = TINY_COLLADA_LOG_LEVEL_WARNING,
+    LOG_INFO = TINY_COLLADA_LOG_LEVEL_INFO,
+    LOG_DEBUG = TINY_COLLADA_LOG_LEVEL_DEBUG
+};
+
+//  ログの出力先
+//  message は改行を含まない1行。呼び出しが終わるまで有効
+//  メッシュを並列に解析しているときは複数のスレッドから呼ばれる
+using LogSink = void (*)(LogLevel level, const char* message, void* user_data);
+
+
+//  解析統計
+//  Parser::setStatisticsEnabled(true) のときだけ parse ごとに記録する
+//  フェーズの時間は全スレッドの合計なので、並列解析では total_seconds_ を超えることがある
+struct ParseStatistics
+{
+    enum Phase {
+        PHASE_FILE_LOAD,            //  ファイルのマップ、読み込み
+        PHASE_XML_PARSE,            //  XMLの字句解析(DOM作成、ストリーミング走査)
+        PHASE_VISUAL_SCENE,         //  visual_scene収集
+        PHASE_MATERIAL,             //  マテリアル、エフェクト、イメージ収集
+        PHASE_SCENE_BUILD,          //  id索引、シーンとメッシュの枠作成
+        PHASE_SOURCE_DECODE,        //  メッシュごとの配列読み込み
+        PHASE_TRIANGULATE,          //  多角形の三角形分割
+        PHASE_INDEX_SETUP,          //  インデックス展開
+        PHASE_ATTRIBUTE_REMAP,      //  法線、uvの並べ替え(インターリーブ時は頂点の溶接)
+        PHASE_VERTEX_CACHE,         //  頂点キャッシュ最適化
+        PHASE_BATCH,                //  静的バッチ作成
+        PHASE_COUNT
+    };
+
+    //  区間の記録
+    struct Event
+    {
+        Phase phase_;
+        uint32_t thread_;           //  解析を呼んだスレッドが0
+        double begin_;              //  解析開始からのマイクロ秒
+        double duration_;           //  マイクロ秒
+    };
+
+    ParseStatistics() {
+        clear();
+    }
+
+    void clear();
+
+    //  フェーズ名
+    static const char* getPhaseName(Phase phase);
+
+    //  Chrome trace 形式(chrome://tracing や Perfetto で開ける JSON)で書き出す
+    Result writeChromeTrace(const char* const path) const;
+
+    double total_seconds_;
+    double phase_seconds_[PHASE_COUNT];
+    uint64_t input_bytes_;
+    uint64_t element_count_;            //  XML要素数
+    uint64_t scene_count_;
+    uint64_t mesh_count_;
+    uint64_t material_count_;
+    uint64_t source_count_;
+    uint64_t float_count_;              //  読み込んだ float の数
+    uint64_t index_count_;              //  <p> のインデックス数
+    uint64_t vertex_count_;             //  出力頂点数
+    uint64_t string_count_;             //  登録済みの名前の数
+    uint64_t arena_allocation_count_;   //  アリーナからの切り出し回数
+    uint64_t arena_block_count_;        //  Allocator(malloc)からのブロック確保回数
+    uint64_t arena_allocated_bytes_;
+    uint64_t arena_reserved_bytes_;
+    ::std::vector<Event> events_;
+};
+
+
+//  頂点キャッシュ効率
+//  ACMR は三角形あたり、ATVR は頂点あたりのキャッシュミス数(FIFO 16エントリで計測)
+struct VertexCacheStatistics
+{
+    VertexCacheStatistics()
+        : acmr_(0.0f)
+        , atvr_(0.0f)
+    {}
+
+    float acmr_;
+    float atvr_;
+};
+
 
 //  ColladaMaterial
 class ColladaMaterial
@@ -139,6 +430,7 @@ public:
 
 
 //  Colladaメッシュデータ
+//  ジオメトリ1つにつき1つだけ作られ、それを参照する全てのシーンで共有される
 class ColladaMesh final
 {
 public:
@@ -163,7 +455,7 @@ public:
             stride_ = stride;
         }
     
-        void dump();
+        void dump() const;
 
     public:
         int8_t stride_;
@@ -171,18 +463,100 @@ public:
         Indices indices_;
     };
 
+    //  頂点属性の種類
+    enum Attribute {
+        ATTRIBUTE_POSITION,
+        ATTRIBUTE_NORMAL,
+        ATTRIBUTE_TEXCOORD,
+        ATTRIBUTE_COUNT
+    };
+
+    //  インターリーブ頂点データ
+    //  (位置, 法線, uv) の組み合わせごとに1頂点とし、全属性を1本のバッファに並べる
+    //  インデックスは全属性共通で ColladaMesh::getIndexBuffer() に入る
+    class InterleavedData
+    {
+    public:
+        //  頂点レイアウトの1要素
+        //  offset_ は頂点先頭からの位置(float単位)
+        struct Element
+        {
+            Attribute attribute_;
+            uint8_t components_;
+            uint8_t offset_;
+        };
+
+    public:
+        InterleavedData()
+            : stride_(0)
+            , layout_()
+            , data_()
+        {}
+
+    public:
+        bool isValidate() const {
+            return stride_ != 0;
+        }
+
+        //  頂点数
+        size_t getVertexCount() const {
+            return stride_ ? data_.size() / stride_ : 0;
+        }
+
+        //  1頂点のバイト数
+        size_t getStrideBytes() const {
+            return stride_ * sizeof(float);
+        }
+
+        //  指定属性のレイアウトを取得
+        //  持っていなければ nullptr
+        const Element* findElement(
+            Attribute attribute
+        ) const {
+            for (size_t i = 0; i < layout_.size(); ++i) {
+                if (layout_[i].attribute_ == attribute) {
+                    return &layout_[i];
+                }
+            }
+            return nullptr;
+        }
+
+    public:
+        uint8_t stride_;                //  1頂点のfloat数
+        std::vector<Element> layout_;
+        std::vector<float> data_;
+    };
+
 public:
     enum PrimitiveType {
         PRIMITIVE_TRIANGLES,        
         UNKNOWN_TYPE
     };
+
+    //  サブメッシュ
+    //  プリミティブ要素(<triangles>, <polylist>, <polygons>)1つ分の描画範囲
+    //  範囲は getIndexBuffer() 上の位置と数で、通常出力なら属性ごとのインデックスも同じ並び
+    //  material_ は要素の material 属性(シンボル)。ColladaScene::findMaterial で実際のマテリアルにする
+    struct SubMesh
+    {
+        uint32_t index_offset_;
+        uint32_t index_count_;
+        const char* material_;          //  無ければ nullptr
+    };
     
 public:
     ColladaMesh()
         : vertex_()
         , normal_()
         , uv_()
+        , interleaved_()
+        , index_buffer_()
+        , original_cache_statistics_()
+        , cache_statistics_()
         , primitive_type_(UNKNOWN_TYPE)
+        , submeshes_()
+        , material_()
+        , lazy_()
     {}
     ~ColladaMesh(){}
     ColladaMesh& operator=(const ColladaMesh&) = delete;	// コピーの禁止
@@ -190,18 +564,33 @@ public:
 
     
 public:
+    //  遅延解析
+    //  Parser::setLazyDecoding(true) で解析したメッシュは、配列を最初に参照したときに解析する
+    //  取得関数は自動で呼ぶ。メンバーを直接参照する場合は先に呼ぶこと
+    //  解析は1回だけで、複数スレッドから同時に呼んでもよい
+    void decode() const {
+        if (lazy_) {
+            decodeLazy();
+        }
+    }
+
+    bool isDecoded() const;
+
     //  法線を持っているか判定
     bool hasNormal() const {
+        decode();
         return normal_.isValidate();
     }
     
     //  頂点を持っているか判定
     bool hasVertex() const {
+        decode();
         return vertex_.isValidate();
     }
 
     //  テクスチャ座標を持っているか判定
     bool hasTexCoord() const {
+        decode();
         return uv_.isValidate();
     }
 
@@ -212,53 +601,214 @@ public:
     }
     
     PrimitiveType getPrimitiveType() const {
+        decode();
         return primitive_type_;
     }
     
     const ArrayData* getVertex() const{
+        decode();
         return &vertex_;
     }
     
     const ArrayData* getNormals() const {
+        decode();
         return &normal_;
     }
 
     const ArrayData* getTexCoord() const {
+        decode();
         return &uv_;
     }
 
-    void dump();
+    //  インターリーブ頂点データを持っているか判定
+    bool hasInterleaved() const {
+        decode();
+        return interleaved_.isValidate();
+    }
+
+    const InterleavedData* getInterleaved() const {
+        decode();
+        return &interleaved_;
+    }
+
+    //  描画用インデックスバッファ
+    //  通常は頂点(位置)インデックス、インターリーブ出力なら共通インデックス
+    const IndexBuffer* getIndexBuffer() const {
+        decode();
+        return &index_buffer_;
+    }
+
+    //  頂点キャッシュ最適化前後の効率
+    //  最適化を行っていなければどちらも0
+    const VertexCacheStatistics* getOriginalCacheStatistics() const {
+        decode();
+        return &original_cache_statistics_;
+    }
+
+    const VertexCacheStatistics* getCacheStatistics() const {
+        decode();
+        return &cache_statistics_;
+    }
+
+    //  サブメッシュ一覧(ドキュメント順)
+    //  全てのサブメッシュが頂点データとインデックスバッファを共有する
+    const std::vector<SubMesh>* getSubMeshes() const {
+        decode();
+        return &submeshes_;
+    }
+
+    void dump() const;
+
+private:
+    void decodeLazy() const;
 
 
 public:
+    class LazyDecoder;
+
     ArrayData vertex_;
     ArrayData normal_;
     ArrayData uv_;
+    InterleavedData interleaved_;
+    IndexBuffer index_buffer_;
+    VertexCacheStatistics original_cache_statistics_;
+    VertexCacheStatistics cache_statistics_;
     PrimitiveType primitive_type_;
+    std::vector<SubMesh> submeshes_;
     std::shared_ptr<ColladaMaterial> material_;
+    std::shared_ptr<LazyDecoder> lazy_;     //  遅延解析の状態(遅延解析でなければ nullptr)
+};
+using ColladaMeshes = Meshes;
+
+
+//  ノード階層
+//  <visual_scene> 以下の全ての <node> を、親が必ず子より前に来る順(文書順)に平坦に並べる
+//  ノードの情報は種類ごとに別の配列に持つ。i 番目のノードの親は parents_[i]
+//  行列は ColladaScene::matrix_ と同じ列優先の4x4で、ノードごとに16個ずつ並ぶ
+class ColladaNodes final
+{
+public:
+    static const uint32_t NO_INDEX = 0xFFFFFFFF;
+
+public:
+    size_t size() const {
+        return parents_.size();
+    }
+
+    const float* getLocalMatrix(size_t idx) const {
+        return &local_matrices_[idx * 16];
+    }
+
+    const float* getWorldMatrix(size_t idx) const {
+        return &world_matrices_[idx * 16];
+    }
+
+    //  local_matrices_ からワールド行列を計算しなおす
+    //  親が子より前にあるので先頭から1回たどるだけで済む
+    //  first より前のワールド行列は計算済みのものをそのまま使う
+    void updateWorldMatrices(size_t first = 0);
+
+    void clear();
+
+public:
+    std::vector<uint32_t> parents_;         //  親の番号(ルートは NO_INDEX)
+    std::vector<std::string> ids_;          //  id 属性(無ければ空)
+    std::vector<float> local_matrices_;     //  親からの変換
+    std::vector<float> world_matrices_;     //  ルートからの変換
 };
-using ColladaMeshes = std::vector<std::shared_ptr<ColladaMesh>>;
 
 
 //  シーン情報
+//  マトリックスとマテリアルはインスタンスごと、メッシュは共有
 class ColladaScene final
 {
 public:
+    //  <instance_material> 1つ分の結び付け
+    //  サブメッシュの material_ と symbol_ が同じものを使う
+    struct MaterialBinding
+    {
+        const char* symbol_;
+        std::shared_ptr<ColladaMaterial> material_;
+    };
+
+public:
+    ColladaScene()
+        : matrix_()
+        , meshes_()
+        , material_()
+        , material_bindings_()
+        , node_(ColladaNodes::NO_INDEX)
+    {}
+
     void dump(){
         if (material_) {
             material_->dump();
         }
     }
 
+    //  シンボルに結び付けられたマテリアル
+    //  見つからなければ material_
+    const std::shared_ptr<ColladaMaterial>& findMaterial(
+        const char* symbol
+    ) const;
+
 
 public:
-    std::vector<float> matrix_;
-    std::vector<std::shared_ptr<ColladaMesh>> meshes_;
-    std::shared_ptr<ColladaMaterial> material_;
+    std::vector<float> matrix_;             //  ワールド行列
+    ColladaMeshes meshes_;
+    std::shared_ptr<ColladaMaterial> material_;    //  最初の <instance_material> のマテリアル
+    std::vector<MaterialBinding> material_bindings_;
+    uint32_t node_;                         //  <instance_geometry> を持つノードの番号(Parser::nodes())
 };
 using ColladaScenes = std::vector<std::shared_ptr<ColladaScene>>;
 
 
+//  静的バッチ
+//  同じマテリアルを使うサブメッシュを、シーンのワールド行列で変換済みの
+//  頂点バッファ1本とインデックスバッファ1本にまとめたもの。1回の描画で描ける
+class ColladaBatch final
+{
+public:
+    //  元のサブメッシュ1つ分の範囲(ピック用)
+    //  scenes()[scene_]->meshes_[mesh_] のサブメッシュ submesh_ が
+    //  indices_ の [index_offset_, index_offset_ + index_count_) と
+    //  vertices_ の [vertex_offset_, vertex_offset_ + vertex_count_) になる
+    struct Range
+    {
+        uint32_t scene_;
+        uint32_t mesh_;
+        uint32_t submesh_;
+        uint32_t index_offset_;
+        uint32_t index_count_;
+        uint32_t vertex_offset_;
+        uint32_t vertex_count_;
+    };
+
+public:
+    ColladaBatch()
+        : material_()
+        , vertices_()
+        , indices_()
+        , ranges_()
+    {}
+    ColladaBatch& operator=(const ColladaBatch&) = delete;	// コピーの禁止
+    ColladaBatch(const ColladaBatch&) = delete;
+
+    //  三角形番号(インデックス位置 / 3)を含む範囲
+    //  範囲外なら nullptr
+    const Range* findRange(
+        size_t triangle
+    ) const;
+
+public:
+    std::shared_ptr<ColladaMaterial> material_;     //  マテリアルが無いサブメッシュのバッチは nullptr
+    ColladaMesh::InterleavedData vertices_;         //  位置、法線(変換して正規化済み)、uv。持っていない属性は0
+    IndexBuffer indices_;
+    std::vector<Range> ranges_;                     //  index_offset_ の昇順
+};
+using ColladaBatches = std::vector<std::shared_ptr<ColladaBatch>>;
+
+
 //  パーサー
 class Parser final
 {
@@ -269,9 +819,101 @@ public:
     Parser(const Parser&) = delete;
 public:
     Result parse(const char* const dae_file_path);
+
+    //  メモリ上の.daeを解析
+    //  ファイルを経由せず、呼び出し側が持っているデータを直接解析する
+    Result parse(const char* const data, size_t size);
+
+    //  解析結果を消す
+    //  parse は結果を追加していくので、別のファイルを解析し直す場合は先に呼ぶ
+    //  確保済みの領域(アリーナ、XMLノードのプール、作業用の配列)は残して次の parse で使い回す
+    //  以前の解析結果を保持していても構わない。その分の領域は使い回さずに新しく確保する
+    void reset();
+
+    //  ストリーミング解析モード
+    //  有効にするとDOM全体を作らず、float_array や p などの配列要素は
+    //  ファイルを読みながら直接数値に変換する。巨大な.dae向け
+    void setStreamingMode(bool enable);
+    bool isStreamingMode() const;
+
+    //  メッシュ解析のスレッド数
+    //  1(デフォルト)なら呼び出し側スレッドだけで解析する。0ならCPUのコア数
+    //  結果の並びはスレッド数に関係なくドキュメント順になる
+    void setThreadCount(unsigned int thread_count);
+    unsigned int getThreadCount() const;
+
+    //  インターリーブ出力モード
+    //  有効にすると各メッシュは vertex_ / normal_ / uv_ の代わりに
+    //  interleaved_ に頂点バッファとインデックスバッファを1本ずつ持つ
+    void setInterleavedOutput(bool enable);
+    bool isInterleavedOutput() const;
+
+    //  頂点キャッシュ最適化
+    //  有効にすると三角形の順番を並べ替え(Forsyth方式)、頂点を初出順に並べ直す
+    //  前後の効率は ColladaMesh::getCacheStatistics() などで取得できる
+    void setVertexCacheOptimization(bool enable);
+    bool isVertexCacheOptimization() const;
+
+    //  遅延解析
+    //  有効にすると parse では配列要素の位置だけを記録し、各メッシュの配列は
+    //  最初に参照したとき(ColladaMesh::decode())に解析する。デフォルトは無効
+    //  ストリーミング解析と同じ走査を使うので setStreamingMode の設定は関係ない
+    //  入力はメッシュが全て解析されるまで残る。メモリ上の.daeを解析した場合は
+    //  呼び出し側がそれまで data を保持すること
+    //  parse の後に解析したメッシュは解析統計に含まれない
+    void setLazyDecoding(bool enable);
+    bool isLazyDecoding() const;
+
+    //  遅延解析のメッシュをまとめて解析する
+    //  setThreadCount のスレッド数で並列に解析する。解析済みのメッシュは何もしない
+    //  解析に失敗したメッシュは空になり、最初に失敗したメッシュのエラーを返す
+    Result prefetch(const ColladaMeshes& meshes);
+
+    //  静的バッチ
+    //  有効にすると parse の最後にそのファイルのシーンをマテリアルごとにまとめ、batches() に追加する
+    //  まとめる処理はマテリアル単位で setThreadCount のスレッド数で並列に行う。デフォルトは無効
+    //  遅延解析でもメッシュは parse の中で全て解析する
+    void setStaticBatching(bool enable);
+    bool isStaticBatching() const;
+
+    //  アリーナのブロックを確保するアロケータ
+    //  nullptr(デフォルト)なら malloc / free を使う
+    void setAllocator(Allocator* allocator);
+    Allocator* getAllocator() const;
+
+    //  ログの出力先と出力レベル
+    //  シンクが nullptr(デフォルト)なら何も出力しない。レベルのデフォルトは LOG_WARNING
+    //  TINY_COLLADA_LOG_LEVEL で消したレベルは設定しても出力されない
+    //  解析中には変更しないこと
+    void setLogSink(LogSink sink, void* user_data = nullptr);
+    void setLogLevel(LogLevel level);
+    LogLevel getLogLevel() const;
+
+    //  解析統計
+    //  有効にすると parse のたびにフェーズごとの時間と件数を記録する。デフォルトは無効
+    void setStatisticsEnabled(bool enable);
+    bool isStatisticsEnabled() const;
+    const ParseStatistics& getStatistics() const;
     
-//    const Meshes* meshes() const;
+    //  ジオメトリ単位のメッシュ一覧(ドキュメント順、重複なし)
+    const ColladaMeshes* meshes() const;
     const ColladaScenes* scenes() const;
+
+    //  ノード階層
+    //  scenes() と同じく parse のたびに後ろに追加され、reset で消える
+    const ColladaNodes* nodes() const;
+
+    //  静的バッチ(setStaticBatching(true) のときだけ)
+    //  parse のたびにマテリアルの初出順で後ろに追加され、reset で消える
+    const ColladaBatches* batches() const;
+
+    //  解析結果をバイナリキャッシュに書き出す
+    //  source_path は解析した.dae。サイズとハッシュを記録して読み込み時の照合に使う
+    Result writeCache(
+        const char* const cache_path,
+        const char* const source_path
+    ) const;
+
 private:
     class Impl;
     ::std::unique_ptr<Impl> impl_;
@@ -279,6 +921,210 @@ private:
 };
 
 
+//  複数ファイルの一括解析
+//  ファイルごとに Parser で解析し、複数のファイルをスレッドで並列に解析する
+//  解析中のファイルの合計サイズが上限を超える場合は、空くまで次のファイルの解析を待たせる
+class BatchParser final
+{
+public:
+    //  1ファイル解析するたびに、解析したスレッドから完了順に呼ばれる
+    //  index は paths 上の位置。scenes は呼び出しの間だけ有効で、
+    //  残したいシーンやメッシュは shared_ptr をコピーしておく
+    using Callback = void (*)(
+        size_t index,
+        const char* path,
+        Result result,
+        const ColladaScenes* scenes,
+        void* user_data
+    );
+
+    //  スレッドごとの Parser を作った直後に呼ばれる
+    //  ストリーミング解析やログなどの設定に使う
+    using Setup = void (*)(Parser& parser, void* user_data);
+
+public:
+    BatchParser();
+    ~BatchParser();
+    BatchParser& operator=(const BatchParser&) = delete;	// コピーの禁止
+    BatchParser(const BatchParser&) = delete;
+
+public:
+    //  同時に解析するファイル数
+    //  0(デフォルト)ならCPUのコア数。各 Parser のスレッド数は1のまま
+    void setThreadCount(unsigned int thread_count);
+    unsigned int getThreadCount() const;
+
+    //  同時に解析するファイルの合計サイズの上限(バイト)
+    //  1ファイルで上限を超える場合は、そのファイルだけを解析する
+    void setMaxInFlightBytes(uint64_t bytes);
+    uint64_t getMaxInFlightBytes() const;
+
+    void setParserSetup(Setup setup, void* user_data = nullptr);
+
+    //  解析
+    //  ファイルは paths の順に解析を始め、全て終わるまで戻らない
+    //  失敗したファイルがあれば、その中で paths の先頭に近いもののエラーを返す
+    //  コールバックや解析が例外を投げた場合は残りを中止し、最初の例外を投げなおす
+    Result parse(
+        const char* const* paths,
+        size_t count,
+        Callback callback,
+        void* user_data = nullptr
+    );
+
+private:
+    class Impl;
+    ::std::unique_ptr<Impl> impl_;
+};
+
+
+//  バイナリキャッシュ
+//  Parser::writeCache で書き出したファイルをメモリマップし、
+//  配列ごとの確保やコピーをせずにキャッシュ上のデータを直接参照する
+//  参照は SceneCache を閉じるか破棄するまで有効
+class SceneCache final
+{
+public:
+    //  キャッシュ上の配列データ
+    struct ArrayData
+    {
+        bool isValidate() const {
+            return stride_ != 0;
+        }
+
+        int8_t stride_;
+        ArraySpan<float> data_;
+        ArraySpan<uint32_t> indices_;
+    };
+
+    //  キャッシュ上のサブメッシュ
+    //  ColladaMesh::SubMesh の描画範囲だけを持つ
+    struct SubMesh
+    {
+        uint32_t index_offset_;
+        uint32_t index_count_;
+    };
+
+    //  キャッシュ上のメッシュ
+    struct Mesh
+    {
+        //  描画用インデックスの先頭アドレス
+        const void* getIndexData() const {
+            if (index_type_ == IndexBuffer::TYPE_UINT16) {
+                return indices16_.data();
+            }
+            return indices32_.data();
+        }
+
+        size_t getIndexCount() const {
+            return indices16_.size() + indices32_.size();
+        }
+
+        ColladaMesh::PrimitiveType primitive_type_;
+        ArrayData vertex_;
+        ArrayData normal_;
+        ArrayData uv_;
+        uint8_t interleaved_stride_;
+        ArraySpan<ColladaMesh::InterleavedData::Element> interleaved_layout_;
+        ArraySpan<float> interleaved_data_;
+        IndexBuffer::Type index_type_;
+        ArraySpan<uint16_t> indices16_;
+        ArraySpan<uint32_t> indices32_;
+        ArraySpan<SubMesh> submeshes_;
+    };
+
+    //  キャッシュ上のマテリアル
+    struct Material
+    {
+        const char* shading_name_;
+        const char* texture_name_;
+        ArraySpan<float> diffuse_;
+        ArraySpan<float> ambient_;
+        ArraySpan<float> emission_;
+        ArraySpan<float> specular_;
+        ArraySpan<float> reflective_;
+        float shininess_;
+        float transparency_;
+        float reflectivity_;
+    };
+
+    //  キャッシュ上のシーン
+    //  meshes_ はメッシュ番号、material_ はマテリアル番号(なければ-1)
+    //  node_ はノード番号(なければ ColladaNodes::NO_INDEX)
+    //  submesh_materials_ は meshes_ の順にサブメッシュを並べたときのマテリアル番号(なければ-1)
+    struct Scene
+    {
+        ArraySpan<float> matrix_;
+        ArraySpan<uint32_t> meshes_;
+        int32_t material_;
+        uint32_t node_;
+        ArraySpan<int32_t> submesh_materials_;
+    };
+
+    //  キャッシュ上のノード階層
+    //  並びと行列は ColladaNodes と同じ
+    struct Nodes
+    {
+        size_t size() const {
+            return parents_.size();
+        }
+
+        ArraySpan<uint32_t> parents_;
+        ArraySpan<float> local_matrices_;
+        ArraySpan<float> world_matrices_;
+    };
+
+public:
+    SceneCache();
+    ~SceneCache();
+    SceneCache& operator=(const SceneCache&) = delete;	// コピーの禁止
+    SceneCache(const SceneCache&) = delete;
+
+public:
+    //  キャッシュを開く
+    //  source_path を指定すると元の.daeとサイズ、ハッシュを照合する
+    //  一致しなければ CACHE_MISMATCH
+    Result open(
+        const char* const cache_path,
+        const char* const source_path = nullptr
+    );
+    void close();
+
+    size_t getSceneCount() const;
+    Scene getScene(size_t idx) const;
+
+    size_t getMeshCount() const;
+    Mesh getMesh(size_t idx) const;
+
+    size_t getMaterialCount() const;
+    Material getMaterial(size_t idx) const;
+
+    Nodes getNodes() const;
+    const char* getNodeId(size_t idx) const;
+
+private:
+    class Impl;
+    ::std::unique_ptr<Impl> impl_;
+};
+
+
+//----------------------------------------------------------------------
+//  数値テキスト解析
+//  空白(スペース、タブ、改行)区切りの数値列を out の末尾に追加する
+//  戻り値は読み込んだ数値の数
+size_t readFloatArray(
+    const char* text,
+    size_t length,
+    Vertices* out
+);
+
+size_t readIndexArray(
+    const char* text,
+    size_t length,
+    Indices* out
+);
+
+
 
 
 